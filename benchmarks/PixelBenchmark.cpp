@@ -0,0 +1,147 @@
+// Runs every pixel kernel version the CPU supports on a 4K frame and prints the time per frame. The output is compared
+// with the scalar reference as well, the exhaustive size and alignment checks are in tests/PixelKernelsTest.cpp.
+#include "PixelKernelsImpl.hpp"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+const uint32_t c_frameWidth = 3840;
+const uint32_t c_frameHeight = 2160;
+const int c_iterationCount = 20;
+const double c_frameBudgetMs = 1000.0 / 60.0;
+// Odd sizes so the scalar tails of the SIMD versions get checked too
+const uint32_t c_tailWidth = 46;
+const uint32_t c_tailHeight = 6;
+const size_t c_tailFirstPixel = 37;
+
+const PixelIsa c_isas[] = {PixelIsa::Scalar, PixelIsa::Sse2, PixelIsa::Avx2, PixelIsa::Neon};
+
+struct Frame
+{
+    Frame(uint32_t width, uint32_t height, size_t firstPixel) :
+        width(width),
+        height(height),
+        firstPixel(firstPixel),
+        pixels(size_t(width) * height),
+        yuv(size_t(width) * height * 3 / 2)
+    {
+    }
+
+    uint32_t width;
+    uint32_t height;
+    size_t firstPixel;
+    std::vector<uint32_t> pixels;
+    std::vector<uint8_t> yuv;
+};
+
+// Covers every byte value and translucent alpha, the test pattern alone is always opaque
+std::vector<uint32_t> createSource(size_t count)
+{
+    std::vector<uint32_t> source(count);
+    uint32_t state = 0x12345678;
+    for (uint32_t& pixel : source)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        pixel = state;
+    }
+    return source;
+}
+
+std::vector<uint8_t> getPixelBytes(const Frame& frame)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(frame.pixels.data());
+    return std::vector<uint8_t>(bytes, bytes + frame.pixels.size() * sizeof(uint32_t));
+}
+
+std::vector<uint8_t> getYuvBytes(const Frame& frame)
+{
+    return frame.yuv;
+}
+
+void convertNv12(const PixelKernelTable& table, const uint32_t* source, Frame& frame)
+{
+    uint8_t* luma = frame.yuv.data();
+    uint8_t* chroma = luma + size_t(frame.width) * frame.height;
+    convertRgbaToYuv420(table, reinterpret_cast<const uint8_t*>(source), frame.width * 4, frame.width, frame.height, luma, frame.width, chroma, chroma + 1, frame.width, 2);
+}
+
+void convertI420(const PixelKernelTable& table, const uint32_t* source, Frame& frame)
+{
+    uint8_t* luma = frame.yuv.data();
+    uint8_t* u = luma + size_t(frame.width) * frame.height;
+    uint8_t* v = u + size_t(frame.width / 2) * (frame.height / 2);
+    convertRgbaToYuv420(table, reinterpret_cast<const uint8_t*>(source), frame.width * 4, frame.width, frame.height, luma, frame.width, u, v, frame.width / 2, 1);
+}
+
+// Runs one kernel with every supported version, checks the output against the scalar reference and prints the time
+template<typename Run>
+bool benchmarkKernel(const char* name, Frame& frame, Frame& tailFrame, Run run, std::vector<uint8_t> (*getOutput)(const Frame&))
+{
+    std::vector<uint8_t> reference;
+    bool matches = true;
+    for (PixelIsa isa : c_isas)
+    {
+        const PixelKernelTable* table = getPixelKernelTable(isa);
+        if (table == nullptr)
+        {
+            continue;
+        }
+
+        run(*table, tailFrame);
+        run(*table, frame);
+        std::vector<uint8_t> output = getOutput(frame);
+        const std::vector<uint8_t> tailOutput = getOutput(tailFrame);
+        output.insert(output.end(), tailOutput.begin(), tailOutput.end());
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < c_iterationCount; ++i)
+        {
+            run(*table, frame);
+        }
+        const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+        const double frameMs = duration.count() / c_iterationCount;
+
+        bool valid = true;
+        if (isa == PixelIsa::Scalar)
+        {
+            reference = std::move(output);
+        }
+        else
+        {
+            valid = output == reference;
+            matches = matches && valid;
+        }
+        printf("%-14s %-6s %8.3f ms %8.1f Mpixel/s%s%s\n", name, getPixelIsaName(isa), frameMs, frame.pixels.size() / frameMs / 1000.0, frameMs <= c_frameBudgetMs ? "" : " over 60 Hz budget",
+               valid ? "" : " MISMATCH");
+    }
+    return matches;
+}
+} // namespace
+
+int main()
+{
+    printf("Pixel kernels: %s selected, %ux%u frame\n", getPixelIsaName(getPixelIsa()), c_frameWidth, c_frameHeight);
+
+    const std::vector<uint32_t> source = createSource(size_t(c_frameWidth) * c_frameHeight);
+    Frame frame(c_frameWidth, c_frameHeight, 0);
+    Frame tailFrame(c_tailWidth, c_tailHeight, c_tailFirstPixel);
+
+    auto fill = [](const PixelKernelTable& table, Frame& f) { table.fillTestPattern(f.pixels.data(), f.pixels.size(), f.firstPixel); };
+    auto swizzle = [&](const PixelKernelTable& table, Frame& f) { table.swizzleRgbaBgra(source.data(), f.pixels.data(), f.pixels.size()); };
+    auto premultiply = [&](const PixelKernelTable& table, Frame& f) { table.premultiplyAlpha(source.data(), f.pixels.data(), f.pixels.size()); };
+    auto nv12 = [&](const PixelKernelTable& table, Frame& f) { convertNv12(table, source.data(), f); };
+    auto i420 = [&](const PixelKernelTable& table, Frame& f) { convertI420(table, source.data(), f); };
+
+    bool matches = benchmarkKernel("fill", frame, tailFrame, fill, getPixelBytes);
+    matches = benchmarkKernel("swizzle", frame, tailFrame, swizzle, getPixelBytes) && matches;
+    matches = benchmarkKernel("premultiply", frame, tailFrame, premultiply, getPixelBytes) && matches;
+    matches = benchmarkKernel("RGBA to NV12", frame, tailFrame, nv12, getYuvBytes) && matches;
+    matches = benchmarkKernel("RGBA to I420", frame, tailFrame, i420, getYuvBytes) && matches;
+
+    printf(matches ? "All versions match the scalar reference\n" : "ERROR: Some versions differ from the scalar reference\n");
+    return matches ? 0 : 1;
+}
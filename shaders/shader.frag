@@ -1,12 +1,47 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// Every conversion step is a specialization constant so that a variant only contains the steps it needs. The generic
+// variant reads the same steps from the push constant instead and is used while a specialized variant compiles.
+layout(constant_id = 0) const bool c_generic = true;
+layout(constant_id = 1) const bool c_srgbDecode = false;
+layout(constant_id = 2) const bool c_premultiply = false;
+
+// Same bit layout as BlitVariant::getKey
+const uint c_srgbDecodeBit = 1u;
+const uint c_premultiplyBit = 1u << 1;
+
 layout(set = 0, binding = 0) uniform sampler2D srcImage;
+layout(push_constant) uniform Conversion
+{
+    uint key;
+} conversion;
+
 layout(location = 0) in vec2 inUV;
 
 layout(location = 0) out vec4 outColor;
 
-void main() 
+bool hasStep(bool specialized, uint bit)
 {
-    outColor = texture(srcImage, inUV);
+    return c_generic ? (conversion.key & bit) != 0 : specialized;
+}
+
+vec3 srgbToLinear(vec3 c)
+{
+    return mix(c / 12.92, pow((c + 0.055) / 1.055, vec3(2.4)), greaterThan(c, vec3(0.04045)));
+}
+
+void main()
+{
+    vec4 color = texture(srcImage, inUV);
+    if (hasStep(c_srgbDecode, c_srgbDecodeBit))
+    {
+        color.rgb = srgbToLinear(color.rgb);
+    }
+    if (hasStep(c_premultiply, c_premultiplyBit))
+    {
+        color.rgb *= color.a;
+    }
+
+    outColor = color;
 }
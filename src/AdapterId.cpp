@@ -0,0 +1,106 @@
+#include "AdapterId.hpp"
+#include "Utils.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+const char* c_adapterOverrideVariable = "DXVK_INTEROP_ADAPTER";
+
+bool hexToBytes(const char* hex, uint8_t* bytes, size_t size)
+{
+    if (std::strlen(hex) != size * 2)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        const char byteString[3] = {hex[i * 2], hex[i * 2 + 1], '\0'};
+        char* end = nullptr;
+        bytes[i] = static_cast<uint8_t>(std::strtoul(byteString, &end, 16));
+        if (end != byteString + 2)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+AdapterId getAdapterOverride()
+{
+    AdapterId id;
+
+    const char* value = std::getenv(c_adapterOverrideVariable);
+    if (value == nullptr)
+    {
+        return id;
+    }
+
+    if (std::strncmp(value, "index:", 6) == 0)
+    {
+        id.index = std::atoi(value + 6);
+    }
+    else if (std::strncmp(value, "luid:", 5) == 0)
+    {
+        id.luidValid = hexToBytes(value + 5, id.luid, sizeof(id.luid));
+    }
+    else if (std::strncmp(value, "uuid:", 5) == 0)
+    {
+        id.uuidValid = hexToBytes(value + 5, id.uuid, sizeof(id.uuid));
+    }
+
+    if (id.index < 0 && !hasAdapterIdentity(id))
+    {
+        printf("Ignoring invalid %s value '%s'\n", c_adapterOverrideVariable, value);
+    }
+    return id;
+}
+
+bool hasAdapterIdentity(const AdapterId& id)
+{
+    return id.luidValid || id.uuidValid;
+}
+
+bool matchesAdapter(const AdapterId& id, const uint8_t* luid, bool luidValid, const uint8_t* uuid)
+{
+    if (id.uuidValid && std::memcmp(id.uuid, uuid, sizeof(id.uuid)) != 0)
+    {
+        return false;
+    }
+    if (id.luidValid && luidValid)
+    {
+        return std::memcmp(id.luid, luid, sizeof(id.luid)) == 0;
+    }
+    return id.uuidValid;
+}
+
+std::string describeAdapter(const AdapterId& id)
+{
+    std::string description;
+    if (id.luidValid)
+    {
+        description = "luid " + bytesToHex(id.luid, sizeof(id.luid));
+    }
+    if (id.uuidValid)
+    {
+        description += (description.empty() ? "uuid " : ", uuid ") + bytesToHex(id.uuid, sizeof(id.uuid));
+    }
+    return description;
+}
+
+std::string bytesToHex(const uint8_t* bytes, size_t size)
+{
+    static const char c_digits[] = "0123456789abcdef";
+
+    std::string hex;
+    hex.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hex.push_back(c_digits[bytes[i] >> 4]);
+        hex.push_back(c_digits[bytes[i] & 0xf]);
+    }
+    return hex;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Identifies a GPU across APIs, by LUID on Windows and by device UUID where LUIDs are not available
+struct AdapterId
+{
+    bool luidValid = false;
+    uint8_t luid[8]{};
+    bool uuidValid = false;
+    uint8_t uuid[16]{};
+    // Adapter index requested by the user, -1 if not set
+    int index = -1;
+};
+
+// User override from DXVK_INTEROP_ADAPTER, accepts "index:<n>", "luid:<16 hex digits>" or "uuid:<32 hex digits>"
+AdapterId getAdapterOverride();
+bool hasAdapterIdentity(const AdapterId& id);
+// A requested UUID has to match as well, the LUID is compared when both sides have one
+bool matchesAdapter(const AdapterId& id, const uint8_t* luid, bool luidValid, const uint8_t* uuid);
+// The identities that are set, e.g. "luid 0123456789abcdef", for messages
+std::string describeAdapter(const AdapterId& id);
+std::string bytesToHex(const uint8_t* bytes, size_t size);
@@ -0,0 +1,105 @@
+#include "AllocationCounter.hpp"
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+
+namespace
+{
+// Per thread so that no synchronization is needed and other threads don't show up in the frame loop's count
+thread_local uint64_t s_allocationCount = 0;
+} // namespace
+
+uint64_t getHeapAllocationCount()
+{
+    return s_allocationCount;
+}
+
+#ifdef DXVK_INTEROP_COUNT_ALLOCATIONS
+
+namespace
+{
+void* countedAllocate(size_t size)
+{
+    ++s_allocationCount;
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+// The CRT has no aligned_alloc, memory from _aligned_malloc must be freed with _aligned_free
+void* countedAlignedAllocate(size_t size, std::align_val_t alignment)
+{
+    ++s_allocationCount;
+    void* ptr = _aligned_malloc(size == 0 ? 1 : size, static_cast<size_t>(alignment));
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+} // namespace
+
+void* operator new(size_t size)
+{
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return countedAllocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return countedAlignedAllocate(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return countedAlignedAllocate(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t /*alignment*/) noexcept
+{
+    _aligned_free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t /*alignment*/) noexcept
+{
+    _aligned_free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/, std::align_val_t /*alignment*/) noexcept
+{
+    _aligned_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t /*size*/, std::align_val_t /*alignment*/) noexcept
+{
+    _aligned_free(ptr);
+}
+
+#endif
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts heap allocations done through the global operator new, used to verify that the frame loop is allocation free.
+// The operators are only replaced when built with DXVK_INTEROP_COUNT_ALLOCATIONS, otherwise the count stays zero.
+// Returns the count of the calling thread, background threads such as the shader watcher allocate independently.
+uint64_t getHeapAllocationCount();
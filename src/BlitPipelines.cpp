@@ -0,0 +1,390 @@
+#include "BlitPipelines.hpp"
+#include "Context.hpp"
+#include "Trace.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+namespace
+{
+// Same location the build writes the SPIR-V to, relative to the working directory
+const std::filesystem::path c_vertexShaderPath("shaders/shader.vert.spv");
+const std::filesystem::path c_fragmentShaderPath("shaders/shader.frag.spv");
+
+struct SpecializationData
+{
+    VkBool32 generic;
+    VkBool32 srgbDecode;
+    VkBool32 premultiply;
+};
+
+// Constant ids as declared in shader.frag
+const std::array<VkSpecializationMapEntry, 3> c_specializationEntries{{
+    {0, offsetof(SpecializationData, generic), sizeof(VkBool32)}, //
+    {1, offsetof(SpecializationData, srgbDecode), sizeof(VkBool32)}, //
+    {2, offsetof(SpecializationData, premultiply), sizeof(VkBool32)} //
+}};
+
+bool isSrgbFormat(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A8B8G8R8_SRGB_PACK32:
+        return true;
+    default:
+        return false;
+    }
+}
+} // namespace
+
+uint32_t BlitVariant::getKey() const
+{
+    return (srgbDecode ? 1u : 0u) | (premultiply ? 1u << 1 : 0u);
+}
+
+BlitVariant selectBlitVariant(VkFormat target, VkCompositeAlphaFlagBitsKHR compositeAlpha)
+{
+    // Sampling and storing convert between the channel orders of the source and the target, so only the transfer
+    // function and the alpha mode can differ. An sRGB target encodes on store, the values are decoded first to cancel it.
+    BlitVariant variant;
+    variant.srgbDecode = isSrgbFormat(target);
+    variant.premultiply = compositeAlpha == VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR;
+    return variant;
+}
+
+BlitPipelines::BlitPipelines(const Context& context, VkRenderPass renderPass, VkPipelineLayout pipelineLayout) :
+    m_context(context),
+    m_device(context.getDevice()),
+    m_renderPass(renderPass),
+    m_pipelineLayout(pipelineLayout)
+{
+    VkPipelineCacheCreateInfo pipelineCacheInfo{};
+    pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    VK_CHECK(vkCreatePipelineCache(m_device, &pipelineCacheInfo, m_context.getAllocator(AllocationSite::Pipeline), &m_pipelineCache));
+
+    std::vector<uint32_t> vertexCode;
+    std::vector<uint32_t> fragmentCode;
+    CHECK(readSpirvFile(c_vertexShaderPath, vertexCode));
+    CHECK(readSpirvFile(c_fragmentShaderPath, fragmentCode));
+    m_generation = createGeneration(vertexCode, fragmentCode, {});
+    CHECK(m_generation != nullptr);
+}
+
+BlitPipelines::~BlitPipelines()
+{
+    std::vector<Generation*> generations{m_generation.get()};
+    std::unique_ptr<Generation> reloaded = m_reload.valid() ? m_reload.get() : nullptr;
+    if (reloaded)
+    {
+        generations.push_back(reloaded.get());
+    }
+
+    for (Generation* generation : generations)
+    {
+        for (auto& variant : generation->variants)
+        {
+            Entry& entry = variant.second;
+            if (entry.pipeline == VK_NULL_HANDLE)
+            {
+                entry.pipeline = entry.compilation.get();
+            }
+            vkDestroyPipeline(m_device, entry.pipeline, m_context.getAllocator(AllocationSite::Pipeline));
+        }
+        vkDestroyPipeline(m_device, generation->genericPipeline, m_context.getAllocator(AllocationSite::Pipeline));
+        vkDestroyShaderModule(m_device, generation->fragmentShaderModule, nullptr);
+        vkDestroyShaderModule(m_device, generation->vertexShaderModule, nullptr);
+    }
+    vkDestroyPipelineCache(m_device, m_pipelineCache, m_context.getAllocator(AllocationSite::Pipeline));
+}
+
+bool BlitPipelines::beginFrame(DeletionQueue& deletionQueue, uint64_t frameIndex)
+{
+    // The shader modules of the live set are destroyed on swap, so it waits until no variant is compiling from them
+    if (!m_reload.valid() || m_reload.wait_for(std::chrono::seconds(0)) != std::future_status::ready || isCompiling())
+    {
+        return false;
+    }
+
+    std::unique_ptr<Generation> reloaded = m_reload.get();
+    bool swapped = false;
+    if (reloaded)
+    {
+        std::unique_ptr<Generation> retired = std::move(m_generation);
+        m_generation = std::move(reloaded);
+        for (auto& variant : retired->variants)
+        {
+            Entry& entry = variant.second;
+            if (entry.pipeline == VK_NULL_HANDLE)
+            {
+                entry.pipeline = entry.compilation.get();
+            }
+            deletionQueue.retire(entry.pipeline, m_context.getAllocator(AllocationSite::Pipeline), frameIndex);
+        }
+        deletionQueue.retire(retired->genericPipeline, m_context.getAllocator(AllocationSite::Pipeline), frameIndex);
+        // Pipelines don't reference their modules after creation
+        vkDestroyShaderModule(m_device, retired->fragmentShaderModule, nullptr);
+        vkDestroyShaderModule(m_device, retired->vertexShaderModule, nullptr);
+        printf("Blit pipelines reloaded\n");
+        swapped = true;
+    }
+    else
+    {
+        LOGW("Failed to build the reloaded shaders, keeping the previous pipelines");
+    }
+
+    if (m_reloadPending)
+    {
+        m_reloadPending = false;
+        reload();
+    }
+    return swapped;
+}
+
+void BlitPipelines::reload()
+{
+    // The running reload may have read the files before the latest change, so another one follows it
+    if (m_reload.valid())
+    {
+        m_reloadPending = true;
+        return;
+    }
+
+    // Read here so that the build uses exactly these bytes even if the files are replaced while it runs
+    std::vector<uint32_t> vertexCode;
+    std::vector<uint32_t> fragmentCode;
+    if (!readSpirvFile(c_vertexShaderPath, vertexCode) || !readSpirvFile(c_fragmentShaderPath, fragmentCode))
+    {
+        LOGW("Failed to read the reloaded shaders, keeping the previous pipelines");
+        return;
+    }
+
+    std::vector<BlitVariant> variants;
+    for (const auto& variant : m_generation->variants)
+    {
+        variants.push_back(variant.second.variant);
+    }
+    m_reload = std::async(std::launch::async, [this, vertexCode = std::move(vertexCode), fragmentCode = std::move(fragmentCode), variants]() {
+        TRACE_SCOPE("Blit pipelines reload");
+        return createGeneration(vertexCode, fragmentCode, variants);
+    });
+}
+
+void BlitPipelines::prepare(const BlitVariant& variant)
+{
+    const uint32_t key = variant.getKey();
+    if (m_generation->variants.find(key) != m_generation->variants.end())
+    {
+        return;
+    }
+
+    Entry& entry = m_generation->variants[key];
+    entry.variant = variant;
+    entry.compilation = std::async(std::launch::async, [this, generation = m_generation.get(), variant]() {
+        TRACE_SCOPE("Blit variant compile");
+        // The generic pipeline was built from the same modules, so a failure here is not a shader error
+        VkPipeline pipeline;
+        VK_CHECK(createPipeline(*generation, &variant, pipeline));
+        return pipeline;
+    });
+}
+
+VkPipeline BlitPipelines::get(const BlitVariant& variant)
+{
+    auto it = m_generation->variants.find(variant.getKey());
+    if (it == m_generation->variants.end())
+    {
+        prepare(variant);
+        return m_generation->genericPipeline;
+    }
+
+    Entry& entry = it->second;
+    if (entry.pipeline == VK_NULL_HANDLE)
+    {
+        if (entry.compilation.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            return m_generation->genericPipeline;
+        }
+        entry.pipeline = entry.compilation.get();
+    }
+    return entry.pipeline;
+}
+
+std::unique_ptr<BlitPipelines::Generation> BlitPipelines::createGeneration(const std::vector<uint32_t>& vertexCode, const std::vector<uint32_t>& fragmentCode, const std::vector<BlitVariant>& variants) const
+{
+    std::unique_ptr<Generation> generation = std::make_unique<Generation>();
+    VkResult result = createShaderModule(m_device, vertexCode, generation->vertexShaderModule);
+    if (result == VK_SUCCESS)
+    {
+        result = createShaderModule(m_device, fragmentCode, generation->fragmentShaderModule);
+    }
+    if (result == VK_SUCCESS)
+    {
+        result = createPipeline(*generation, nullptr, generation->genericPipeline);
+    }
+    for (size_t i = 0; i < variants.size() && result == VK_SUCCESS; ++i)
+    {
+        Entry& entry = generation->variants[variants[i].getKey()];
+        entry.variant = variants[i];
+        result = createPipeline(*generation, &variants[i], entry.pipeline);
+    }
+
+    if (result != VK_SUCCESS)
+    {
+        printf("WARNING: Failed to create the blit pipelines. Result = %d\n", result);
+        for (auto& variant : generation->variants)
+        {
+            vkDestroyPipeline(m_device, variant.second.pipeline, m_context.getAllocator(AllocationSite::Pipeline));
+        }
+        vkDestroyPipeline(m_device, generation->genericPipeline, m_context.getAllocator(AllocationSite::Pipeline));
+        vkDestroyShaderModule(m_device, generation->fragmentShaderModule, nullptr);
+        vkDestroyShaderModule(m_device, generation->vertexShaderModule, nullptr);
+        return nullptr;
+    }
+    return generation;
+}
+
+bool BlitPipelines::isCompiling() const
+{
+    for (const auto& variant : m_generation->variants)
+    {
+        const Entry& entry = variant.second;
+        if (entry.pipeline == VK_NULL_HANDLE && entry.compilation.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+VkResult BlitPipelines::createPipeline(const Generation& generation, const BlitVariant* variant, VkPipeline& pipeline) const
+{
+    VkPipelineVertexInputStateCreateInfo vertexInputState{};
+    vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputState.vertexBindingDescriptionCount = 0;
+    vertexInputState.pVertexBindingDescriptions = nullptr;
+    vertexInputState.vertexAttributeDescriptionCount = 0;
+    vertexInputState.pVertexAttributeDescriptions = nullptr;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState{};
+    inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblyState.primitiveRestartEnable = VK_FALSE;
+
+    // Viewport and scissor are dynamic so that the same pipeline draws to outputs of any size
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.pViewports = nullptr;
+    viewportState.scissorCount = 1;
+    viewportState.pScissors = nullptr;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationState{};
+    rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationState.depthClampEnable = VK_FALSE;
+    rasterizationState.rasterizerDiscardEnable = VK_FALSE;
+    rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationState.lineWidth = 1.0f;
+    rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
+    rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizationState.depthBiasEnable = VK_FALSE;
+    rasterizationState.depthBiasConstantFactor = 0.0f;
+    rasterizationState.depthBiasClamp = 0.0f;
+    rasterizationState.depthBiasSlopeFactor = 0.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisampleState{};
+    multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleState.sampleShadingEnable = VK_FALSE;
+    multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampleState.minSampleShading = 1.0f;
+    multisampleState.pSampleMask = nullptr;
+    multisampleState.alphaToCoverageEnable = VK_FALSE;
+    multisampleState.alphaToOneEnable = VK_FALSE;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilState{};
+    depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilState.depthTestEnable = VK_TRUE;
+    depthStencilState.depthWriteEnable = VK_TRUE;
+    depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencilState.depthBoundsTestEnable = VK_FALSE;
+    depthStencilState.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachmentState{};
+    colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachmentState.blendEnable = VK_FALSE;
+    colorBlendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendState{};
+    colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendState.logicOpEnable = VK_FALSE;
+    colorBlendState.logicOp = VK_LOGIC_OP_COPY;
+    colorBlendState.attachmentCount = 1;
+    colorBlendState.pAttachments = &colorBlendAttachmentState;
+    colorBlendState.blendConstants[0] = 0.0f;
+    colorBlendState.blendConstants[1] = 0.0f;
+    colorBlendState.blendConstants[2] = 0.0f;
+    colorBlendState.blendConstants[3] = 0.0f;
+
+    const std::array<VkDynamicState, 2> dynamicStates{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = ui32Size(dynamicStates);
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    SpecializationData specializationData{};
+    specializationData.generic = variant == nullptr ? VK_TRUE : VK_FALSE;
+    if (variant != nullptr)
+    {
+        specializationData.srgbDecode = variant->srgbDecode ? VK_TRUE : VK_FALSE;
+        specializationData.premultiply = variant->premultiply ? VK_TRUE : VK_FALSE;
+    }
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = ui32Size(c_specializationEntries);
+    specializationInfo.pMapEntries = c_specializationEntries.data();
+    specializationInfo.dataSize = sizeof(SpecializationData);
+    specializationInfo.pData = &specializationData;
+
+    VkPipelineShaderStageCreateInfo vertexShaderStageInfo{};
+    vertexShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertexShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertexShaderStageInfo.module = generation.vertexShaderModule;
+    vertexShaderStageInfo.pName = "main";
+
+    VkPipelineShaderStageCreateInfo fragmentShaderStageInfo{};
+    fragmentShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragmentShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    fragmentShaderStageInfo.module = generation.fragmentShaderModule;
+    fragmentShaderStageInfo.pName = "main";
+    fragmentShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
+    const std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{vertexShaderStageInfo, fragmentShaderStageInfo};
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = ui32Size(shaderStages);
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pVertexInputState = &vertexInputState;
+    pipelineInfo.pInputAssemblyState = &inputAssemblyState;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizationState;
+    pipelineInfo.pMultisampleState = &multisampleState;
+    pipelineInfo.pDepthStencilState = &depthStencilState;
+    pipelineInfo.pColorBlendState = &colorBlendState;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = m_pipelineLayout;
+    pipelineInfo.renderPass = m_renderPass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    pipeline = VK_NULL_HANDLE;
+    return vkCreateGraphicsPipelines(m_device, m_pipelineCache, 1, &pipelineInfo, m_context.getAllocator(AllocationSite::Pipeline), &pipeline);
+}
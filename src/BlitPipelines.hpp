@@ -0,0 +1,82 @@
+#pragma once
+
+#include "VulkanUtils.hpp"
+#include "DeletionQueue.hpp"
+#include <future>
+#include <memory>
+#include <unordered_map>
+
+class Context;
+
+// Conversion steps of the fragment shader, applied in the declared order
+struct BlitVariant
+{
+    bool srgbDecode = false;
+    bool premultiply = false;
+
+    // Same bit layout as the push constant of the generic shader
+    uint32_t getKey() const;
+};
+
+// The steps needed to show a surface on a target of the given format and composite alpha mode. Every shared format holds
+// full range sRGB encoded RGB with straight alpha, so the source format never adds a step.
+BlitVariant selectBlitVariant(VkFormat target, VkCompositeAlphaFlagBitsKHR compositeAlpha);
+
+// Pipelines for the blit variants, the conversion steps are specialization constants so that each variant only does
+// the work it needs. Variants are compiled on background threads the first time they are asked for and cached by key.
+// Until a variant is ready, the generic pipeline that reads the steps from the push constant is returned instead.
+// Reloaded shaders are compiled into a new set of pipelines in the background, which replaces the live set at the start
+// of a frame once it is complete. A reload that fails to build keeps the live set.
+class BlitPipelines final
+{
+public:
+    BlitPipelines(const Context& context, VkRenderPass renderPass, VkPipelineLayout pipelineLayout);
+    ~BlitPipelines();
+    BlitPipelines(const BlitPipelines&) = delete;
+    BlitPipelines& operator=(const BlitPipelines&) = delete;
+
+    // Swaps in reloaded pipelines when they are ready, the replaced ones are retired with the given frame index. Returns
+    // true on a swap, everything drawn with the previous shaders is then out of date.
+    bool beginFrame(DeletionQueue& deletionQueue, uint64_t frameIndex);
+    // Starts building the generic pipeline and every cached variant from the current SPIR-V files. While a reload is
+    // building, another one is queued and started once the first has been swapped in.
+    void reload();
+    // Starts compiling the variant if it isn't cached yet
+    void prepare(const BlitVariant& variant);
+    // Compiles in the background on first use and returns the generic pipeline until the variant is ready
+    VkPipeline get(const BlitVariant& variant);
+
+private:
+    struct Entry
+    {
+        BlitVariant variant;
+        std::future<VkPipeline> compilation;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+    };
+
+    // Pipelines built from one version of the shaders
+    struct Generation
+    {
+        VkShaderModule vertexShaderModule = VK_NULL_HANDLE;
+        VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+        VkPipeline genericPipeline = VK_NULL_HANDLE;
+        std::unordered_map<uint32_t, Entry> variants;
+    };
+
+    // Null if a shader module or a pipeline can't be created
+    std::unique_ptr<Generation> createGeneration(const std::vector<uint32_t>& vertexCode, const std::vector<uint32_t>& fragmentCode, const std::vector<BlitVariant>& variants) const;
+    bool isCompiling() const;
+    // Null variant for the generic pipeline
+    VkResult createPipeline(const Generation& generation, const BlitVariant* variant, VkPipeline& pipeline) const;
+
+    const Context& m_context;
+    VkDevice m_device;
+    VkRenderPass m_renderPass;
+    VkPipelineLayout m_pipelineLayout;
+    // Shared by every generation so that unchanged stages compile faster after a reload
+    VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+    std::unique_ptr<Generation> m_generation;
+    std::future<std::unique_ptr<Generation>> m_reload;
+    // Shaders changed again while m_reload was building
+    bool m_reloadPending = false;
+};
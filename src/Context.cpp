@@ -1,15 +1,32 @@
 #include "Context.hpp"
 #include "Utils.hpp"
+#include "Trace.hpp"
+#include "StartupTimeline.hpp"
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <windows.h>
+#include <vulkan/vulkan_win32.h>
 
 #include <set>
+#include <array>
 #include <algorithm>
+#include <cstring>
+#include <future>
 
 namespace
 {
 const uint64_t c_timeout = 10'000'000'000;
 const VkPresentModeKHR c_presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+const size_t c_keyEventCapacity = 64;
+const uint64_t c_unsubmittedFrameIndex = UINT64_MAX;
+// Enabled when available, the renderer picks its texture path based on what is present
+const std::array<const char*, 5> c_optionalDeviceExtensions = {
+    VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME, //
+    VK_KHR_EXTERNAL_SEMAPHORE_WIN32_EXTENSION_NAME, //
+    VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME, //
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, //
+    VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME //
+};
 
 VKAPI_ATTR VkBool32 VKAPI_CALL debugUtilsCallback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
                                                   VkDebugUtilsMessageTypeFlagsEXT message_type,
@@ -54,45 +71,41 @@ std::vector<const char*> getRequiredInstanceExtensions()
 }
 } // namespace
 
-Context::Context()
+Context::Context(const AdapterId& preferredAdapter) :
+    m_preferredAdapter(preferredAdapter)
 {
+    m_keyEvents.reserve(c_keyEventCapacity);
+    m_frameKeyEvents.reserve(c_keyEventCapacity);
+
     initGLFW();
-    createInstance();
-    createWindow();
-    enumeratePhysicalDevice();
-    createDevice();
-    createSwapchain();
-    createCommandPools();
-    createSemaphores();
-    createFences();
+    {
+        // Loading the instance with its layers is slow and doesn't need the window, GLFW windows are created on the main thread
+        std::future<void> instance = std::async(std::launch::async, [this]() {
+            StartupStep step("Vulkan instance");
+            createInstance();
+        });
+        {
+            StartupStep step("Window");
+            createWindow();
+        }
+        instance.get();
+    }
+    VK_CHECK(glfwCreateWindowSurface(m_instance, m_window, getAllocator(AllocationSite::Surface), &m_surface));
+    createDeviceObjects();
 }
 
 Context::~Context()
 {
-    vkDeviceWaitIdle(m_device);
-
-    for (VkFence fence : m_inFlightFences)
-    {
-        vkDestroyFence(m_device, fence, nullptr);
-    }
-
-    vkDestroySemaphore(m_device, m_renderFinished, nullptr);
-    vkDestroySemaphore(m_device, m_imageAvailable, nullptr);
-    vkDestroyCommandPool(m_device, m_computeCommandPool, nullptr);
-    vkDestroyCommandPool(m_device, m_graphicsCommandPool, nullptr);
-
-    vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
-
-    vkDestroyDevice(m_device, nullptr);
+    destroyDeviceObjects();
 
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
     glfwDestroyWindow(m_window);
     glfwTerminate();
 
     auto vkDestroyDebugUtilsMessengerEXT = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(m_instance, "vkDestroyDebugUtilsMessengerEXT");
     CHECK(vkDestroyDebugUtilsMessengerEXT);
-    vkDestroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, nullptr);
-    vkDestroyInstance(m_instance, nullptr);
+    vkDestroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, getAllocator(AllocationSite::Instance));
+    vkDestroyInstance(m_instance, getAllocator(AllocationSite::Instance));
+    m_hostAllocator.printReport();
 }
 
 GLFWwindow* Context::getGlfwWindow() const
@@ -125,52 +138,203 @@ VkQueue Context::getGraphicsQueue() const
     return m_graphicsQueue;
 }
 
+uint32_t Context::getGraphicsQueueFamilyIndex() const
+{
+    return m_graphicsQueueFamilyIndex;
+}
+
 VkCommandPool Context::getGraphicsCommandPool() const
 {
     return m_graphicsCommandPool;
 }
 
+bool Context::hasTransferQueue() const
+{
+    return m_transferQueue != VK_NULL_HANDLE;
+}
+
+uint32_t Context::getTransferQueueFamilyIndex() const
+{
+    return m_transferQueueFamilyIndex;
+}
+
+VkCommandPool Context::getTransferCommandPool() const
+{
+    return m_transferCommandPool;
+}
+
+SubmitBatch& Context::getTransferBatch()
+{
+    return m_transferBatch;
+}
+
 VkSurfaceKHR Context::getSurface() const
 {
     return m_surface;
 }
 
+const AdapterId& Context::getPreferredAdapter() const
+{
+    return m_preferredAdapter;
+}
+
+const VkAllocationCallbacks* Context::getAllocator(AllocationSite site) const
+{
+    return m_hostAllocator.getCallbacks(site);
+}
+
+bool Context::isDeviceExtensionEnabled(const char* extensionName) const
+{
+    for (const char* extension : m_enabledDeviceExtensions)
+    {
+        if (std::strcmp(extension, extensionName) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Context::recover()
+{
+    destroyDeviceObjects();
+
+    VK_CHECK(glfwCreateWindowSurface(m_instance, m_window, getAllocator(AllocationSite::Surface), &m_surface));
+    m_physicalDevice = VK_NULL_HANDLE;
+    createDeviceObjects();
+}
+
 bool Context::update()
 {
     glfwPollEvents();
     return !(glfwWindowShouldClose(m_window) || m_shouldQuit);
 }
 
-std::vector<Context::KeyEvent> Context::getKeyEvents()
+const std::vector<Context::KeyEvent>& Context::getKeyEvents()
 {
-    std::vector<KeyEvent> events = m_keyEvents;
-    m_keyEvents.clear();
-    return events;
+    // Swap instead of copy so that both buffers keep their capacity
+    m_frameKeyEvents.clear();
+    std::swap(m_keyEvents, m_frameKeyEvents);
+    return m_frameKeyEvents;
 }
 
-uint32_t Context::acquireNextSwapchainImage()
+bool Context::acquireNextSwapchainImage(uint32_t& imageIndex)
 {
-    VK_CHECK(vkAcquireNextImageKHR(m_device, m_swapchain, c_timeout, m_imageAvailable, VK_NULL_HANDLE, &m_imageIndex));
-    VK_CHECK(vkWaitForFences(m_device, 1, &m_inFlightFences[m_imageIndex], true, c_timeout));
+    TRACE_SCOPE("acquireNextSwapchainImage");
+    m_hostAllocator.beginFrame(m_frameIndex);
+    if (m_swapchainOutOfDate && !recreateSwapchain())
+    {
+        return false;
+    }
+
+    const VkResult acquireResult = vkAcquireNextImageKHR(m_device, m_swapchain, c_timeout, m_imageAvailable, VK_NULL_HANDLE, &m_imageIndex);
+    if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        m_swapchainOutOfDate = true;
+        return false;
+    }
+    // The presentation engine did not release an image in time, the device itself is fine so the frame is just skipped
+    if (acquireResult == VK_TIMEOUT || acquireResult == VK_NOT_READY)
+    {
+        printf("WARNING: Swapchain image not available, skipping the frame\n");
+        return false;
+    }
+    if (acquireResult != VK_SUBOPTIMAL_KHR)
+    {
+        VK_CHECK(acquireResult);
+    }
+
+    // A fence that does not signal within the timeout means the GPU is hung
+    const VkResult waitResult = vkWaitForFences(m_device, 1, &m_inFlightFences[m_imageIndex], true, c_timeout);
+    if (waitResult == VK_TIMEOUT)
+    {
+        throwRecoverableError("vkWaitForFences", __FILE__, __LINE__, waitResult);
+    }
+    VK_CHECK(waitResult);
     VK_CHECK(vkResetFences(m_device, 1, &m_inFlightFences[m_imageIndex]));
-    return m_imageIndex;
+    m_completedFrameIndex = std::max(m_completedFrameIndex, m_inFlightFrameIndices[m_imageIndex]);
+    releaseCompletedSetupCommands(m_completedFrameIndex);
+    m_deletionQueue.collect(m_completedFrameIndex);
+
+    m_graphicsBatch.addWait(m_imageAvailable, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+    imageIndex = m_imageIndex;
+    return true;
 }
 
-void Context::submitCommandBuffers(const std::vector<VkCommandBuffer>& commandBuffers)
+bool Context::isSwapchainOutOfDate() const
 {
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    return m_swapchainOutOfDate;
+}
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &m_imageAvailable;
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = ui32Size(commandBuffers);
-    submitInfo.pCommandBuffers = commandBuffers.data();
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &m_renderFinished;
+uint64_t Context::getSwapchainGeneration() const
+{
+    return m_swapchainGeneration;
+}
 
-    VK_CHECK(vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_inFlightFences[m_imageIndex]));
+SubmitBatch& Context::getGraphicsBatch()
+{
+    return m_graphicsBatch;
+}
+
+uint64_t Context::getFrameIndex() const
+{
+    return m_frameIndex;
+}
+
+uint64_t Context::getCompletedFrameIndex() const
+{
+    return m_completedFrameIndex;
+}
+
+DeletionQueue& Context::getDeletionQueue()
+{
+    return m_deletionQueue;
+}
+
+SingleTimeCommand Context::beginSetupCommands()
+{
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = m_graphicsCommandPool;
+    allocInfo.commandBufferCount = 1;
+
+    SingleTimeCommand command;
+    command.commandPool = m_graphicsCommandPool;
+    command.device = m_device;
+    VK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, &command.commandBuffer));
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(command.commandBuffer, &beginInfo));
+    return command;
+}
+
+void Context::submitSetupCommands(const SingleTimeCommand& command)
+{
+    VK_CHECK(vkEndCommandBuffer(command.commandBuffer));
+    m_graphicsBatch.addCommandBuffer(command.commandBuffer);
+    m_pendingSetupCommands.push_back({command, c_unsubmittedFrameIndex});
+}
+
+void Context::submitCommandBuffers(Span<const VkCommandBuffer> commandBuffers)
+{
+    // Timeline waits may be submitted before their signals, but the transfer work goes first so it can start right away
+    m_transferBatch.flush(m_transferQueue);
+    m_graphicsBatch.addCommandBuffers(commandBuffers);
+    m_graphicsBatch.addSignal(m_renderFinished, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+    m_graphicsBatch.setFence(m_inFlightFences[m_imageIndex]);
+    m_graphicsBatch.flush(m_graphicsQueue);
+
+    for (PendingSetupCommand& pending : m_pendingSetupCommands)
+    {
+        if (pending.frameIndex == c_unsubmittedFrameIndex)
+        {
+            pending.frameIndex = m_frameIndex;
+        }
+    }
+    m_inFlightFrameIndices[m_imageIndex] = m_frameIndex++;
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -181,7 +345,16 @@ void Context::submitCommandBuffers(const std::vector<VkCommandBuffer>& commandBu
     presentInfo.pImageIndices = &m_imageIndex;
     presentInfo.pResults = nullptr;
 
-    VK_CHECK(vkQueuePresentKHR(m_presentQueue, &presentInfo));
+    TRACE_SCOPE("vkQueuePresentKHR");
+    const VkResult presentResult = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+    if (presentResult == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        m_swapchainOutOfDate = true;
+    }
+    else if (presentResult != VK_SUBOPTIMAL_KHR)
+    {
+        VK_CHECK(presentResult);
+    }
 }
 
 void Context::initGLFW()
@@ -202,7 +375,7 @@ void Context::createInstance()
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_3;
 
     VkDebugUtilsMessengerCreateInfoEXT debugUtilsCreateInfo{};
     debugUtilsCreateInfo.pNext = nullptr;
@@ -241,11 +414,11 @@ void Context::createInstance()
     instanceCreateInfo.ppEnabledLayerNames = c_validationLayers.data();
     instanceCreateInfo.pNext = &validationFeatures;
 
-    VK_CHECK(vkCreateInstance(&instanceCreateInfo, nullptr, &m_instance));
+    VK_CHECK(vkCreateInstance(&instanceCreateInfo, getAllocator(AllocationSite::Instance), &m_instance));
 
     auto vkCreateDebugUtilsMessengerEXT = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(m_instance, "vkCreateDebugUtilsMessengerEXT");
     CHECK(vkCreateDebugUtilsMessengerEXT);
-    VK_CHECK(vkCreateDebugUtilsMessengerEXT(m_instance, &debugUtilsCreateInfo, nullptr, &m_debugMessenger));
+    VK_CHECK(vkCreateDebugUtilsMessengerEXT(m_instance, &debugUtilsCreateInfo, getAllocator(AllocationSite::Instance), &m_debugMessenger));
 }
 
 void Context::createWindow()
@@ -263,8 +436,26 @@ void Context::createWindow()
     //glfwSetInputMode(m_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetWindowUserPointer(m_window, this);
     glfwSetKeyCallback(m_window, keyCallback);
+}
+
+void Context::createDeviceObjects()
+{
+    {
+        StartupStep step("Vulkan device");
+        enumeratePhysicalDevice();
+        createDevice();
+    }
 
-    VK_CHECK(glfwCreateWindowSurface(m_instance, m_window, nullptr, &m_surface));
+    // Swapchain creation talks to the window system, the other objects only need the device
+    std::future<void> swapchain = std::async(std::launch::async, [this]() {
+        StartupStep step("Swapchain");
+        createSwapchain();
+    });
+    createCommandPools();
+    createSemaphores();
+    swapchain.get();
+    // One fence per swapchain image
+    createFences();
 }
 
 void Context::handleKey(GLFWwindow* /*window*/, int key, int /*scancode*/, int action, int /*mods*/)
@@ -285,16 +476,39 @@ void Context::enumeratePhysicalDevice()
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(m_instance, &deviceCount, devices.data());
 
+    // Prefer the device on the same adapter as the D3D11 producer, the shared texture can't be imported elsewhere
+    VkPhysicalDevice firstSuitable = VK_NULL_HANDLE;
     for (VkPhysicalDevice device : devices)
     {
-        if (isDeviceSuitable(device, m_surface))
+        if (!isDeviceSuitable(device, m_surface))
+        {
+            continue;
+        }
+        if (firstSuitable == VK_NULL_HANDLE)
+        {
+            firstSuitable = device;
+        }
+        const VkPhysicalDeviceIDProperties idProperties = getPhysicalDeviceIdProperties(device);
+        if (matchesAdapter(m_preferredAdapter, idProperties.deviceLUID, idProperties.deviceLUIDValid == VK_TRUE, idProperties.deviceUUID))
         {
             m_physicalDevice = device;
             break;
         }
     }
+
+    if (m_physicalDevice == VK_NULL_HANDLE)
+    {
+        if (hasAdapterIdentity(m_preferredAdapter))
+        {
+            printf("WARNING: No suitable Vulkan device matches adapter %s, falling back to the first suitable device\n", describeAdapter(m_preferredAdapter).c_str());
+        }
+        m_physicalDevice = firstSuitable;
+    }
     CHECK(m_physicalDevice != VK_NULL_HANDLE);
 
+    const VkPhysicalDeviceIDProperties idProperties = getPhysicalDeviceIdProperties(m_physicalDevice);
+    printf("Vulkan device luid: %s, uuid: %s\n", idProperties.deviceLUIDValid ? bytesToHex(idProperties.deviceLUID, VK_LUID_SIZE).c_str() : "n/a", bytesToHex(idProperties.deviceUUID, VK_UUID_SIZE).c_str());
+
     //printDeviceExtensions(m_physicalDevice);
     vkGetPhysicalDeviceProperties(m_physicalDevice, &m_physicalDeviceProperties);
     printPhysicalDeviceName(m_physicalDeviceProperties);
@@ -304,12 +518,16 @@ void Context::createDevice()
 {
     const QueueFamilyIndices indices = getQueueFamilies(m_physicalDevice, m_surface);
 
-    const std::set<int> uniqueQueueFamilies = //
+    std::set<int> uniqueQueueFamilies = //
         {
             indices.graphicsFamily,
             indices.computeFamily,
             indices.presentFamily //
         };
+    if (indices.transferFamily != -1)
+    {
+        uniqueQueueFamilies.insert(indices.transferFamily);
+    }
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     const float queuePriority = 1.0f;
@@ -325,24 +543,51 @@ void Context::createDevice()
 
     VkPhysicalDeviceFeatures deviceFeatures{};
 
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.timelineSemaphore = VK_TRUE;
+
+    VkPhysicalDeviceVulkan13Features vulkan13Features{};
+    vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    vulkan13Features.pNext = &vulkan12Features;
+    vulkan13Features.synchronization2 = VK_TRUE;
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &vulkan13Features;
     createInfo.queueCreateInfoCount = ui32Size(queueCreateInfos);
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = ui32Size(c_deviceExtensions);
-    createInfo.ppEnabledExtensionNames = c_deviceExtensions.data();
+    m_enabledDeviceExtensions = c_deviceExtensions;
+    for (const char* extension : c_optionalDeviceExtensions)
+    {
+        if (hasDeviceExtension(m_physicalDevice, extension))
+        {
+            m_enabledDeviceExtensions.push_back(extension);
+        }
+    }
+    createInfo.enabledExtensionCount = ui32Size(m_enabledDeviceExtensions);
+    createInfo.ppEnabledExtensionNames = m_enabledDeviceExtensions.data();
     createInfo.enabledLayerCount = ui32Size(c_validationLayers);
     createInfo.ppEnabledLayerNames = c_validationLayers.data();
 
-    VK_CHECK(vkCreateDevice(m_physicalDevice, &createInfo, nullptr, &m_device));
+    VK_CHECK(vkCreateDevice(m_physicalDevice, &createInfo, getAllocator(AllocationSite::Device), &m_device));
+    m_deletionQueue.setDevice(m_device);
 
     vkGetDeviceQueue(m_device, indices.graphicsFamily, 0, &m_graphicsQueue);
+    m_graphicsQueueFamilyIndex = static_cast<uint32_t>(indices.graphicsFamily);
     vkGetDeviceQueue(m_device, indices.computeFamily, 0, &m_computeQueue);
     vkGetDeviceQueue(m_device, indices.presentFamily, 0, &m_presentQueue);
+    m_transferQueue = VK_NULL_HANDLE;
+    if (indices.transferFamily != -1)
+    {
+        vkGetDeviceQueue(m_device, indices.transferFamily, 0, &m_transferQueue);
+        m_transferQueueFamilyIndex = static_cast<uint32_t>(indices.transferFamily);
+    }
+    printf("Transfer queue: %s\n", hasTransferQueue() ? "dedicated family" : "none, copies run on the graphics queue");
 }
 
-void Context::createSwapchain()
+void Context::createSwapchain(VkSwapchainKHR oldSwapchain)
 {
     const SwapchainCapabilities capabilities = getSwapchainCapabilities(m_physicalDevice, m_surface);
 
@@ -382,12 +627,14 @@ void Context::createSwapchain()
     createInfo.queueFamilyIndexCount = 0;
     createInfo.pQueueFamilyIndices = nullptr;
     createInfo.preTransform = capabilities.surfaceCapabilities.currentTransform;
-    createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    createInfo.compositeAlpha = c_compositeAlpha;
     createInfo.presentMode = c_presentMode;
-    createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // Partial redraw loads the previous content outside the damage, so pixels hidden by other windows must still be
+    // rendered. With clipping they would be undefined and never redrawn, frames without damage are skipped.
+    createInfo.clipped = VK_FALSE;
+    createInfo.oldSwapchain = oldSwapchain;
 
-    VK_CHECK(vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &m_swapchain));
+    VK_CHECK(vkCreateSwapchainKHR(m_device, &createInfo, getAllocator(AllocationSite::Swapchain), &m_swapchain));
 
     uint32_t queriedImageCount;
     vkGetSwapchainImagesKHR(m_device, m_swapchain, &queriedImageCount, nullptr);
@@ -396,6 +643,24 @@ void Context::createSwapchain()
     vkGetSwapchainImagesKHR(m_device, m_swapchain, &queriedImageCount, m_swapchainImages.data());
 }
 
+bool Context::recreateSwapchain()
+{
+    VkSurfaceCapabilitiesKHR surfaceCapabilities;
+    VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physicalDevice, m_surface, &surfaceCapabilities));
+    if (surfaceCapabilities.currentExtent.width == 0 || surfaceCapabilities.currentExtent.height == 0)
+    {
+        return false;
+    }
+
+    // Frames in flight may still present from the old swapchain, it is destroyed once the next frame has completed
+    const VkSwapchainKHR oldSwapchain = m_swapchain;
+    createSwapchain(oldSwapchain);
+    m_deletionQueue.retire(oldSwapchain, getAllocator(AllocationSite::Swapchain), m_frameIndex);
+    m_swapchainOutOfDate = false;
+    ++m_swapchainGeneration;
+    return true;
+}
+
 void Context::createCommandPools()
 {
     const QueueFamilyIndices indices = getQueueFamilies(m_physicalDevice, m_surface);
@@ -405,10 +670,16 @@ void Context::createCommandPools()
     poolInfo.queueFamilyIndex = indices.graphicsFamily;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-    VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_graphicsCommandPool));
+    VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, getAllocator(AllocationSite::CommandPool), &m_graphicsCommandPool));
 
     poolInfo.queueFamilyIndex = indices.computeFamily;
-    VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_computeCommandPool));
+    VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, getAllocator(AllocationSite::CommandPool), &m_computeCommandPool));
+
+    if (hasTransferQueue())
+    {
+        poolInfo.queueFamilyIndex = m_transferQueueFamilyIndex;
+        VK_CHECK(vkCreateCommandPool(m_device, &poolInfo, getAllocator(AllocationSite::CommandPool), &m_transferCommandPool));
+    }
 }
 
 void Context::createSemaphores()
@@ -416,13 +687,14 @@ void Context::createSemaphores()
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_imageAvailable));
-    VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_renderFinished));
+    VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, getAllocator(AllocationSite::Sync), &m_imageAvailable));
+    VK_CHECK(vkCreateSemaphore(m_device, &semaphoreInfo, getAllocator(AllocationSite::Sync), &m_renderFinished));
 }
 
 void Context::createFences()
 {
     m_inFlightFences.resize(m_swapchainImages.size());
+    m_inFlightFrameIndices.assign(m_swapchainImages.size(), 0);
 
     VkFenceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
@@ -431,6 +703,62 @@ void Context::createFences()
 
     for (VkFence& fence : m_inFlightFences)
     {
-        vkCreateFence(m_device, &createInfo, nullptr, &fence);
+        vkCreateFence(m_device, &createInfo, getAllocator(AllocationSite::Sync), &fence);
     }
 }
+
+void Context::releaseCompletedSetupCommands(uint64_t completedFrameIndex)
+{
+    auto completed = [this, completedFrameIndex](const PendingSetupCommand& pending) {
+        if (pending.frameIndex > completedFrameIndex)
+        {
+            return false;
+        }
+        vkFreeCommandBuffers(m_device, pending.command.commandPool, 1, &pending.command.commandBuffer);
+        return true;
+    };
+    m_pendingSetupCommands.erase(std::remove_if(m_pendingSetupCommands.begin(), m_pendingSetupCommands.end(), completed), m_pendingSetupCommands.end());
+}
+
+void Context::destroyDeviceObjects()
+{
+    m_graphicsBatch.clear();
+    m_transferBatch.clear();
+    m_pendingSetupCommands.clear();
+
+    if (m_device != VK_NULL_HANDLE)
+    {
+        vkDeviceWaitIdle(m_device);
+        m_completedFrameIndex = m_frameIndex - 1;
+        m_deletionQueue.flush();
+
+        for (VkFence fence : m_inFlightFences)
+        {
+            vkDestroyFence(m_device, fence, getAllocator(AllocationSite::Sync));
+        }
+        m_inFlightFences.clear();
+
+        vkDestroySemaphore(m_device, m_renderFinished, getAllocator(AllocationSite::Sync));
+        vkDestroySemaphore(m_device, m_imageAvailable, getAllocator(AllocationSite::Sync));
+        vkDestroyCommandPool(m_device, m_transferCommandPool, getAllocator(AllocationSite::CommandPool));
+        vkDestroyCommandPool(m_device, m_computeCommandPool, getAllocator(AllocationSite::CommandPool));
+        vkDestroyCommandPool(m_device, m_graphicsCommandPool, getAllocator(AllocationSite::CommandPool));
+        m_renderFinished = VK_NULL_HANDLE;
+        m_imageAvailable = VK_NULL_HANDLE;
+        m_transferCommandPool = VK_NULL_HANDLE;
+        m_computeCommandPool = VK_NULL_HANDLE;
+        m_graphicsCommandPool = VK_NULL_HANDLE;
+
+        vkDestroySwapchainKHR(m_device, m_swapchain, getAllocator(AllocationSite::Swapchain));
+        m_swapchain = VK_NULL_HANDLE;
+        m_swapchainImages.clear();
+        m_swapchainOutOfDate = false;
+        ++m_swapchainGeneration;
+
+        vkDestroyDevice(m_device, getAllocator(AllocationSite::Device));
+        m_device = VK_NULL_HANDLE;
+    }
+
+    vkDestroySurfaceKHR(m_instance, m_surface, getAllocator(AllocationSite::Surface));
+    m_surface = VK_NULL_HANDLE;
+}
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "VulkanUtils.hpp"
+#include "SubmitBatch.hpp"
+#include "AdapterId.hpp"
+#include "HostAllocator.hpp"
+#include "DeletionQueue.hpp"
 #include <vector>
 
 class GLFWwindow;
@@ -14,7 +18,7 @@ public:
         int action;
     };
 
-    Context();
+    Context(const AdapterId& preferredAdapter = AdapterId{});
     ~Context();
 
     GLFWwindow* getGlfwWindow() const;
@@ -23,44 +27,108 @@ public:
     VkInstance getInstance() const;
     const std::vector<VkImage>& getSwapchainImages() const;
     VkQueue getGraphicsQueue() const;
+    uint32_t getGraphicsQueueFamilyIndex() const;
     VkCommandPool getGraphicsCommandPool() const;
+    // A dedicated transfer queue family is optional, the getters below are only valid when it exists
+    bool hasTransferQueue() const;
+    uint32_t getTransferQueueFamilyIndex() const;
+    VkCommandPool getTransferCommandPool() const;
+    // Flushed to the transfer queue before the graphics batch, so graphics work can wait for its signals
+    SubmitBatch& getTransferBatch();
     VkSurfaceKHR getSurface() const;
+    const AdapterId& getPreferredAdapter() const;
+    bool isDeviceExtensionEnabled(const char* extensionName) const;
+    // Null unless DXVK_INTEROP_HOST_ALLOCATOR is set, an object must be destroyed with the site it was created with
+    const VkAllocationCallbacks* getAllocator(AllocationSite site) const;
+
+    // Rebuilds surface, device, swapchain and synchronization objects in place, instance and window are kept
+    void recover();
 
     bool update();
-    std::vector<KeyEvent> getKeyEvents();
-    uint32_t acquireNextSwapchainImage();
-    void submitCommandBuffers(const std::vector<VkCommandBuffer>& commandBuffers);
+    // Returns the events received since the previous call, the reference is valid until the next call
+    const std::vector<KeyEvent>& getKeyEvents();
+    // False when no image was acquired and the frame has to be skipped, e.g. while the swapchain is out of date
+    bool acquireNextSwapchainImage(uint32_t& imageIndex);
+    // Set when presentation reported the swapchain out of date, it is recreated on the next acquire
+    bool isSwapchainOutOfDate() const;
+    // Incremented whenever the swapchain is recreated, views of the previous images are then stale
+    uint64_t getSwapchainGeneration() const;
+    // Work recorded by any stage of the frame goes to this batch and is flushed with the frame submission
+    SubmitBatch& getGraphicsBatch();
+    // Index of the frame being recorded, frames start from 1
+    uint64_t getFrameIndex() const;
+    // All frames up to this index have finished executing on the GPU
+    uint64_t getCompletedFrameIndex() const;
+    // Objects retired with the current frame index are destroyed once this frame has completed
+    DeletionQueue& getDeletionQueue();
+    // Allocates and begins a one time command buffer from the graphics command pool
+    SingleTimeCommand beginSetupCommands();
+    // Ends the command buffer and submits it with the next frame instead of waiting for the queue to go idle
+    void submitSetupCommands(const SingleTimeCommand& command);
+    void submitCommandBuffers(Span<const VkCommandBuffer> commandBuffers);
 
 private:
     void initGLFW();
     void createInstance();
     void createWindow();
+    // Physical device, device, swapchain, command pools and synchronization objects
+    void createDeviceObjects();
     void handleKey(GLFWwindow* /*window*/, int key, int /*scancode*/, int action, int /*mods*/);
     void enumeratePhysicalDevice();
     void createDevice();
-    void createSwapchain();
+    void createSwapchain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+    // Replaces only the swapchain, false while the window is minimized and has no extent
+    bool recreateSwapchain();
     void createCommandPools();
     void createSemaphores();
     void createFences();
+    void destroyDeviceObjects();
+    // Frees the setup command buffers of every frame up to the completed one, like the deletion queue
+    void releaseCompletedSetupCommands(uint64_t completedFrameIndex);
+
+    struct PendingSetupCommand
+    {
+        SingleTimeCommand command;
+        // Frame that submitted the command buffer, c_unsubmittedFrameIndex until then
+        uint64_t frameIndex;
+    };
 
+    // Declared first so that it outlives every Vulkan object
+    HostAllocator m_hostAllocator;
+    AdapterId m_preferredAdapter;
     VkInstance m_instance;
     VkDebugUtilsMessengerEXT m_debugMessenger;
     GLFWwindow* m_window;
     bool m_shouldQuit = false;
     std::vector<KeyEvent> m_keyEvents;
-    VkSurfaceKHR m_surface;
-    VkPhysicalDevice m_physicalDevice;
+    std::vector<KeyEvent> m_frameKeyEvents;
+    VkSurfaceKHR m_surface = VK_NULL_HANDLE;
+    VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
     VkPhysicalDeviceProperties m_physicalDeviceProperties;
-    VkDevice m_device;
+    VkDevice m_device = VK_NULL_HANDLE;
+    std::vector<const char*> m_enabledDeviceExtensions;
     VkQueue m_graphicsQueue;
+    uint32_t m_graphicsQueueFamilyIndex = 0;
     VkQueue m_computeQueue;
     VkQueue m_presentQueue;
-    VkSwapchainKHR m_swapchain;
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    uint32_t m_transferQueueFamilyIndex = 0;
+    VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
     std::vector<VkImage> m_swapchainImages;
-    VkCommandPool m_graphicsCommandPool;
-    VkCommandPool m_computeCommandPool;
-    VkSemaphore m_imageAvailable;
-    VkSemaphore m_renderFinished;
+    bool m_swapchainOutOfDate = false;
+    uint64_t m_swapchainGeneration = 0;
+    VkCommandPool m_graphicsCommandPool = VK_NULL_HANDLE;
+    VkCommandPool m_computeCommandPool = VK_NULL_HANDLE;
+    VkCommandPool m_transferCommandPool = VK_NULL_HANDLE;
+    VkSemaphore m_imageAvailable = VK_NULL_HANDLE;
+    VkSemaphore m_renderFinished = VK_NULL_HANDLE;
     std::vector<VkFence> m_inFlightFences;
+    std::vector<uint64_t> m_inFlightFrameIndices;
+    uint64_t m_frameIndex = 1;
+    uint64_t m_completedFrameIndex = 0;
+    SubmitBatch m_graphicsBatch;
+    SubmitBatch m_transferBatch;
+    DeletionQueue m_deletionQueue;
+    std::vector<PendingSetupCommand> m_pendingSetupCommands;
     uint32_t m_imageIndex;
 };
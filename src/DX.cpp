@@ -1,13 +1,19 @@
 #include "DX.hpp"
 #include "Utils.hpp"
+#include "VulkanUtils.hpp"
+#include "Trace.hpp"
+#include "PixelKernels.hpp"
 #include <comdef.h>
-#include <d3d11_1.h>
+#include <d3d11_4.h>
 #include <dxgi1_2.h>
 #include <iostream>
+#include <cstring>
 
 namespace
 {
 float clearBlue = 1.0f;
+const int c_bandHeight = 16;
+const size_t c_maxDirtyRects = 16;
 
 template<typename T>
 void releaseDXPtr(T*& ptr)
@@ -19,8 +25,58 @@ void releaseDXPtr(T*& ptr)
     }
 }
 
+// Returns the adapter matching the requested LUID or index, otherwise the first hardware adapter
+IDXGIAdapter1* findAdapter(IDXGIFactory1* factory, const AdapterId& requested)
+{
+    IDXGIAdapter1* selected = nullptr;
+    IDXGIAdapter1* adapter = nullptr;
+    for (UINT i = 0; factory->EnumAdapters1(i, &adapter) != DXGI_ERROR_NOT_FOUND; ++i)
+    {
+        DXGI_ADAPTER_DESC1 desc{};
+        adapter->GetDesc1(&desc);
+
+        const bool isSoftware = (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) != 0;
+        const bool requestedByIndex = requested.index == static_cast<int>(i);
+        const bool requestedByLuid = requested.luidValid && std::memcmp(requested.luid, &desc.AdapterLuid, sizeof(requested.luid)) == 0;
+        const bool isDefault = selected == nullptr && !isSoftware;
+
+        if (requestedByIndex || requestedByLuid)
+        {
+            releaseDXPtr(selected);
+            return adapter;
+        }
+        if (isDefault)
+        {
+            selected = adapter;
+            continue;
+        }
+        adapter->Release();
+    }
+    return selected;
+}
+
+bool isShareableRenderTarget(ID3D11Device* device, DXGI_FORMAT format)
+{
+    const UINT requiredSupport = D3D11_FORMAT_SUPPORT_TEXTURE2D | D3D11_FORMAT_SUPPORT_RENDER_TARGET;
+    UINT support = 0;
+    if (FAILED(device->CheckFormatSupport(format, &support)) || (support & requiredSupport) != requiredSupport)
+    {
+        return false;
+    }
+
+    D3D11_FEATURE_DATA_FORMAT_SUPPORT2 support2{};
+    support2.InFormat = format;
+    const HRESULT hr = device->CheckFeatureSupport(D3D11_FEATURE_FORMAT_SUPPORT2, &support2, sizeof(support2));
+    return SUCCEEDED(hr) && (support2.OutFormatSupport2 & D3D11_FORMAT_SUPPORT2_SHAREABLE) != 0;
+}
+
 void checkHresult(HRESULT hr)
 {
+    if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET || hr == DXGI_ERROR_DEVICE_HUNG)
+    {
+        throw RecoverableError(std::string("HRESULT error: ") + _com_error(hr).ErrorMessage());
+    }
+
     if (FAILED(hr))
     {
         std::cerr << "HRESULT error: " << _com_error(hr).ErrorMessage() << "\n";
@@ -31,38 +87,206 @@ void checkHresult(HRESULT hr)
 
 DX::DX()
 {
+    m_dirtyRects.reserve(c_maxDirtyRects);
 }
 
 DX::~DX()
 {
-    releaseDXPtr(m_rtv);
-    releaseDXPtr(m_dxgiMutex);
-    releaseDXPtr(m_texture);
+    releaseTexture();
+    if (m_readyFenceHandle != nullptr)
+    {
+        CloseHandle(m_readyFenceHandle);
+    }
+
+    releaseDXPtr(m_releaseFence);
+    releaseDXPtr(m_readyFence);
+    releaseDXPtr(m_deviceContext4);
+    releaseDXPtr(m_device5);
+    releaseDXPtr(m_deviceContext1);
     releaseDXPtr(m_deviceContext);
     releaseDXPtr(m_device);
 }
 
-void DX::init()
+AdapterId DX::selectAdapter(const AdapterId& requested)
+{
+    IDXGIFactory1* factory = nullptr;
+    checkHresult(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)&factory));
+
+    // DXGI only identifies adapters by LUID, a requested UUID is resolved through Vulkan first
+    AdapterId resolved = requested;
+    if (requested.uuidValid && !requested.luidValid)
+    {
+        resolved.luidValid = findDeviceLuid(requested.uuid, resolved.luid);
+        if (!resolved.luidValid)
+        {
+            printf("No Vulkan device with a LUID has uuid %s\n", bytesToHex(requested.uuid, sizeof(requested.uuid)).c_str());
+            LOGE("Requested adapter not found");
+        }
+    }
+
+    IDXGIAdapter1* adapter = findAdapter(factory, resolved);
+    CHECK(adapter);
+
+    DXGI_ADAPTER_DESC1 desc{};
+    adapter->GetDesc1(&desc);
+
+    const bool requestedExplicitly = requested.index >= 0 || hasAdapterIdentity(requested);
+    if (resolved.luidValid && std::memcmp(resolved.luid, &desc.AdapterLuid, sizeof(resolved.luid)) != 0)
+    {
+        printf("No DXGI adapter has the requested %s\n", describeAdapter(requested).c_str());
+        LOGE("Requested adapter not found");
+    }
+
+    // A requested UUID is kept, so the Vulkan device has to match it as well as the LUID
+    AdapterId selected = resolved;
+    selected.luidValid = true;
+    std::memcpy(selected.luid, &desc.AdapterLuid, sizeof(selected.luid));
+    printf("DXGI adapter: %ls (%s, %s)\n", desc.Description, describeAdapter(selected).c_str(), requestedExplicitly ? "requested by user" : "default");
+
+    releaseDXPtr(adapter);
+    releaseDXPtr(factory);
+    return selected;
+}
+
+HRESULT DX::createDeviceOnAdapter(const AdapterId& adapterId, ID3D11Device** device, ID3D11DeviceContext** deviceContext)
+{
+    UINT flags = 0;
+#ifdef _DEBUG
+    flags = D3D11_CREATE_DEVICE_DEBUG;
+#endif
+    IDXGIFactory1* factory = nullptr;
+    HRESULT hr = CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)&factory);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // Create the device explicitly on the adapter the Vulkan device was matched against
+    IDXGIAdapter1* adapter = findAdapter(factory, adapterId);
+    CHECK(adapter);
+    hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, 0, flags, nullptr, 0, D3D11_SDK_VERSION, device, nullptr, deviceContext);
+    releaseDXPtr(adapter);
+    releaseDXPtr(factory);
+    return hr;
+}
+
+void DX::init(const AdapterId& adapter)
 {
-    createDevice();
+    createDevice(adapter);
     createTextures();
     createSharedObjects();
+    createReadyFence();
 }
 
 void DX::update()
 {
+    TRACE_SCOPE("DX::update");
     const UINT64 acqKey = 0;
     const UINT64 relKey = 0;
     const DWORD timeOutInMs = 5;
+    m_dirtyRects.clear();
+
+    // Queued on the GPU, the consumer signals the release fence once it has read the previous frame
+    if (m_releaseFence != nullptr)
+    {
+        checkHresult(m_deviceContext4->Wait(m_releaseFence, m_readyFenceValue));
+    }
+
     HRESULT result = m_dxgiMutex->AcquireSync(acqKey, timeOutInMs);
     if (result == WAIT_OBJECT_0)
     {
-        clearBlue = clearBlue < 0.0f ? 1.0f : clearBlue - 0.0003f;
-        float clearColor[4] = {0.0f, 0.0f, clearBlue, 1.0f};
-        m_deviceContext->ClearRenderTargetView(m_rtv, clearColor);
+        if (m_replay != nullptr)
+        {
+            uploadReplayFrames();
+        }
+        else
+        {
+            clearBlue = clearBlue < 0.0f ? 1.0f : clearBlue - 0.0003f;
+            float clearColor[4] = {0.0f, 0.0f, clearBlue, 1.0f};
+            drawBand(clearColor);
+        }
+
+        if (m_recorder != nullptr)
+        {
+            m_recorder->record(m_deviceContext, m_texture, m_dirtyRects);
+        }
     }
     result = m_dxgiMutex->ReleaseSync(relKey);
     checkHresult(result);
+
+    // Signaled every update, also when nothing was written, so that the consumer can always wait for the latest value
+    if (m_readyFence != nullptr)
+    {
+        checkHresult(m_deviceContext4->Signal(m_readyFence, ++m_readyFenceValue));
+        m_deviceContext->Flush();
+    }
+}
+
+void DX::setFrameReplay(FrameReplay* replay)
+{
+    CHECK(m_texture == nullptr);
+    m_replay = replay;
+    if (m_replay != nullptr)
+    {
+        m_format = m_replay->getFormat();
+    }
+}
+
+void DX::drawBand(const float clearColor[4])
+{
+    if (m_clearViewSupported)
+    {
+        // Only a horizontal band sweeping down the texture changes per frame
+        const DirtyRect band{0, m_bandTop, c_texWidth, m_bandTop + c_bandHeight};
+        const D3D11_RECT rect{band.left, band.top, band.right, band.bottom};
+        m_deviceContext1->ClearView(m_rtv, clearColor, &rect, 1);
+        m_dirtyRects.push_back(band);
+        m_bandTop = (m_bandTop + c_bandHeight) % c_texHeight;
+    }
+    else
+    {
+        m_deviceContext->ClearRenderTargetView(m_rtv, clearColor);
+        m_dirtyRects.push_back(DirtyRect{0, 0, c_texWidth, c_texHeight});
+    }
+}
+
+void DX::uploadReplayFrames()
+{
+    for (const ReplayFrame& frame : m_replay->getDueFrames(Tracer::now()))
+    {
+        // Uploaded straight from the file mapping
+        const uint8_t* pixels = frame.pixels;
+        for (const DirtyRect& rect : frame.dirtyRects)
+        {
+            const UINT rowPitch = static_cast<UINT>(rect.right - rect.left) * c_texChannels;
+            const D3D11_BOX box{static_cast<UINT>(rect.left), static_cast<UINT>(rect.top), 0, static_cast<UINT>(rect.right), static_cast<UINT>(rect.bottom), 1};
+            m_deviceContext->UpdateSubresource(m_texture, 0, &box, pixels, rowPitch, 0);
+            pixels += static_cast<size_t>(rowPitch) * (rect.bottom - rect.top);
+            addDirtyRect(rect);
+        }
+    }
+}
+
+void DX::addDirtyRect(const DirtyRect& rect)
+{
+    // Merged into the last one once the list is full so that the frame loop doesn't allocate
+    if (m_dirtyRects.size() < c_maxDirtyRects)
+    {
+        m_dirtyRects.push_back(rect);
+    }
+    else
+    {
+        m_dirtyRects.back() = unite(m_dirtyRects.back(), rect);
+    }
+}
+
+void DX::setReleaseFenceHandle(HANDLE handle)
+{
+    releaseDXPtr(m_releaseFence);
+    if (handle != nullptr)
+    {
+        checkHresult(m_device5->OpenSharedFence(handle, __uuidof(ID3D11Fence), (void**)&m_releaseFence));
+    }
 }
 
 HANDLE DX::getSharedHandle()
@@ -70,14 +294,49 @@ HANDLE DX::getSharedHandle()
     return m_sharedHandle;
 }
 
-void DX::createDevice()
+void DX::requestFormat(Span<const DXGI_FORMAT> formats)
 {
-    UINT flags = 0;
-#ifdef _DEBUG
-    flags = D3D11_CREATE_DEVICE_DEBUG;
-#endif
-    const HRESULT hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, 0, flags, nullptr, 0, D3D11_SDK_VERSION, &m_device, nullptr, &m_deviceContext);
+    for (DXGI_FORMAT format : formats)
+    {
+        if (format == m_format)
+        {
+            return;
+        }
+        // Replayed pixels are uploaded as they were recorded
+        if (m_replay != nullptr || !isShareableRenderTarget(m_device, format))
+        {
+            continue;
+        }
+
+        // The consumer has duplicated the handle of the old texture, its import stays valid until the consumer retires it
+        releaseTexture();
+        m_format = format;
+        createTextures();
+        createSharedObjects();
+        return;
+    }
+}
+
+void DX::createDevice(const AdapterId& adapterId)
+{
+    HRESULT hr = createDeviceOnAdapter(adapterId, &m_device, &m_deviceContext);
     checkHresult(hr);
+
+    // Without ID3D11DeviceContext1 there is no ClearView, every update then covers the full texture
+    if (FAILED(m_deviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&m_deviceContext1)))
+    {
+        m_deviceContext1 = nullptr;
+    }
+
+    if (FAILED(m_device->QueryInterface(__uuidof(ID3D11Device5), (void**)&m_device5)) || FAILED(m_deviceContext->QueryInterface(__uuidof(ID3D11DeviceContext4), (void**)&m_deviceContext4)))
+    {
+        releaseDXPtr(m_device5);
+        releaseDXPtr(m_deviceContext4);
+    }
+
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options{};
+    hr = m_device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+    m_clearViewSupported = m_deviceContext1 != nullptr && SUCCEEDED(hr) && options.ClearView;
 }
 
 void DX::createTextures()
@@ -87,7 +346,7 @@ void DX::createTextures()
     desc.Height = c_texHeight;
     desc.MipLevels = 1;
     desc.ArraySize = 1;
-    desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.Format = m_format;
     desc.SampleDesc.Count = 1;
     desc.Usage = D3D11_USAGE_DEFAULT;
     desc.BindFlags = D3D11_BIND_RENDER_TARGET;
@@ -96,13 +355,11 @@ void DX::createTextures()
     const UINT rowSizeInBytes = c_texWidth * c_texChannels;
     const UINT imageSizeInBytes = c_texWidth * c_texHeight * c_texChannels;
 
-    std::vector<uint8_t> imageData(imageSizeInBytes, 128);
-    for (uint32_t i = 0; i < imageSizeInBytes; i += 4)
+    std::vector<uint32_t> imageData(c_texWidth * c_texHeight);
+    fillTestPattern(imageData.data(), imageData.size());
+    if (m_format == DXGI_FORMAT_B8G8R8A8_UNORM)
     {
-        imageData[i + 0] = i % 200 + 20;
-        imageData[i + 1] = 255 - (i % 255);
-        imageData[i + 2] = 128 + (i % 127);
-        imageData[i + 3] = 255;
+        swizzleRgbaBgra(imageData.data(), imageData.data(), imageData.size());
     }
 
     D3D11_SUBRESOURCE_DATA initData{};
@@ -114,7 +371,7 @@ void DX::createTextures()
     checkHresult(hr);
 
     D3D11_RENDER_TARGET_VIEW_DESC rtvDesc{};
-    rtvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    rtvDesc.Format = m_format;
     rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
     rtvDesc.Texture2D.MipSlice = 0;
     hr = m_device->CreateRenderTargetView(m_texture, &rtvDesc, &m_rtv);
@@ -134,3 +391,30 @@ void DX::createSharedObjects()
     hr = m_texture->QueryInterface(__uuidof(IDXGIKeyedMutex), (LPVOID*)&m_dxgiMutex);
     checkHresult(hr);
 }
+
+void DX::releaseTexture()
+{
+    if (m_sharedHandle != nullptr)
+    {
+        CloseHandle(m_sharedHandle);
+        m_sharedHandle = nullptr;
+    }
+
+    releaseDXPtr(m_rtv);
+    releaseDXPtr(m_dxgiMutex);
+    releaseDXPtr(m_texture);
+}
+
+void DX::createReadyFence()
+{
+    if (m_device5 == nullptr)
+    {
+        printf("Shared fences not supported, the consumer is synchronized with the keyed mutex only\n");
+        return;
+    }
+
+    HRESULT hr = m_device5->CreateFence(0, D3D11_FENCE_FLAG_SHARED, __uuidof(ID3D11Fence), (void**)&m_readyFence);
+    checkHresult(hr);
+    hr = m_readyFence->CreateSharedHandle(nullptr, GENERIC_ALL, nullptr, &m_readyFenceHandle);
+    checkHresult(hr);
+}
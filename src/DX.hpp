@@ -1,31 +1,70 @@
 #pragma once
 
-#include <d3d11.h>
+#include "FrameSource.hpp"
+#include "AdapterId.hpp"
+#include "FrameRecording.hpp"
+#include <d3d11_4.h>
 #include <wrl/client.h>
 
 #include <vector>
 
-class DX
+class DX : public FrameSource
 {
 public:
     DX();
     ~DX();
 
-    void init();
-    void update();
-    HANDLE getSharedHandle();
+    // Resolves the DXGI adapter to use, the returned id carries the adapter LUID for matching the Vulkan device
+    static AdapterId selectAdapter(const AdapterId& requested);
+
+    // Creates a D3D11 device on the given adapter, used by everything that opens the shared texture
+    static HRESULT createDeviceOnAdapter(const AdapterId& adapter, ID3D11Device** device, ID3D11DeviceContext** deviceContext);
+
+    // The texture content comes from the replay instead of being drawn, must be set before init
+    void setFrameReplay(FrameReplay* replay);
+    // Every update is written to the recorder
+    void setFrameRecorder(FrameRecorder* recorder) { m_recorder = recorder; }
+    void init(const AdapterId& adapter);
+    void update() override;
+    HANDLE getSharedHandle() override;
+    DXGI_FORMAT getFormat() const override { return m_format; }
+    void requestFormat(Span<const DXGI_FORMAT> formats) override;
     ID3D11Texture2D* getTexture() { return m_texture; }
+    const std::vector<DirtyRect>& getDirtyRects() const override { return m_dirtyRects; }
+    HANDLE getReadyFenceHandle() override { return m_readyFenceHandle; }
+    uint64_t getReadyFenceValue() const override { return m_readyFenceValue; }
+    void setReleaseFenceHandle(HANDLE handle) override;
 
 private:
-    void createDevice();
+    void createDevice(const AdapterId& adapter);
     void createTextures();
     void createSharedObjects();
+    void releaseTexture();
+    void createReadyFence();
+    void drawBand(const float clearColor[4]);
+    void uploadReplayFrames();
+    void addDirtyRect(const DirtyRect& rect);
 
     ID3D11Device* m_device = nullptr;
     ID3D11DeviceContext* m_deviceContext = nullptr;
+    // Null when the runtime doesn't have it
+    ID3D11DeviceContext1* m_deviceContext1 = nullptr;
+    // Only available from Windows 10 1703 onwards, shared fences are not used without them
+    ID3D11Device5* m_device5 = nullptr;
+    ID3D11DeviceContext4* m_deviceContext4 = nullptr;
+    bool m_clearViewSupported = false;
 
-    ID3D11Texture2D* m_texture;
-    HANDLE m_sharedHandle;
-    IDXGIKeyedMutex* m_dxgiMutex;
-    ID3D11RenderTargetView* m_rtv;
+    DXGI_FORMAT m_format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    ID3D11Texture2D* m_texture = nullptr;
+    HANDLE m_sharedHandle = nullptr;
+    IDXGIKeyedMutex* m_dxgiMutex = nullptr;
+    ID3D11Fence* m_readyFence = nullptr;
+    HANDLE m_readyFenceHandle = nullptr;
+    uint64_t m_readyFenceValue = 0;
+    ID3D11Fence* m_releaseFence = nullptr;
+    ID3D11RenderTargetView* m_rtv = nullptr;
+    std::vector<DirtyRect> m_dirtyRects;
+    int m_bandTop = 0;
+    FrameReplay* m_replay = nullptr;
+    FrameRecorder* m_recorder = nullptr;
 };
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "DeletionQueue.hpp"
+#include "Utils.hpp"
+#include <cstdio>
+
+void DeletionQueue::retire(VkImage image, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex)
+{
+    push(VK_OBJECT_TYPE_IMAGE, (uint64_t)image, allocator, lastUsedFrameIndex);
+}
+
+void DeletionQueue::retire(VkImageView imageView, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex)
+{
+    push(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)imageView, allocator, lastUsedFrameIndex);
+}
+
+void DeletionQueue::retire(VkDeviceMemory memory, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex)
+{
+    push(VK_OBJECT_TYPE_DEVICE_MEMORY, (uint64_t)memory, allocator, lastUsedFrameIndex);
+}
+
+void DeletionQueue::retire(VkBuffer buffer, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex)
+{
+    push(VK_OBJECT_TYPE_BUFFER, (uint64_t)buffer, allocator, lastUsedFrameIndex);
+}
+
+void DeletionQueue::retire(VkFramebuffer framebuffer, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex)
+{
+    push(VK_OBJECT_TYPE_FRAMEBUFFER, (uint64_t)framebuffer, allocator, lastUsedFrameIndex);
+}
+
+void DeletionQueue::retire(VkPipeline pipeline, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex)
+{
+    push(VK_OBJECT_TYPE_PIPELINE, (uint64_t)pipeline, allocator, lastUsedFrameIndex);
+}
+
+void DeletionQueue::retire(VkDescriptorPool descriptorPool, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex)
+{
+    push(VK_OBJECT_TYPE_DESCRIPTOR_POOL, (uint64_t)descriptorPool, allocator, lastUsedFrameIndex);
+}
+
+void DeletionQueue::retire(VkSwapchainKHR swapchain, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex)
+{
+    push(VK_OBJECT_TYPE_SWAPCHAIN_KHR, (uint64_t)swapchain, allocator, lastUsedFrameIndex);
+}
+
+void DeletionQueue::collect(uint64_t completedFrameIndex)
+{
+    auto it = m_entries.begin();
+    for (; it != m_entries.end() && it->lastUsedFrameIndex <= completedFrameIndex; ++it)
+    {
+        destroy(*it);
+    }
+    m_entries.erase(m_entries.begin(), it);
+}
+
+void DeletionQueue::flush()
+{
+    for (const Entry& entry : m_entries)
+    {
+        destroy(entry);
+    }
+    m_entries.clear();
+}
+
+void DeletionQueue::push(VkObjectType type, uint64_t handle, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex)
+{
+    if (handle == 0)
+    {
+        return;
+    }
+    CHECK(m_entries.empty() || m_entries.back().lastUsedFrameIndex <= lastUsedFrameIndex);
+    m_entries.push_back(Entry{type, handle, allocator, lastUsedFrameIndex});
+}
+
+void DeletionQueue::destroy(const Entry& entry)
+{
+    switch (entry.type)
+    {
+    case VK_OBJECT_TYPE_IMAGE:
+        vkDestroyImage(m_device, (VkImage)entry.handle, entry.allocator);
+        break;
+    case VK_OBJECT_TYPE_IMAGE_VIEW:
+        vkDestroyImageView(m_device, (VkImageView)entry.handle, entry.allocator);
+        break;
+    case VK_OBJECT_TYPE_DEVICE_MEMORY:
+        vkFreeMemory(m_device, (VkDeviceMemory)entry.handle, entry.allocator);
+        break;
+    case VK_OBJECT_TYPE_BUFFER:
+        vkDestroyBuffer(m_device, (VkBuffer)entry.handle, entry.allocator);
+        break;
+    case VK_OBJECT_TYPE_FRAMEBUFFER:
+        vkDestroyFramebuffer(m_device, (VkFramebuffer)entry.handle, entry.allocator);
+        break;
+    case VK_OBJECT_TYPE_PIPELINE:
+        vkDestroyPipeline(m_device, (VkPipeline)entry.handle, entry.allocator);
+        break;
+    case VK_OBJECT_TYPE_DESCRIPTOR_POOL:
+        vkDestroyDescriptorPool(m_device, (VkDescriptorPool)entry.handle, entry.allocator);
+        break;
+    case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+        vkDestroySwapchainKHR(m_device, (VkSwapchainKHR)entry.handle, entry.allocator);
+        break;
+    default:
+        LOGE("Unknown object type in the deletion queue");
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+// Vulkan objects that may still be used by frames in flight are retired here with the index of the last frame that
+// used them, and destroyed once that frame has completed. Reconfiguring at runtime then never needs to idle the device.
+// Objects are destroyed in the order they were retired, so retire views before their images and images before memory.
+class DeletionQueue final
+{
+public:
+    void setDevice(VkDevice device) { m_device = device; }
+
+    void retire(VkImage image, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex);
+    void retire(VkImageView imageView, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex);
+    void retire(VkDeviceMemory memory, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex);
+    void retire(VkBuffer buffer, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex);
+    void retire(VkFramebuffer framebuffer, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex);
+    void retire(VkPipeline pipeline, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex);
+    void retire(VkDescriptorPool descriptorPool, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex);
+    void retire(VkSwapchainKHR swapchain, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex);
+
+    // Destroys the objects whose last frame has completed
+    void collect(uint64_t completedFrameIndex);
+    // Destroys everything, the device must be idle
+    void flush();
+
+private:
+    struct Entry
+    {
+        VkObjectType type;
+        uint64_t handle;
+        const VkAllocationCallbacks* allocator;
+        uint64_t lastUsedFrameIndex;
+    };
+
+    void push(VkObjectType type, uint64_t handle, const VkAllocationCallbacks* allocator, uint64_t lastUsedFrameIndex);
+    void destroy(const Entry& entry);
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    // Frame indices only grow, so the entries are sorted by them
+    std::vector<Entry> m_entries;
+};
@@ -0,0 +1,228 @@
+#include "FrameGraph.hpp"
+
+namespace
+{
+struct UsageInfo
+{
+    VkPipelineStageFlags2 stage;
+    VkAccessFlags2 access;
+    VkAccessFlags2 writeAccess;
+    VkImageLayout layout;
+};
+
+UsageInfo getUsageInfo(ImageUsage usage)
+{
+    switch (usage)
+    {
+    case ImageUsage::TransferRead:
+        return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+    case ImageUsage::TransferWrite:
+        return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+    case ImageUsage::SampledRead:
+        return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    case ImageUsage::ColorAttachmentWrite:
+        return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    case ImageUsage::Present:
+        // Chained to the render finished semaphore which is signaled at color attachment output
+        return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+    }
+    CHECK(false);
+    return {};
+}
+
+bool canMerge(const VkImageMemoryBarrier2& a, const VkImageMemoryBarrier2& b)
+{
+    return a.image == b.image && a.srcStageMask == b.srcStageMask && a.srcAccessMask == b.srcAccessMask && a.dstStageMask == b.dstStageMask && a.dstAccessMask == b.dstAccessMask
+           && a.oldLayout == b.oldLayout && a.newLayout == b.newLayout && a.srcQueueFamilyIndex == b.srcQueueFamilyIndex && a.dstQueueFamilyIndex == b.dstQueueFamilyIndex
+           && a.subresourceRange.baseMipLevel + a.subresourceRange.levelCount == b.subresourceRange.baseMipLevel;
+}
+} // namespace
+
+VkImageLayout FrameGraph::getLayout(ImageUsage usage)
+{
+    return getUsageInfo(usage).layout;
+}
+
+void FrameGraph::registerImage(VkImage image, uint32_t mipLevels, VkPipelineStageFlags2 waitStages, bool externalContent)
+{
+    // Handles can be reused after an image has been destroyed, registering always starts from a clean state
+    TrackedImage& tracked = m_images[image];
+    tracked.levels.assign(mipLevels, LevelState{});
+    for (LevelState& level : tracked.levels)
+    {
+        level.readStages = waitStages;
+        level.hasContent = externalContent;
+    }
+}
+
+void FrameGraph::unregisterImage(VkImage image)
+{
+    m_images.erase(image);
+}
+
+bool FrameGraph::hasContent(VkImage image, uint32_t mipLevel) const
+{
+    const auto it = m_images.find(image);
+    CHECK(it != m_images.end());
+    return it->second.levels[mipLevel].hasContent;
+}
+
+VkAttachmentLoadOp FrameGraph::getLoadOp(VkImage image) const
+{
+    return hasContent(image) ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+}
+
+void FrameGraph::beginPass(VkCommandBuffer cb, uint32_t queueFamilyIndex, Span<const ImageAccess> accesses)
+{
+    for (const ImageAccess& access : accesses)
+    {
+        const auto it = m_images.find(access.image);
+        CHECK(it != m_images.end());
+        std::vector<LevelState>& levels = it->second.levels;
+
+        const uint32_t levelEnd = access.levelCount == VK_REMAINING_MIP_LEVELS ? ui32Size(levels) : access.baseMipLevel + access.levelCount;
+        CHECK(levelEnd <= levels.size());
+        for (uint32_t level = access.baseMipLevel; level < levelEnd; ++level)
+        {
+            addBarrier(access.image, level, levels[level], access.usage, queueFamilyIndex);
+        }
+    }
+    flushBarriers(cb);
+}
+
+void FrameGraph::releaseOwnership(VkCommandBuffer cb, VkImage image, uint32_t dstQueueFamilyIndex, ImageUsage nextUsage)
+{
+    const auto it = m_images.find(image);
+    CHECK(it != m_images.end());
+
+    const VkImageLayout newLayout = getLayout(nextUsage);
+    std::vector<LevelState>& levels = it->second.levels;
+    for (uint32_t level = 0; level < levels.size(); ++level)
+    {
+        LevelState& state = levels[level];
+        if (state.queueFamilyIndex == VK_QUEUE_FAMILY_IGNORED || state.queueFamilyIndex == dstQueueFamilyIndex)
+        {
+            continue;
+        }
+
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = state.writeStages | state.readStages;
+        barrier.srcAccessMask = state.writeAccess;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+        barrier.dstAccessMask = VK_ACCESS_2_NONE;
+        barrier.oldLayout = state.hasContent ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = state.queueFamilyIndex;
+        barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+        barrier.image = image;
+        barrier.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        pushBarrier(barrier);
+
+        state.pendingAcquire = true;
+        state.dstQueueFamilyIndex = dstQueueFamilyIndex;
+        state.releaseOldLayout = barrier.oldLayout;
+        state.layout = newLayout;
+    }
+    flushBarriers(cb);
+}
+
+void FrameGraph::addBarrier(VkImage image, uint32_t level, LevelState& state, ImageUsage usage, uint32_t queueFamilyIndex)
+{
+    const UsageInfo info = getUsageInfo(usage);
+    const bool isWrite = info.writeAccess != VK_ACCESS_2_NONE;
+
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.dstStageMask = info.stage;
+    barrier.dstAccessMask = info.access;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+
+    if (state.pendingAcquire)
+    {
+        // Acquire half of the transfer, the release already made the writes available
+        CHECK(state.dstQueueFamilyIndex == queueFamilyIndex && state.layout == info.layout);
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        barrier.oldLayout = state.releaseOldLayout;
+        barrier.newLayout = info.layout;
+        barrier.srcQueueFamilyIndex = state.queueFamilyIndex;
+        barrier.dstQueueFamilyIndex = queueFamilyIndex;
+        pushBarrier(barrier);
+
+        state.pendingAcquire = false;
+        state.queueFamilyIndex = queueFamilyIndex;
+        state.writeStages = isWrite ? info.stage : VK_PIPELINE_STAGE_2_NONE;
+        state.writeAccess = info.writeAccess;
+        state.readStages = isWrite ? VK_PIPELINE_STAGE_2_NONE : info.stage;
+        state.hasContent = state.hasContent || isWrite;
+        return;
+    }
+
+    // Exclusive images can only change queues through releaseOwnership unless their content is not needed
+    CHECK(state.queueFamilyIndex == VK_QUEUE_FAMILY_IGNORED || state.queueFamilyIndex == queueFamilyIndex || !state.hasContent);
+    state.queueFamilyIndex = queueFamilyIndex;
+
+    const bool layoutChange = state.layout != info.layout;
+    if (isWrite || layoutChange)
+    {
+        // Writes and layout transitions wait for the previous write and every read since
+        barrier.srcStageMask = state.writeStages | state.readStages;
+        barrier.srcAccessMask = state.writeAccess;
+        barrier.oldLayout = state.hasContent ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = info.layout;
+        if (barrier.srcStageMask != VK_PIPELINE_STAGE_2_NONE || barrier.oldLayout != barrier.newLayout)
+        {
+            pushBarrier(barrier);
+        }
+
+        // A layout transition acts like a write that completes before the destination stage
+        state.layout = info.layout;
+        state.writeStages = info.stage;
+        state.writeAccess = info.writeAccess;
+        state.readStages = isWrite ? VK_PIPELINE_STAGE_2_NONE : info.stage;
+        state.hasContent = state.hasContent || isWrite;
+        return;
+    }
+
+    // Read in the current layout, only needs a barrier when this stage has not yet seen the last write
+    if ((state.readStages & info.stage) != info.stage && state.writeStages != VK_PIPELINE_STAGE_2_NONE)
+    {
+        barrier.srcStageMask = state.writeStages;
+        barrier.srcAccessMask = state.writeAccess;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = state.layout;
+        pushBarrier(barrier);
+    }
+    state.readStages |= info.stage;
+}
+
+void FrameGraph::pushBarrier(const VkImageMemoryBarrier2& barrier)
+{
+    if (m_barrierCount > 0 && canMerge(m_barriers[m_barrierCount - 1], barrier))
+    {
+        m_barriers[m_barrierCount - 1].subresourceRange.levelCount += barrier.subresourceRange.levelCount;
+        return;
+    }
+    CHECK(m_barrierCount < c_maxBarriers);
+    m_barriers[m_barrierCount++] = barrier;
+}
+
+void FrameGraph::flushBarriers(VkCommandBuffer cb)
+{
+    if (m_barrierCount == 0)
+    {
+        return;
+    }
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.imageMemoryBarrierCount = m_barrierCount;
+    dependencyInfo.pImageMemoryBarriers = m_barriers.data();
+    vkCmdPipelineBarrier2(cb, &dependencyInfo);
+
+    m_barrierCount = 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "VulkanUtils.hpp"
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+enum class ImageUsage
+{
+    TransferRead,
+    TransferWrite,
+    SampledRead,
+    ColorAttachmentWrite,
+    Present
+};
+
+struct ImageAccess
+{
+    VkImage image;
+    ImageUsage usage;
+    uint32_t baseMipLevel = 0;
+    // VK_REMAINING_MIP_LEVELS covers every level from the base
+    uint32_t levelCount = VK_REMAINING_MIP_LEVELS;
+};
+
+// Tracks the layout, last accesses and owning queue family of every registered image per mip level. Passes declare
+// the accesses they are about to make and the graph records the barriers that make them safe, merged into a single
+// vkCmdPipelineBarrier2. Read after read needs no barrier and write after read only an execution dependency.
+class FrameGraph final
+{
+public:
+    static VkImageLayout getLayout(ImageUsage usage);
+
+    // Prior work on the image is assumed to be chained to waitStages, e.g. the stage the acquire semaphore waits at.
+    // Images with external content, such as imported ones, are never transitioned from the undefined layout later on.
+    void registerImage(VkImage image, uint32_t mipLevels, VkPipelineStageFlags2 waitStages = VK_PIPELINE_STAGE_2_NONE, bool externalContent = false);
+    void unregisterImage(VkImage image);
+    // False until something has been written to the level, attachments use this to pick their load op
+    bool hasContent(VkImage image, uint32_t mipLevel = 0) const;
+    VkAttachmentLoadOp getLoadOp(VkImage image) const;
+
+    void beginPass(VkCommandBuffer cb, uint32_t queueFamilyIndex, Span<const ImageAccess> accesses);
+    // Records the release half of an ownership transfer, the next pass on the destination queue records the acquire and
+    // has to use the image as nextUsage
+    void releaseOwnership(VkCommandBuffer cb, VkImage image, uint32_t dstQueueFamilyIndex, ImageUsage nextUsage);
+
+private:
+    struct LevelState
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+        // Reads since the last write, a following write has to wait for all of them
+        VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+        uint32_t queueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        // Set by releaseOwnership, the acquiring pass must repeat the layouts of the release barrier
+        bool pendingAcquire = false;
+        uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        VkImageLayout releaseOldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        bool hasContent = false;
+    };
+
+    struct TrackedImage
+    {
+        std::vector<LevelState> levels;
+    };
+
+    static const uint32_t c_maxBarriers = 32;
+
+    void addBarrier(VkImage image, uint32_t level, LevelState& state, ImageUsage usage, uint32_t queueFamilyIndex);
+    void pushBarrier(const VkImageMemoryBarrier2& barrier);
+    void flushBarriers(VkCommandBuffer cb);
+
+    std::unordered_map<VkImage, TrackedImage> m_images;
+    std::array<VkImageMemoryBarrier2, c_maxBarriers> m_barriers{};
+    uint32_t m_barrierCount = 0;
+};
@@ -0,0 +1,130 @@
+#include "FramePacer.hpp"
+#include "Utils.hpp"
+#include "Trace.hpp"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+const double c_defaultRefreshRate = 60.0;
+// Weight of the newest sample in the moving averages
+const double c_averageWeight = 0.1;
+// Added to the render time estimate to absorb jitter
+const uint64_t c_wakeupMarginNs = 500'000;
+// Timers can wake up late by this much, the rest of the wait is spent spinning
+const uint64_t c_spinThresholdNs = 1'000'000;
+// Without a high resolution timer sleeps are rounded up to the system timer period
+const uint64_t c_coarseSpinThresholdNs = 2'000'000;
+// Longer gaps are pauses of the producer rather than its frame interval
+const uint64_t c_maxProducerIntervalNs = 250'000'000;
+// A slow producer lowers the frame rate at most to this fraction of the refresh rate
+const uint64_t c_maxDisplayIntervalsPerFrame = 4;
+} // namespace
+
+std::unique_ptr<FramePacer> FramePacer::createFromEnvironment()
+{
+    const char* value = std::getenv("DXVK_INTEROP_PACING");
+    if (value != nullptr && std::strcmp(value, "0") == 0)
+    {
+        printf("Frame pacing: off\n");
+        return nullptr;
+    }
+
+    // The window is not fullscreen, so the refresh rate of the primary monitor is the best guess
+    GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+    const GLFWvidmode* mode = monitor != nullptr ? glfwGetVideoMode(monitor) : nullptr;
+    const double refreshRate = mode != nullptr && mode->refreshRate > 0 ? mode->refreshRate : c_defaultRefreshRate;
+    return std::make_unique<FramePacer>(refreshRate);
+}
+
+FramePacer::FramePacer(double refreshRate) :
+    m_displayIntervalNs(static_cast<uint64_t>(1'000'000'000.0 / refreshRate))
+{
+    // High resolution waitable timers are available since Windows 10 1803
+    m_timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    m_highResolutionTimer = m_timer != nullptr;
+    if (m_timer == nullptr)
+    {
+        m_timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+    }
+    CHECK(m_timer);
+    printf("Frame pacing: %.1f Hz display, %s timer\n", refreshRate, m_highResolutionTimer ? "high resolution" : "default resolution");
+}
+
+FramePacer::~FramePacer()
+{
+    CloseHandle(m_timer);
+}
+
+void FramePacer::waitForNextFrame()
+{
+    TRACE_SCOPE("FramePacer::waitForNextFrame");
+    const uint64_t nowNs = Tracer::now();
+    if (m_deadlineNs == 0)
+    {
+        // The first frame starts right away and sets the phase of the deadlines
+        m_deadlineNs = nowNs;
+    }
+
+    const uint64_t leadNs = static_cast<uint64_t>(m_renderDurationNs) + c_wakeupMarginNs;
+    const uint64_t wakeupNs = m_deadlineNs > leadNs ? m_deadlineNs - leadNs : 0;
+    if (wakeupNs > nowNs)
+    {
+        sleepUntil(wakeupNs);
+    }
+    m_frameStartNs = Tracer::now();
+}
+
+void FramePacer::endFrame(bool producerFrame)
+{
+    const uint64_t nowNs = Tracer::now();
+    const double durationNs = static_cast<double>(nowNs - m_frameStartNs);
+    m_renderDurationNs = m_renderDurationNs == 0.0 ? durationNs : m_renderDurationNs + c_averageWeight * (durationNs - m_renderDurationNs);
+
+    if (producerFrame)
+    {
+        const uint64_t intervalNs = nowNs - m_lastProducerFrameNs;
+        if (m_lastProducerFrameNs != 0 && intervalNs < c_maxProducerIntervalNs)
+        {
+            const double interval = static_cast<double>(intervalNs);
+            m_producerIntervalNs = m_producerIntervalNs == 0.0 ? interval : m_producerIntervalNs + c_averageWeight * (interval - m_producerIntervalNs);
+        }
+        m_lastProducerFrameNs = nowNs;
+    }
+
+    // A frame that missed its deadline moves to the next one on the display interval grid
+    m_deadlineNs += getFrameInterval();
+    while (m_deadlineNs <= nowNs)
+    {
+        m_deadlineNs += m_displayIntervalNs;
+    }
+    Tracer::get().addCounter("Frame interval us", static_cast<int64_t>(getFrameInterval() / 1000));
+}
+
+void FramePacer::sleepUntil(uint64_t timeNs)
+{
+    const uint64_t spinThresholdNs = m_highResolutionTimer ? c_spinThresholdNs : c_coarseSpinThresholdNs;
+    const uint64_t nowNs = Tracer::now();
+    if (timeNs > nowNs + spinThresholdNs)
+    {
+        // Negative due times are relative, in 100 ns units
+        LARGE_INTEGER dueTime{};
+        dueTime.QuadPart = -static_cast<LONGLONG>((timeNs - nowNs - spinThresholdNs) / 100);
+        CHECK(SetWaitableTimerEx(m_timer, &dueTime, 0, nullptr, nullptr, nullptr, 0));
+        WaitForSingleObject(m_timer, INFINITE);
+    }
+
+    while (Tracer::now() < timeNs)
+    {
+        YieldProcessor();
+    }
+}
+
+uint64_t FramePacer::getFrameInterval() const
+{
+    // Rounded down so the consumer never runs slower than the producer and no producer frame is skipped
+    const uint64_t displayIntervals = static_cast<uint64_t>(m_producerIntervalNs / static_cast<double>(m_displayIntervalNs));
+    return std::clamp<uint64_t>(displayIntervals, 1, c_maxDisplayIntervalsPerFrame) * m_displayIntervalNs;
+}
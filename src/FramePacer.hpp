@@ -0,0 +1,39 @@
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <memory>
+
+// Starts each frame as late as possible before its deadline instead of rendering as fast as the swapchain allows.
+// Deadlines are spaced by the display refresh interval, or by a whole number of them when the producer delivers
+// frames at a lower rate. The wakeup is the deadline minus the recent render time, reached by sleeping on a high
+// resolution timer and spinning for the last part.
+class FramePacer final
+{
+public:
+    // Enabled unless DXVK_INTEROP_PACING is set to 0, null otherwise
+    static std::unique_ptr<FramePacer> createFromEnvironment();
+
+    explicit FramePacer(double refreshRate);
+    ~FramePacer();
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    void waitForNextFrame();
+    // Called once the frame has been submitted, producerFrame tells if the producer delivered a new frame for it
+    void endFrame(bool producerFrame);
+
+private:
+    void sleepUntil(uint64_t timeNs);
+    uint64_t getFrameInterval() const;
+
+    HANDLE m_timer = nullptr;
+    bool m_highResolutionTimer = false;
+    uint64_t m_displayIntervalNs;
+    // Moving averages, zero until the first sample
+    double m_renderDurationNs = 0.0;
+    double m_producerIntervalNs = 0.0;
+    uint64_t m_lastProducerFrameNs = 0;
+    uint64_t m_frameStartNs = 0;
+    uint64_t m_deadlineNs = 0;
+};
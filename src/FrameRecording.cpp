@@ -0,0 +1,261 @@
+#include "FrameRecording.hpp"
+#include "SurfaceFormat.hpp"
+#include "Trace.hpp"
+#include <cstring>
+
+namespace
+{
+const char c_magic[8] = {'D', 'X', 'I', 'F', 'R', 'A', 'M', 'E'};
+const uint32_t c_version = 1;
+const uint32_t c_frameChunkType = 1;
+const DirtyRect c_fullRect{0, 0, c_texWidth, c_texHeight};
+
+size_t getPixelSize(const DirtyRect& rect)
+{
+    return static_cast<size_t>(rect.right - rect.left) * (rect.bottom - rect.top) * c_texChannels;
+}
+
+void writeBytes(FILE* file, const void* data, size_t size)
+{
+    if (std::fwrite(data, 1, size, file) != size)
+    {
+        LOGE("Failed to write the recording");
+    }
+}
+} // namespace
+
+FrameRecorder::FrameRecorder(const char* path, DXGI_FORMAT format)
+{
+    CHECK(findSurfaceFormat(format));
+    m_file = std::fopen(path, "wb");
+    if (m_file == nullptr)
+    {
+        printf("Unable to create recording %s\n", path);
+        LOGE("Failed to open the recording");
+    }
+
+    RecordingHeader header{};
+    std::memcpy(header.magic, c_magic, sizeof(c_magic));
+    header.version = c_version;
+    header.width = c_texWidth;
+    header.height = c_texHeight;
+    header.format = format;
+    writeBytes(m_file, &header, sizeof(header));
+    m_byteCount = sizeof(header);
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    if (m_stagingTexture != nullptr)
+    {
+        m_stagingTexture->Release();
+    }
+    std::fclose(m_file);
+    printf("Recorded %llu frames, %.1f MB\n", static_cast<unsigned long long>(m_frameCount), static_cast<double>(m_byteCount) / (1024.0 * 1024.0));
+}
+
+void FrameRecorder::record(ID3D11DeviceContext* deviceContext, ID3D11Texture2D* texture, Span<const DirtyRect> dirtyRects)
+{
+    TRACE_SCOPE("FrameRecorder::record");
+    const uint64_t nowNs = Tracer::now();
+    if (m_frameCount == 0)
+    {
+        m_firstFrameNs = nowNs;
+        // Replays start from the first frame, so it has to cover the initial content as well
+        dirtyRects = Span<const DirtyRect>(&c_fullRect, 1);
+    }
+
+    if (m_stagingTexture == nullptr)
+    {
+        D3D11_TEXTURE2D_DESC desc{};
+        texture->GetDesc(&desc);
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        desc.MiscFlags = 0;
+
+        ID3D11Device* device = nullptr;
+        texture->GetDevice(&device);
+        CHECK(SUCCEEDED(device->CreateTexture2D(&desc, nullptr, &m_stagingTexture)));
+        device->Release();
+    }
+
+    size_t pixelSize = 0;
+    for (const DirtyRect& rect : dirtyRects)
+    {
+        const D3D11_BOX box{static_cast<UINT>(rect.left), static_cast<UINT>(rect.top), 0, static_cast<UINT>(rect.right), static_cast<UINT>(rect.bottom), 1};
+        deviceContext->CopySubresourceRegion(m_stagingTexture, 0, box.left, box.top, 0, texture, 0, &box);
+        pixelSize += getPixelSize(rect);
+    }
+
+    ChunkHeader chunk{};
+    chunk.type = c_frameChunkType;
+    chunk.size = static_cast<uint32_t>(sizeof(FrameChunkHeader) + dirtyRects.size() * sizeof(DirtyRect) + pixelSize);
+    FrameChunkHeader frame{};
+    frame.timestampNs = nowNs - m_firstFrameNs;
+    frame.dirtyRectCount = static_cast<uint32_t>(dirtyRects.size());
+
+    writeBytes(m_file, &chunk, sizeof(chunk));
+    writeBytes(m_file, &frame, sizeof(frame));
+    writeBytes(m_file, dirtyRects.data(), dirtyRects.size() * sizeof(DirtyRect));
+
+    if (!dirtyRects.empty())
+    {
+        // Waits for the copies, recording is not meant to run at full speed
+        D3D11_MAPPED_SUBRESOURCE mapped{};
+        CHECK(SUCCEEDED(deviceContext->Map(m_stagingTexture, 0, D3D11_MAP_READ, 0, &mapped)));
+        for (const DirtyRect& rect : dirtyRects)
+        {
+            const size_t rowSize = static_cast<size_t>(rect.right - rect.left) * c_texChannels;
+            for (int y = rect.top; y < rect.bottom; ++y)
+            {
+                const uint8_t* row = static_cast<const uint8_t*>(mapped.pData) + static_cast<size_t>(y) * mapped.RowPitch + static_cast<size_t>(rect.left) * c_texChannels;
+                writeBytes(m_file, row, rowSize);
+            }
+        }
+        deviceContext->Unmap(m_stagingTexture, 0);
+    }
+
+    m_byteCount += sizeof(chunk) + chunk.size;
+    ++m_frameCount;
+}
+
+FrameReplay::FrameReplay(const char* path, bool maxRate) :
+    m_maxRate(maxRate)
+{
+    m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        printf("Unable to open recording %s\n", path);
+        LOGE("Failed to open the recording");
+    }
+
+    LARGE_INTEGER fileSize{};
+    CHECK(GetFileSizeEx(m_file, &fileSize));
+    const size_t size = static_cast<size_t>(fileSize.QuadPart);
+    if (size < sizeof(RecordingHeader))
+    {
+        LOGE("The recording is truncated");
+    }
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CHECK(m_mapping);
+    m_view = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    CHECK(m_view);
+
+    RecordingHeader header;
+    std::memcpy(&header, m_view, sizeof(header));
+    if (std::memcmp(header.magic, c_magic, sizeof(c_magic)) != 0 || header.version != c_version)
+    {
+        LOGE("The file is not a recording of this version");
+    }
+    if (header.width != c_texWidth || header.height != c_texHeight || findSurfaceFormat(static_cast<DXGI_FORMAT>(header.format)) == nullptr)
+    {
+        LOGE("The recording has a different texture size or an unsupported format");
+    }
+    m_format = static_cast<DXGI_FORMAT>(header.format);
+
+    parseChunks(m_view + sizeof(header), size - sizeof(header));
+    if (m_frames.empty())
+    {
+        LOGE("The recording has no frames");
+    }
+
+    const double durationMs = static_cast<double>(m_frames.back().timestampNs) / 1'000'000.0;
+    printf("Replaying %zu frames (%.1f ms) from %s at %s\n", m_frames.size(), durationMs, path, m_maxRate ? "the maximum rate" : "the recorded rate");
+}
+
+FrameReplay::~FrameReplay()
+{
+    UnmapViewOfFile(m_view);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+}
+
+Span<const ReplayFrame> FrameReplay::getDueFrames(uint64_t nowNs)
+{
+    if (m_nextFrame == m_frames.size())
+    {
+        m_nextFrame = 0;
+    }
+    if (m_nextFrame == 0)
+    {
+        m_startNs = nowNs;
+    }
+
+    const size_t first = m_nextFrame;
+    if (m_maxRate)
+    {
+        ++m_nextFrame;
+    }
+    else
+    {
+        const uint64_t elapsedNs = nowNs - m_startNs;
+        while (m_nextFrame < m_frames.size() && m_frames[m_nextFrame].timestampNs <= elapsedNs)
+        {
+            ++m_nextFrame;
+        }
+    }
+    return Span<const ReplayFrame>(m_frames.data() + first, m_nextFrame - first);
+}
+
+void FrameReplay::parseChunks(const uint8_t* data, size_t size)
+{
+    size_t offset = 0;
+    while (offset < size)
+    {
+        ChunkHeader chunk;
+        if (size - offset < sizeof(chunk))
+        {
+            LOGE("The recording has a truncated chunk header");
+        }
+        std::memcpy(&chunk, data + offset, sizeof(chunk));
+        offset += sizeof(chunk);
+        if (size - offset < chunk.size)
+        {
+            LOGE("The recording has a truncated chunk");
+        }
+
+        const uint8_t* payload = data + offset;
+        offset += chunk.size;
+        if (chunk.type != c_frameChunkType)
+        {
+            continue;
+        }
+
+        FrameChunkHeader frameHeader;
+        if (chunk.size < sizeof(frameHeader))
+        {
+            LOGE("The recording has an invalid frame chunk");
+        }
+        std::memcpy(&frameHeader, payload, sizeof(frameHeader));
+
+        const size_t rectsSize = static_cast<size_t>(frameHeader.dirtyRectCount) * sizeof(DirtyRect);
+        if (chunk.size - sizeof(frameHeader) < rectsSize)
+        {
+            LOGE("The recording has an invalid frame chunk");
+        }
+
+        // Headers and rectangles are 4 byte aligned within the mapping, so they are used in place
+        ReplayFrame frame;
+        frame.timestampNs = frameHeader.timestampNs;
+        frame.dirtyRects = Span<const DirtyRect>(reinterpret_cast<const DirtyRect*>(payload + sizeof(frameHeader)), frameHeader.dirtyRectCount);
+        frame.pixels = payload + sizeof(frameHeader) + rectsSize;
+
+        size_t pixelSize = 0;
+        for (const DirtyRect& rect : frame.dirtyRects)
+        {
+            const DirtyRect clamped = clampRect(rect, c_texWidth, c_texHeight);
+            if (isEmpty(rect) || clamped.left != rect.left || clamped.top != rect.top || clamped.right != rect.right || clamped.bottom != rect.bottom)
+            {
+                LOGE("The recording has a dirty rectangle outside of the texture");
+            }
+            pixelSize += getPixelSize(rect);
+        }
+        if (chunk.size - sizeof(frameHeader) - rectsSize != pixelSize)
+        {
+            LOGE("The recording has a frame with the wrong amount of pixels");
+        }
+        m_frames.push_back(frame);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Utils.hpp"
+#include <windows.h>
+#include <d3d11.h>
+#include <cstdio>
+#include <vector>
+
+// Recordings start with a RecordingHeader followed by chunks. Every chunk has a ChunkHeader and a payload of the given
+// size, readers skip chunk types they don't know. A frame chunk holds a FrameChunkHeader, the dirty rectangles and
+// then the pixels of each rectangle, tightly packed rows in the recorded format. The first frame covers the whole texture.
+struct RecordingHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;
+};
+
+struct ChunkHeader
+{
+    uint32_t type;
+    uint32_t size;
+};
+
+struct FrameChunkHeader
+{
+    // Relative to the first frame
+    uint64_t timestampNs;
+    uint32_t dirtyRectCount;
+    uint32_t padding;
+};
+
+// Writes the frames of a producer to a recording, the pixels are read back through a staging texture
+class FrameRecorder final
+{
+public:
+    FrameRecorder(const char* path, DXGI_FORMAT format);
+    ~FrameRecorder();
+    FrameRecorder(const FrameRecorder&) = delete;
+    FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+    // Called while the producer holds the texture, after the dirty rectangles have been written
+    void record(ID3D11DeviceContext* deviceContext, ID3D11Texture2D* texture, Span<const DirtyRect> dirtyRects);
+    uint64_t getFrameCount() const { return m_frameCount; }
+
+private:
+    FILE* m_file = nullptr;
+    ID3D11Texture2D* m_stagingTexture = nullptr;
+    uint64_t m_firstFrameNs = 0;
+    uint64_t m_frameCount = 0;
+    uint64_t m_byteCount = 0;
+};
+
+struct ReplayFrame
+{
+    uint64_t timestampNs;
+    Span<const DirtyRect> dirtyRects;
+    // Pixels of each dirty rectangle in order, points into the file mapping
+    const uint8_t* pixels;
+};
+
+// Memory maps a recording and hands out its frames either at the recorded rate or one per update, and starts over
+// from the first frame at the end. Nothing is copied, the producer uploads straight from the mapping.
+class FrameReplay final
+{
+public:
+    FrameReplay(const char* path, bool maxRate);
+    ~FrameReplay();
+    FrameReplay(const FrameReplay&) = delete;
+    FrameReplay& operator=(const FrameReplay&) = delete;
+
+    DXGI_FORMAT getFormat() const { return m_format; }
+    bool isMaxRate() const { return m_maxRate; }
+    // Frames that are due at the given time. Each frame only holds the regions it changed, so all of them must be
+    // applied in order.
+    Span<const ReplayFrame> getDueFrames(uint64_t nowNs);
+
+private:
+    void parseChunks(const uint8_t* data, size_t size);
+
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+    const uint8_t* m_view = nullptr;
+    DXGI_FORMAT m_format = DXGI_FORMAT_UNKNOWN;
+    bool m_maxRate = false;
+    std::vector<ReplayFrame> m_frames;
+    size_t m_nextFrame = 0;
+    uint64_t m_startNs = 0;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Utils.hpp"
+#include <windows.h>
+#include <dxgiformat.h>
+#include <vector>
+
+// Producer of the shared texture that the renderer imports, either the in-process DX device or a remote process
+class FrameSource
+{
+public:
+    virtual ~FrameSource() = default;
+
+    virtual void update() = 0;
+    // False once a remote producer has gone away, the renderer then stops since the surface is no longer updated
+    virtual bool isConnected() const { return true; }
+    virtual HANDLE getSharedHandle() = 0;
+    virtual DXGI_FORMAT getFormat() const = 0;
+    // Formats the consumer can use, best first. The producer switches to the first one it can render to and share,
+    // the new texture is returned by the next getSharedHandle. The format stays unchanged if none of them fit.
+    virtual void requestFormat(Span<const DXGI_FORMAT> /*formats*/) {}
+    // Regions of the texture written by the last update, empty if nothing changed
+    virtual const std::vector<DirtyRect>& getDirtyRects() const = 0;
+    // Shared D3D11 fence signaled after each update, null when the producer only has the keyed mutex
+    virtual HANDLE getReadyFenceHandle() { return nullptr; }
+    // Ready fence value signaled by the last update
+    virtual uint64_t getReadyFenceValue() const { return 0; }
+    // Fence the consumer signals with the ready value once it is done reading, the producer waits for it on the GPU
+    // before writing again. Null detaches the previous fence.
+    virtual void setReleaseFenceHandle(HANDLE /*handle*/) {}
+};
@@ -0,0 +1,178 @@
+#include "GpuTimer.hpp"
+#include "Context.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+
+namespace
+{
+const uint64_t c_recalibrationIntervalNs = 1'000'000'000;
+
+bool hasQueryPerformanceCounterDomain(VkInstance instance, VkPhysicalDevice physicalDevice)
+{
+    auto getTimeDomains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+    if (getTimeDomains == nullptr)
+    {
+        return false;
+    }
+
+    uint32_t domainCount = 0;
+    getTimeDomains(physicalDevice, &domainCount, nullptr);
+    std::vector<VkTimeDomainEXT> domains(domainCount);
+    getTimeDomains(physicalDevice, &domainCount, domains.data());
+
+    bool hasDevice = false;
+    bool hasQueryPerformanceCounter = false;
+    for (VkTimeDomainEXT domain : domains)
+    {
+        hasDevice = hasDevice || domain == VK_TIME_DOMAIN_DEVICE_EXT;
+        hasQueryPerformanceCounter = hasQueryPerformanceCounter || domain == VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+    }
+    return hasDevice && hasQueryPerformanceCounter;
+}
+} // namespace
+
+GpuTimer::GpuTimer(const Context& context, uint32_t slotCount) :
+    m_device(context.getDevice()),
+    m_slots(slotCount)
+{
+    if (!Tracer::get().isEnabled())
+    {
+        return;
+    }
+
+    const VkPhysicalDevice physicalDevice = context.getPhysicalDevice();
+    if (!context.isDeviceExtensionEnabled(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) || !hasQueryPerformanceCounterDomain(context.getInstance(), physicalDevice))
+    {
+        printf("WARNING: GPU timestamps can't be calibrated, the trace only contains CPU spans\n");
+        return;
+    }
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    const uint32_t validBits = queueFamilies[context.getGraphicsQueueFamilyIndex()].timestampValidBits;
+    if (validBits == 0)
+    {
+        printf("WARNING: Graphics queue does not support timestamps, the trace only contains CPU spans\n");
+        return;
+    }
+    m_timestampMask = validBits == 64 ? UINT64_MAX : (uint64_t(1) << validBits) - 1;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    m_timestampPeriod = properties.limits.timestampPeriod;
+
+    m_getCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(vkGetDeviceProcAddr(m_device, "vkGetCalibratedTimestampsEXT"));
+    CHECK(m_getCalibratedTimestamps);
+
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = slotCount * c_maxSpansPerFrame * 2;
+    VK_CHECK(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &m_queryPool));
+
+    calibrate();
+    m_enabled = true;
+}
+
+GpuTimer::~GpuTimer()
+{
+    vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+}
+
+void GpuTimer::beginFrame(VkCommandBuffer cb, uint32_t slot)
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    reportSlot(slot);
+    if (Tracer::now() - m_calibrationTraceTime > c_recalibrationIntervalNs)
+    {
+        calibrate();
+    }
+
+    m_currentSlot = slot;
+    m_slots[slot].spanCount = 0;
+    vkCmdResetQueryPool(cb, m_queryPool, slot * c_maxSpansPerFrame * 2, c_maxSpansPerFrame * 2);
+}
+
+uint32_t GpuTimer::beginSpan(VkCommandBuffer cb, const char* name)
+{
+    Slot& slot = m_slots[m_currentSlot];
+    if (!m_enabled || slot.spanCount == c_maxSpansPerFrame)
+    {
+        return c_invalidSpan;
+    }
+
+    const uint32_t span = slot.spanCount++;
+    slot.names[span] = name;
+    const uint32_t query = (m_currentSlot * c_maxSpansPerFrame + span) * 2;
+    vkCmdWriteTimestamp2(cb, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, m_queryPool, query);
+    return span;
+}
+
+void GpuTimer::endSpan(VkCommandBuffer cb, uint32_t span)
+{
+    if (span == c_invalidSpan)
+    {
+        return;
+    }
+
+    const uint32_t query = (m_currentSlot * c_maxSpansPerFrame + span) * 2 + 1;
+    vkCmdWriteTimestamp2(cb, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, m_queryPool, query);
+}
+
+void GpuTimer::calibrate()
+{
+    std::array<VkCalibratedTimestampInfoEXT, 2> infos{};
+    infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[1].timeDomain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+
+    std::array<uint64_t, 2> timestamps{};
+    uint64_t maxDeviation = 0;
+    VK_CHECK(m_getCalibratedTimestamps(m_device, ui32Size(infos), infos.data(), timestamps.data(), &maxDeviation));
+
+    m_calibrationGpuTicks = timestamps[0] & m_timestampMask;
+    m_calibrationTraceTime = Tracer::counterToNanoseconds(timestamps[1]);
+}
+
+void GpuTimer::reportSlot(uint32_t slotIndex)
+{
+    Slot& slot = m_slots[slotIndex];
+    if (slot.spanCount == 0)
+    {
+        return;
+    }
+
+    // The fence of the slot has been waited so the results are available, a failed read only loses the spans
+    std::array<uint64_t, c_maxSpansPerFrame * 2> timestamps{};
+    const uint32_t firstQuery = slotIndex * c_maxSpansPerFrame * 2;
+    const VkResult result = vkGetQueryPoolResults(m_device, m_queryPool, firstQuery, slot.spanCount * 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+    {
+        slot.spanCount = 0;
+        return;
+    }
+
+    for (uint32_t span = 0; span < slot.spanCount; ++span)
+    {
+        const uint64_t begin = toTraceTime(timestamps[span * 2]);
+        const uint64_t end = toTraceTime(timestamps[span * 2 + 1]);
+        Tracer::get().addSpan(slot.names[span], begin, std::max(begin, end), Tracer::c_gpuQueueThreadId);
+    }
+    slot.spanCount = 0;
+}
+
+uint64_t GpuTimer::toTraceTime(uint64_t gpuTicks) const
+{
+    // Masked difference handles timestamps from before the calibration point and counter wrap around
+    const uint64_t masked = (gpuTicks - m_calibrationGpuTicks) & m_timestampMask;
+    const uint64_t half = m_timestampMask / 2 + 1;
+    const double deltaTicks = masked >= half ? -static_cast<double>(m_timestampMask - masked + 1) : static_cast<double>(masked);
+    return m_calibrationTraceTime + static_cast<int64_t>(deltaTicks * m_timestampPeriod);
+}
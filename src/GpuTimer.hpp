@@ -0,0 +1,49 @@
+#pragma once
+
+#include "VulkanUtils.hpp"
+#include <array>
+#include <vector>
+
+class Context;
+
+// Measures spans on the graphics queue with timestamp queries and reports them to the tracer. GPU ticks are mapped to
+// the CPU trace clock with VK_EXT_calibrated_timestamps, recalibrated periodically to follow drift. Does nothing when
+// tracing is off or the device can't be calibrated against QueryPerformanceCounter.
+class GpuTimer final
+{
+public:
+    // One slot per frame in flight, a slot is reused after the fence of its frame has been waited
+    GpuTimer(const Context& context, uint32_t slotCount);
+    ~GpuTimer();
+
+    // Reports the spans of the previous use of the slot and resets its queries
+    void beginFrame(VkCommandBuffer cb, uint32_t slot);
+    // Name must be a string literal, returns the span to pass to endSpan
+    uint32_t beginSpan(VkCommandBuffer cb, const char* name);
+    void endSpan(VkCommandBuffer cb, uint32_t span);
+
+private:
+    static const uint32_t c_maxSpansPerFrame = 8;
+    static const uint32_t c_invalidSpan = UINT32_MAX;
+
+    struct Slot
+    {
+        std::array<const char*, c_maxSpansPerFrame> names{};
+        uint32_t spanCount = 0;
+    };
+
+    void calibrate();
+    void reportSlot(uint32_t slot);
+    uint64_t toTraceTime(uint64_t gpuTicks) const;
+
+    VkDevice m_device;
+    bool m_enabled = false;
+    VkQueryPool m_queryPool = VK_NULL_HANDLE;
+    std::vector<Slot> m_slots;
+    uint32_t m_currentSlot = 0;
+    double m_timestampPeriod = 1.0;
+    uint64_t m_timestampMask = 0;
+    PFN_vkGetCalibratedTimestampsEXT m_getCalibratedTimestamps = nullptr;
+    uint64_t m_calibrationGpuTicks = 0;
+    uint64_t m_calibrationTraceTime = 0;
+};
@@ -0,0 +1,297 @@
+#include "HostAllocator.hpp"
+#include "Trace.hpp"
+#include <windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+const char* c_modeVariable = "DXVK_INTEROP_HOST_ALLOCATOR";
+const size_t c_minAlignment = 16;
+const size_t c_arenaSize = 1024 * 1024;
+// Startup and the first frames allocate pipelines, descriptor sets and command buffers, only later frames are checked
+const uint64_t c_warmupFrameCount = 120;
+const uint64_t c_steadyStateWindowFrameCount = 600;
+
+const char* const c_siteNames[] = {"instance", "surface", "device", "swapchain", "command pool", "sync", "pipeline", "descriptors", "images"};
+const char* const c_scopeNames[] = {"command", "object", "cache", "device", "instance"};
+
+double toKilobytes(int64_t bytes)
+{
+    return static_cast<double>(bytes) / 1024.0;
+}
+} // namespace
+
+HostAllocator::HostAllocator()
+{
+    const char* mode = std::getenv(c_modeVariable);
+    if (mode == nullptr || mode[0] == '\0')
+    {
+        return;
+    }
+
+    if (std::strcmp(mode, "count") == 0)
+    {
+        m_enabled = true;
+    }
+    else if (std::strcmp(mode, "arena") == 0)
+    {
+        m_enabled = true;
+        m_arenaEnabled = true;
+        m_arena = std::make_unique<uint8_t[]>(c_arenaSize);
+    }
+    else
+    {
+        printf("Ignoring invalid %s value '%s'\n", c_modeVariable, mode);
+        return;
+    }
+
+    for (size_t i = 0; i < c_siteCount; ++i)
+    {
+        m_sites[i].owner = this;
+
+        VkAllocationCallbacks& callbacks = m_callbacks[i];
+        callbacks.pUserData = &m_sites[i];
+        callbacks.pfnAllocation = allocationCallback;
+        callbacks.pfnReallocation = reallocationCallback;
+        callbacks.pfnFree = freeCallback;
+        callbacks.pfnInternalAllocation = internalAllocationCallback;
+        callbacks.pfnInternalFree = internalFreeCallback;
+    }
+    printf("Host allocation callbacks enabled%s\n", m_arenaEnabled ? ", command scope allocations served from a frame arena" : "");
+}
+
+const VkAllocationCallbacks* HostAllocator::getCallbacks(AllocationSite site) const
+{
+    return m_enabled ? &m_callbacks[static_cast<size_t>(site)] : nullptr;
+}
+
+void HostAllocator::beginFrame(uint64_t frameIndex)
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    // Command scope allocations are freed before the Vulkan call that made them returns, so nothing is live here
+    m_frameThreadId.store(GetCurrentThreadId(), std::memory_order_relaxed);
+    m_arenaOffset = 0;
+
+    const Totals totals = getTotals();
+    Tracer& tracer = Tracer::get();
+    if (tracer.isEnabled())
+    {
+        tracer.addCounter("Host allocations per frame", static_cast<int64_t>(totals.count - m_previousFrameTotals.count));
+        tracer.addCounter("Host allocations live KB", totals.liveBytes / 1024);
+    }
+    m_previousFrameTotals = totals;
+    checkSteadyState(frameIndex, totals);
+}
+
+void HostAllocator::printReport() const
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    printf("Host allocations by site and scope\n");
+    for (size_t site = 0; site < c_siteCount; ++site)
+    {
+        for (size_t scope = 0; scope < c_scopeCount; ++scope)
+        {
+            const Counters& counters = m_sites[site].scopes[scope];
+            const uint64_t count = counters.count.load(std::memory_order_relaxed);
+            if (count > 0)
+            {
+                printf("  %-12s %-8s %8llu allocations %10.1f KB total %8.1f KB live\n", c_siteNames[site], c_scopeNames[scope], static_cast<unsigned long long>(count),
+                       toKilobytes(counters.bytes.load(std::memory_order_relaxed)), toKilobytes(counters.liveBytes.load(std::memory_order_relaxed)));
+            }
+        }
+
+        const int64_t internalBytes = m_sites[site].internalBytes.load(std::memory_order_relaxed);
+        if (internalBytes != 0)
+        {
+            printf("  %-12s internal %8.1f KB live\n", c_siteNames[site], toKilobytes(internalBytes));
+        }
+    }
+
+    if (m_arenaEnabled)
+    {
+        printf("  %llu command scope allocations served from the frame arena, %llu did not fit\n", static_cast<unsigned long long>(m_arenaAllocationCount.load()),
+               static_cast<unsigned long long>(m_arenaOverflowCount.load()));
+    }
+}
+
+void* VKAPI_PTR HostAllocator::allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    Site& site = *static_cast<Site*>(userData);
+    return site.owner->allocate(site, size, alignment, scope);
+}
+
+void* VKAPI_PTR HostAllocator::reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    Site& site = *static_cast<Site*>(userData);
+    if (original == nullptr)
+    {
+        return site.owner->allocate(site, size, alignment, scope);
+    }
+    if (size == 0)
+    {
+        site.owner->release(original);
+        return nullptr;
+    }
+
+    // On failure the original allocation must stay valid
+    void* memory = site.owner->allocate(site, size, alignment, scope);
+    if (memory != nullptr)
+    {
+        const Header* header = static_cast<const Header*>(original) - 1;
+        std::memcpy(memory, original, std::min(header->size, size));
+        site.owner->release(original);
+    }
+    return memory;
+}
+
+void VKAPI_PTR HostAllocator::freeCallback(void* userData, void* memory)
+{
+    static_cast<Site*>(userData)->owner->release(memory);
+}
+
+void VKAPI_PTR HostAllocator::internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType /*type*/, VkSystemAllocationScope /*scope*/)
+{
+    static_cast<Site*>(userData)->internalBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+void VKAPI_PTR HostAllocator::internalFreeCallback(void* userData, size_t size, VkInternalAllocationType /*type*/, VkSystemAllocationScope /*scope*/)
+{
+    static_cast<Site*>(userData)->internalBytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+void* HostAllocator::allocate(Site& site, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+    alignment = std::max(alignment, c_minAlignment);
+    const size_t totalSize = sizeof(Header) + size + alignment;
+
+    uint8_t* base = nullptr;
+    bool fromArena = false;
+    // The arena is only touched by the frame thread, which also resets it
+    if (m_arenaEnabled && scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && GetCurrentThreadId() == m_frameThreadId.load(std::memory_order_relaxed))
+    {
+        base = allocateFromArena(totalSize);
+        fromArena = base != nullptr;
+    }
+    if (base == nullptr)
+    {
+        base = static_cast<uint8_t*>(std::malloc(totalSize));
+        if (base == nullptr)
+        {
+            return nullptr;
+        }
+    }
+
+    const uintptr_t aligned = (reinterpret_cast<uintptr_t>(base) + sizeof(Header) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    Header* header = reinterpret_cast<Header*>(aligned) - 1;
+    header->base = fromArena ? nullptr : base;
+    header->size = size;
+    header->site = &site;
+    header->scope = static_cast<uint32_t>(scope);
+
+    Counters& counters = site.scopes[scope];
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    counters.liveBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+    return reinterpret_cast<void*>(aligned);
+}
+
+void HostAllocator::release(void* memory)
+{
+    if (memory == nullptr)
+    {
+        return;
+    }
+
+    const Header* header = static_cast<const Header*>(memory) - 1;
+    header->site->scopes[header->scope].liveBytes.fetch_sub(static_cast<int64_t>(header->size), std::memory_order_relaxed);
+    // Arena memory is reclaimed when the arena is reset
+    std::free(header->base);
+}
+
+uint8_t* HostAllocator::allocateFromArena(size_t size)
+{
+    if (m_arenaOffset + size > c_arenaSize)
+    {
+        m_arenaOverflowCount.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    uint8_t* memory = m_arena.get() + m_arenaOffset;
+    m_arenaOffset += size;
+    m_arenaAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    return memory;
+}
+
+HostAllocator::Totals HostAllocator::getTotals() const
+{
+    Totals totals;
+    for (const Site& site : m_sites)
+    {
+        for (const Counters& counters : site.scopes)
+        {
+            totals.count += counters.count.load(std::memory_order_relaxed);
+            totals.bytes += counters.bytes.load(std::memory_order_relaxed);
+            totals.liveBytes += counters.liveBytes.load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+void HostAllocator::checkSteadyState(uint64_t frameIndex, const Totals& totals)
+{
+    if (frameIndex < c_warmupFrameCount)
+    {
+        return;
+    }
+
+    auto getSiteCount = [this](size_t site) {
+        uint64_t count = 0;
+        for (const Counters& counters : m_sites[site].scopes)
+        {
+            count += counters.count.load(std::memory_order_relaxed);
+        }
+        return count;
+    };
+
+    if (m_windowStartFrameIndex != 0 && frameIndex - m_windowStartFrameIndex < c_steadyStateWindowFrameCount)
+    {
+        return;
+    }
+
+    if (m_windowStartFrameIndex != 0)
+    {
+        const uint64_t count = totals.count - m_windowStartTotals.count;
+        const int64_t growth = totals.liveBytes - m_windowStartTotals.liveBytes;
+        if (count > 0 || growth > 0)
+        {
+            printf("WARNING: %llu host allocations (%.1f KB) in the last %llu frames, live host memory changed by %+.1f KB\n", static_cast<unsigned long long>(count),
+                   toKilobytes(static_cast<int64_t>(totals.bytes - m_windowStartTotals.bytes)), static_cast<unsigned long long>(frameIndex - m_windowStartFrameIndex), toKilobytes(growth));
+            for (size_t site = 0; site < c_siteCount; ++site)
+            {
+                const uint64_t siteCount = getSiteCount(site) - m_windowStartSiteCounts[site];
+                if (siteCount > 0)
+                {
+                    printf("  %s: %llu allocations\n", c_siteNames[site], static_cast<unsigned long long>(siteCount));
+                }
+            }
+        }
+    }
+
+    m_windowStartFrameIndex = frameIndex;
+    m_windowStartTotals = totals;
+    for (size_t site = 0; site < c_siteCount; ++site)
+    {
+        m_windowStartSiteCounts[site] = getSiteCount(site);
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Which part of the application passed the callbacks, driver allocations are counted per site and allocation scope
+enum class AllocationSite
+{
+    Instance,
+    Surface,
+    Device,
+    Swapchain,
+    CommandPool,
+    Sync,
+    Pipeline,
+    Descriptors,
+    Images,
+    Count
+};
+
+// Optional VkAllocationCallbacks that make the host allocations of the driver visible. Enabled with
+// DXVK_INTEROP_HOST_ALLOCATOR=count, or =arena to also serve the command scope allocations of the frame thread from a
+// bump arena that is reset every frame. Allocations made after the warm-up frames are reported as steady state churn.
+class HostAllocator final
+{
+public:
+    HostAllocator();
+    HostAllocator(const HostAllocator&) = delete;
+    HostAllocator& operator=(const HostAllocator&) = delete;
+
+    // Null when disabled so that the driver uses its own allocator, create and destroy must pass the same site
+    const VkAllocationCallbacks* getCallbacks(AllocationSite site) const;
+    // Called on the frame thread before the frame makes any Vulkan calls
+    void beginFrame(uint64_t frameIndex);
+    void printReport() const;
+
+private:
+    static const size_t c_siteCount = static_cast<size_t>(AllocationSite::Count);
+    static const size_t c_scopeCount = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+    struct Counters
+    {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<int64_t> liveBytes{0};
+    };
+
+    struct Site
+    {
+        HostAllocator* owner = nullptr;
+        std::array<Counters, c_scopeCount> scopes;
+        std::atomic<int64_t> internalBytes{0};
+    };
+
+    // Stored in front of every allocation
+    struct Header
+    {
+        void* base;
+        size_t size;
+        Site* site;
+        uint32_t scope;
+        uint32_t padding;
+    };
+
+    struct Totals
+    {
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+        int64_t liveBytes = 0;
+    };
+
+    static void* VKAPI_PTR allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+    static void* VKAPI_PTR reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+    static void VKAPI_PTR freeCallback(void* userData, void* memory);
+    static void VKAPI_PTR internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+    static void VKAPI_PTR internalFreeCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+    void* allocate(Site& site, size_t size, size_t alignment, VkSystemAllocationScope scope);
+    void release(void* memory);
+    uint8_t* allocateFromArena(size_t size);
+    Totals getTotals() const;
+    void checkSteadyState(uint64_t frameIndex, const Totals& totals);
+
+    bool m_enabled = false;
+    bool m_arenaEnabled = false;
+    std::array<Site, c_siteCount> m_sites;
+    std::array<VkAllocationCallbacks, c_siteCount> m_callbacks{};
+
+    std::unique_ptr<uint8_t[]> m_arena;
+    size_t m_arenaOffset = 0;
+    std::atomic<uint32_t> m_frameThreadId{0};
+    std::atomic<uint64_t> m_arenaAllocationCount{0};
+    std::atomic<uint64_t> m_arenaOverflowCount{0};
+
+    Totals m_previousFrameTotals;
+    uint64_t m_windowStartFrameIndex = 0;
+    Totals m_windowStartTotals;
+    std::array<uint64_t, c_siteCount> m_windowStartSiteCounts{};
+};
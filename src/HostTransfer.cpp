@@ -0,0 +1,359 @@
+#include "HostTransfer.hpp"
+#include "Context.hpp"
+#include "DX.hpp"
+#include <cstring>
+
+namespace
+{
+const VkFormat c_imageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+// Used like an imported image, and written by the upload copy
+const VkImageUsageFlags c_imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+const DirtyRect c_fullRect{0, 0, c_texWidth, c_texHeight};
+const DWORD c_keyedMutexTimeoutMs = 5;
+// The first read waits longer so that the first frames usually have content to show, the image stays without content
+// until a read succeeds
+const DWORD c_initialKeyedMutexTimeoutMs = 1000;
+// The uploaded image is first read by the mip chain copy or the fragment shader
+const VkPipelineStageFlags2 c_uploadedWaitStages = VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+
+void checkFrameResult(HRESULT hr)
+{
+    if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET || hr == DXGI_ERROR_DEVICE_HUNG)
+    {
+        throw RecoverableError("D3D11 device removed during host transfer");
+    }
+    CHECK(SUCCEEDED(hr));
+}
+} // namespace
+
+HostTransfer::HostTransfer(VkDevice device, VkPhysicalDevice physicalDevice, FrameGraph& frameGraph, MemoryBudget& memoryBudget, const AdapterId& adapter, uint32_t slotCount) :
+    m_device(device),
+    m_physicalDevice(physicalDevice),
+    m_frameGraph(frameGraph),
+    m_memoryBudget(memoryBudget),
+    m_slotCount(slotCount)
+{
+    checkFrameResult(DX::createDeviceOnAdapter(adapter, &m_d3dDevice, &m_d3dContext));
+    checkFrameResult(m_d3dDevice->QueryInterface(__uuidof(ID3D11Device1), (void**)&m_d3dDevice1));
+
+    m_slotSize = static_cast<VkDeviceSize>(c_texWidth) * c_texHeight * c_texChannels;
+
+    createImage();
+    createMappedBuffer();
+    m_memoryBudget.track(MemoryCategory::HostTransfer, m_image.memoryTypeIndex, m_image.size);
+    m_memoryBudget.track(MemoryCategory::HostTransfer, m_uploadMemoryTypeIndex, m_uploadMemorySize);
+}
+
+HostTransfer::~HostTransfer()
+{
+    if (m_context != nullptr)
+    {
+        vkFreeCommandBuffers(m_device, m_context->getGraphicsCommandPool(), ui32Size(m_releaseCommandBuffers), m_releaseCommandBuffers.data());
+        vkFreeCommandBuffers(m_device, m_context->getTransferCommandPool(), ui32Size(m_copyCommandBuffers), m_copyCommandBuffers.data());
+        vkDestroySemaphore(m_device, m_uploadedSemaphore, m_context->getAllocator(AllocationSite::Sync));
+        vkDestroySemaphore(m_device, m_releasedSemaphore, m_context->getAllocator(AllocationSite::Sync));
+    }
+
+    m_frameGraph.unregisterImage(m_image.image);
+    vkDestroyImageView(m_device, m_image.view, nullptr);
+    vkDestroyImage(m_device, m_image.image, nullptr);
+    vkFreeMemory(m_device, m_image.memory, nullptr);
+    m_memoryBudget.untrack(MemoryCategory::HostTransfer, m_image.memoryTypeIndex, m_image.size);
+
+    vkDestroyBuffer(m_device, m_uploadBuffer, nullptr);
+    if (m_uploadMemory != VK_NULL_HANDLE)
+    {
+        vkUnmapMemory(m_device, m_uploadMemory);
+    }
+    vkFreeMemory(m_device, m_uploadMemory, nullptr);
+    m_memoryBudget.untrack(MemoryCategory::HostTransfer, m_uploadMemoryTypeIndex, m_uploadMemorySize);
+
+    releaseSharedTexture();
+    if (m_d3dDevice1)
+    {
+        m_d3dDevice1->Release();
+    }
+    if (m_d3dContext)
+    {
+        m_d3dContext->Release();
+    }
+    if (m_d3dDevice)
+    {
+        m_d3dDevice->Release();
+    }
+}
+
+const char* HostTransfer::getPathName() const
+{
+    return "host copy (staging buffer)";
+}
+
+void HostTransfer::useTransferQueue(Context& context)
+{
+    CHECK(context.hasTransferQueue() && !m_frameGraph.hasContent(m_image.image));
+    m_context = &context;
+    m_transferQueueFamilyIndex = context.getTransferQueueFamilyIndex();
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = m_slotCount;
+
+    m_releaseCommandBuffers.resize(m_slotCount);
+    allocInfo.commandPool = context.getGraphicsCommandPool();
+    VK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, m_releaseCommandBuffers.data()));
+
+    m_copyCommandBuffers.resize(m_slotCount);
+    allocInfo.commandPool = context.getTransferCommandPool();
+    VK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, m_copyCommandBuffers.data()));
+
+    m_releasedSemaphore = createTimelineSemaphore(m_device, context.getAllocator(AllocationSite::Sync), 0);
+    m_uploadedSemaphore = createTimelineSemaphore(m_device, context.getAllocator(AllocationSite::Sync), 0);
+}
+
+const ImportedImage& HostTransfer::upload(VkCommandBuffer cb, uint32_t queueFamilyIndex, HANDLE sharedHandle, uint32_t slot, DirtyRect& dirtyRect, ImageUsage nextUsage)
+{
+    CHECK(slot < m_slotCount);
+
+    const bool hasContent = m_frameGraph.hasContent(m_image.image);
+    if (sharedHandle != m_openedHandle || !hasContent)
+    {
+        // A new surface needs to be read in full
+        if (sharedHandle != m_openedHandle)
+        {
+            openSharedTexture(sharedHandle);
+        }
+        m_pendingRect = c_fullRect;
+    }
+
+    const DirtyRect rect = clampRect(unite(m_pendingRect, dirtyRect), c_texWidth, c_texHeight);
+    dirtyRect = DirtyRect{};
+    if (isEmpty(rect))
+    {
+        return m_image;
+    }
+
+    // Each slot belongs to one swapchain image, its previous copy has completed once the image has been acquired
+    uint8_t* slotData = m_uploadData + slot * m_slotSize;
+    const DWORD timeoutMs = hasContent ? c_keyedMutexTimeoutMs : c_initialKeyedMutexTimeoutMs;
+    if (!readBack(rect, slotData, timeoutMs))
+    {
+        m_pendingRect = rect;
+        return m_image;
+    }
+    m_pendingRect = DirtyRect{};
+    dirtyRect = rect;
+
+    if (m_context != nullptr)
+    {
+        submitTransferQueueCopy(queueFamilyIndex, slot, rect, nextUsage);
+        return m_image;
+    }
+
+    const ImageAccess access{m_image.image, ImageUsage::TransferWrite};
+    m_frameGraph.beginPass(cb, queueFamilyIndex, Span<const ImageAccess>(access));
+    recordCopy(cb, slot, rect);
+    return m_image;
+}
+
+void HostTransfer::recordCopy(VkCommandBuffer cb, uint32_t slot, const DirtyRect& rect)
+{
+    // The slot has the layout of the full texture
+    VkBufferImageCopy region{};
+    region.bufferOffset = slot * m_slotSize + (static_cast<VkDeviceSize>(rect.top) * c_texWidth + rect.left) * c_texChannels;
+    region.bufferRowLength = c_texWidth;
+    region.bufferImageHeight = 0;
+    region.imageSubresource = VkImageSubresourceLayers{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageOffset = VkOffset3D{rect.left, rect.top, 0};
+    region.imageExtent = VkExtent3D{static_cast<uint32_t>(rect.right - rect.left), static_cast<uint32_t>(rect.bottom - rect.top), 1};
+    vkCmdCopyBufferToImage(cb, m_uploadBuffer, m_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+void HostTransfer::submitTransferQueueCopy(uint32_t graphicsQueueFamilyIndex, uint32_t slot, const DirtyRect& rect, ImageUsage nextUsage)
+{
+    SubmitBatch& graphicsBatch = m_context->getGraphicsBatch();
+    SubmitBatch& transferBatch = m_context->getTransferBatch();
+    ++m_handoffValue;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    // Every upload hands the image to the graphics queue, so after the first one it has to be released there
+    if (m_frameGraph.hasContent(m_image.image))
+    {
+        const VkCommandBuffer releaseCb = m_releaseCommandBuffers[slot];
+        VK_CHECK(vkResetCommandBuffer(releaseCb, 0));
+        VK_CHECK(vkBeginCommandBuffer(releaseCb, &beginInfo));
+        // Completes the previous handoff in case no pass has used the image since
+        const ImageAccess access{m_image.image, m_graphicsUsage};
+        m_frameGraph.beginPass(releaseCb, graphicsQueueFamilyIndex, Span<const ImageAccess>(access));
+        m_frameGraph.releaseOwnership(releaseCb, m_image.image, m_transferQueueFamilyIndex, ImageUsage::TransferWrite);
+        VK_CHECK(vkEndCommandBuffer(releaseCb));
+
+        graphicsBatch.addCommandBuffer(releaseCb);
+        graphicsBatch.addSignal(m_releasedSemaphore, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_handoffValue);
+        transferBatch.addWait(m_releasedSemaphore, VK_PIPELINE_STAGE_2_TRANSFER_BIT, m_handoffValue);
+    }
+
+    const VkCommandBuffer copyCb = m_copyCommandBuffers[slot];
+    VK_CHECK(vkResetCommandBuffer(copyCb, 0));
+    VK_CHECK(vkBeginCommandBuffer(copyCb, &beginInfo));
+    const ImageAccess access{m_image.image, ImageUsage::TransferWrite};
+    m_frameGraph.beginPass(copyCb, m_transferQueueFamilyIndex, Span<const ImageAccess>(access));
+    recordCopy(copyCb, slot, rect);
+    m_frameGraph.releaseOwnership(copyCb, m_image.image, graphicsQueueFamilyIndex, nextUsage);
+    VK_CHECK(vkEndCommandBuffer(copyCb));
+
+    transferBatch.addCommandBuffer(copyCb);
+    transferBatch.addSignal(m_uploadedSemaphore, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_handoffValue);
+    graphicsBatch.addWait(m_uploadedSemaphore, c_uploadedWaitStages, m_handoffValue);
+    m_graphicsUsage = nextUsage;
+}
+
+void HostTransfer::createImage()
+{
+    m_image.id = createImageId();
+    { // Create Image
+        VkImageCreateInfo imageCreateInfo{};
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = c_imageFormat;
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.extent = VkExtent3D{c_texWidth, c_texHeight, 1};
+        imageCreateInfo.usage = c_imageUsage;
+        VK_CHECK(vkCreateImage(m_device, &imageCreateInfo, nullptr, &m_image.image));
+    }
+
+    { // Allocate and bind memory
+        VkMemoryRequirements memRequirements{};
+        vkGetImageMemoryRequirements(m_device, m_image.image, &memRequirements);
+
+        const MemoryTypeResult memoryTypeResult = findMemoryType(m_physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        CHECK(memoryTypeResult.found);
+
+        VkMemoryAllocateInfo memAllocInfo{};
+        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memAllocInfo.allocationSize = memRequirements.size;
+        memAllocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+        m_image.size = memRequirements.size;
+        m_image.memoryTypeIndex = memoryTypeResult.typeIndex;
+
+        VK_CHECK(vkAllocateMemory(m_device, &memAllocInfo, nullptr, &m_image.memory));
+        VK_CHECK(vkBindImageMemory(m_device, m_image.image, m_image.memory, 0));
+    }
+
+    { // Create image view
+        VkImageViewCreateInfo viewCreateInfo{};
+        viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewCreateInfo.image = m_image.image;
+        viewCreateInfo.format = c_imageFormat;
+        viewCreateInfo.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        VK_CHECK(vkCreateImageView(m_device, &viewCreateInfo, nullptr, &m_image.view));
+    }
+
+    m_frameGraph.registerImage(m_image.image, 1);
+}
+
+void HostTransfer::createMappedBuffer()
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = m_slotSize * m_slotCount;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_uploadBuffer));
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(m_device, m_uploadBuffer, &memRequirements);
+
+    const MemoryTypeResult memoryTypeResult = findMemoryType(m_physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    CHECK(memoryTypeResult.found);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+
+    VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &m_uploadMemory));
+    VK_CHECK(vkBindBufferMemory(m_device, m_uploadBuffer, m_uploadMemory, 0));
+    m_uploadMemoryTypeIndex = memoryTypeResult.typeIndex;
+    m_uploadMemorySize = memRequirements.size;
+
+    // Stays mapped for the lifetime of the buffer
+    void* data;
+    VK_CHECK(vkMapMemory(m_device, m_uploadMemory, 0, VK_WHOLE_SIZE, 0, &data));
+    m_uploadData = static_cast<uint8_t*>(data);
+}
+
+void HostTransfer::openSharedTexture(HANDLE sharedHandle)
+{
+    releaseSharedTexture();
+
+    checkFrameResult(m_d3dDevice1->OpenSharedResource1(sharedHandle, __uuidof(ID3D11Texture2D), (void**)&m_sharedTexture));
+    checkFrameResult(m_sharedTexture->QueryInterface(__uuidof(IDXGIKeyedMutex), (void**)&m_keyedMutex));
+
+    D3D11_TEXTURE2D_DESC desc{};
+    m_sharedTexture->GetDesc(&desc);
+    CHECK(desc.Width == c_texWidth && desc.Height == c_texHeight);
+
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.BindFlags = 0;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    desc.MiscFlags = 0;
+    checkFrameResult(m_d3dDevice->CreateTexture2D(&desc, nullptr, &m_stagingTexture));
+
+    m_openedHandle = sharedHandle;
+}
+
+void HostTransfer::releaseSharedTexture()
+{
+    if (m_stagingTexture)
+    {
+        m_stagingTexture->Release();
+        m_stagingTexture = nullptr;
+    }
+    if (m_keyedMutex)
+    {
+        m_keyedMutex->Release();
+        m_keyedMutex = nullptr;
+    }
+    if (m_sharedTexture)
+    {
+        m_sharedTexture->Release();
+        m_sharedTexture = nullptr;
+    }
+    m_openedHandle = nullptr;
+}
+
+bool HostTransfer::readBack(const DirtyRect& rect, uint8_t* dst, DWORD timeoutMs)
+{
+    const HRESULT acquireResult = m_keyedMutex->AcquireSync(0, timeoutMs);
+    if (acquireResult != WAIT_OBJECT_0)
+    {
+        checkFrameResult(acquireResult);
+        return false;
+    }
+
+    const D3D11_BOX box{static_cast<UINT>(rect.left), static_cast<UINT>(rect.top), 0, static_cast<UINT>(rect.right), static_cast<UINT>(rect.bottom), 1};
+    m_d3dContext->CopySubresourceRegion(m_stagingTexture, 0, rect.left, rect.top, 0, m_sharedTexture, 0, &box);
+    checkFrameResult(m_keyedMutex->ReleaseSync(0));
+
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    checkFrameResult(m_d3dContext->Map(m_stagingTexture, 0, D3D11_MAP_READ, 0, &mapped));
+
+    const size_t rowSize = static_cast<size_t>(rect.right - rect.left) * c_texChannels;
+    const uint8_t* src = static_cast<const uint8_t*>(mapped.pData);
+    for (int y = rect.top; y < rect.bottom; ++y)
+    {
+        const size_t srcOffset = static_cast<size_t>(y) * mapped.RowPitch + static_cast<size_t>(rect.left) * c_texChannels;
+        const size_t dstOffset = (static_cast<size_t>(y) * c_texWidth + rect.left) * c_texChannels;
+        std::memcpy(dst + dstOffset, src + srcOffset, rowSize);
+    }
+
+    m_d3dContext->Unmap(m_stagingTexture, 0);
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "VulkanUtils.hpp"
+#include "AdapterId.hpp"
+#include "ImportCache.hpp"
+#include <d3d11_1.h>
+#include <vector>
+
+class Context;
+
+// Fallback for drivers that cannot import the shared D3D11 texture. The texture is opened on a separate D3D11 device,
+// read back through a staging texture into a mapped host visible buffer and uploaded with a buffer to image copy.
+// When the device has a dedicated transfer queue, the copy runs there and the image changes queue family twice per
+// upload: the graphics queue releases it, the transfer queue acquires, copies and releases it back, and the frame
+// acquires it again. Each handoff is ordered with a timeline semaphore.
+class HostTransfer final
+{
+public:
+    HostTransfer(VkDevice device, VkPhysicalDevice physicalDevice, FrameGraph& frameGraph, MemoryBudget& memoryBudget, const AdapterId& adapter, uint32_t slotCount);
+    ~HostTransfer();
+
+    const char* getPathName() const;
+    // True while changes are waiting to be read back, the next upload retries them
+    bool hasPendingUpload() const { return !isEmpty(m_pendingRect); }
+    // Must be called before the first upload
+    void useTransferQueue(Context& context);
+    // Uploads the dirty rect of the shared texture using the upload slot of the frame. The rect is replaced with the
+    // rect that was actually uploaded. The first pass of the frame that uses the image must use it as nextUsage. The
+    // image has no content in the frame graph until the first read back succeeds and must not be sampled before that.
+    const ImportedImage& upload(VkCommandBuffer cb, uint32_t queueFamilyIndex, HANDLE sharedHandle, uint32_t slot, DirtyRect& dirtyRect, ImageUsage nextUsage);
+
+private:
+    void createImage();
+    void createMappedBuffer();
+    void openSharedTexture(HANDLE sharedHandle);
+    void releaseSharedTexture();
+    bool readBack(const DirtyRect& rect, uint8_t* dst, DWORD timeoutMs);
+    void recordCopy(VkCommandBuffer cb, uint32_t slot, const DirtyRect& rect);
+    void submitTransferQueueCopy(uint32_t graphicsQueueFamilyIndex, uint32_t slot, const DirtyRect& rect, ImageUsage nextUsage);
+
+    VkDevice m_device;
+    VkPhysicalDevice m_physicalDevice;
+    FrameGraph& m_frameGraph;
+    MemoryBudget& m_memoryBudget;
+    uint32_t m_slotCount;
+
+    ID3D11Device* m_d3dDevice = nullptr;
+    ID3D11Device1* m_d3dDevice1 = nullptr;
+    ID3D11DeviceContext* m_d3dContext = nullptr;
+    HANDLE m_openedHandle = nullptr;
+    ID3D11Texture2D* m_sharedTexture = nullptr;
+    IDXGIKeyedMutex* m_keyedMutex = nullptr;
+    ID3D11Texture2D* m_stagingTexture = nullptr;
+
+    ImportedImage m_image;
+    VkBuffer m_uploadBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_uploadMemory = VK_NULL_HANDLE;
+    uint32_t m_uploadMemoryTypeIndex = 0;
+    VkDeviceSize m_uploadMemorySize = 0;
+    uint8_t* m_uploadData = nullptr;
+    VkDeviceSize m_slotSize = 0;
+    // Changes that could not be read back yet because the producer held the keyed mutex
+    DirtyRect m_pendingRect;
+
+    // Null unless the copies run on the transfer queue
+    Context* m_context = nullptr;
+    uint32_t m_transferQueueFamilyIndex = 0;
+    // One per slot, released together with the slot
+    std::vector<VkCommandBuffer> m_releaseCommandBuffers;
+    std::vector<VkCommandBuffer> m_copyCommandBuffers;
+    // Signaled by the graphics queue when it has released the image, and by the transfer queue after the copy
+    VkSemaphore m_releasedSemaphore = VK_NULL_HANDLE;
+    VkSemaphore m_uploadedSemaphore = VK_NULL_HANDLE;
+    uint64_t m_handoffValue = 0;
+    // How the graphics queue acquired the image after the previous upload
+    ImageUsage m_graphicsUsage = ImageUsage::SampledRead;
+};
@@ -0,0 +1,223 @@
+#include "ImportCache.hpp"
+#include <vulkan/vulkan_win32.h>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+const VkImageUsageFlags c_importedImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+uint64_t s_nextImageId = 1;
+
+bool isSameObject(HANDLE a, HANDLE b)
+{
+    return a == b || CompareObjectHandles(a, b);
+}
+} // namespace
+
+uint64_t createImageId()
+{
+    return s_nextImageId++;
+}
+
+bool ImportKey::operator==(const ImportKey& other) const
+{
+    return handle == other.handle && width == other.width && height == other.height && format == other.format;
+}
+
+size_t ImportKeyHash::operator()(const ImportKey& key) const
+{
+    size_t hash = std::hash<uint64_t>()(key.handle);
+    hash ^= std::hash<uint64_t>()((static_cast<uint64_t>(key.width) << 32) | key.height) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    hash ^= std::hash<uint32_t>()(static_cast<uint32_t>(key.format)) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+ImportCache::ImportCache(VkDevice device, VkPhysicalDevice physicalDevice, FrameGraph& frameGraph, MemoryBudget& memoryBudget, size_t capacity) :
+    m_device(device),
+    m_physicalDevice(physicalDevice),
+    m_frameGraph(frameGraph),
+    m_memoryBudget(memoryBudget),
+    m_capacity(capacity)
+{
+    CHECK(m_capacity > 0);
+    m_lookup.reserve(m_capacity);
+    m_retired.reserve(m_capacity);
+}
+
+ImportCache::~ImportCache()
+{
+    for (const Entry& entry : m_entries)
+    {
+        destroy(entry.image, entry.ownedHandle);
+    }
+    for (const RetiredImage& retired : m_retired)
+    {
+        destroy(retired.image, retired.ownedHandle);
+    }
+}
+
+bool ImportCache::isImportSupported(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+    return isExternalImageImportSupported(physicalDevice, format, c_importedImageUsage, VK_EXTERNAL_MEMORY_HANDLE_TYPE_D3D11_TEXTURE_BIT);
+}
+
+ImportedImage& ImportCache::acquire(HANDLE handle, uint32_t width, uint32_t height, VkFormat format, uint64_t frameIndex)
+{
+    const ImportKey key{reinterpret_cast<uint64_t>(handle), width, height, format};
+
+    EntryList::iterator it = find(handle, key);
+    if (it == m_entries.end())
+    {
+        // Make room before allocating, under pressure the new surface replaces every cached one
+        const size_t capacity = m_memoryBudget.getPressure() == MemoryPressure::Normal ? m_capacity : 1;
+        shrink(capacity - 1);
+
+        m_entries.push_front(Entry{key, nullptr, ImportedImage{}, frameIndex});
+        it = m_entries.begin();
+        CHECK(DuplicateHandle(GetCurrentProcess(), handle, GetCurrentProcess(), &it->ownedHandle, 0, FALSE, DUPLICATE_SAME_ACCESS));
+        it->image = import(it->ownedHandle, key);
+        m_lookup[key] = it;
+
+        ++m_importCount;
+        printf("Imported surface %llu (%u imports, %zu cached)\n", static_cast<unsigned long long>(key.handle), static_cast<unsigned int>(m_importCount), m_entries.size());
+    }
+    else if (it != m_entries.begin())
+    {
+        m_entries.splice(m_entries.begin(), m_entries, it);
+    }
+
+    it->lastUsedFrameIndex = frameIndex;
+    return it->image;
+}
+
+void ImportCache::collect(uint64_t completedFrameIndex)
+{
+    auto completed = [this, completedFrameIndex](const RetiredImage& retired) {
+        if (retired.lastUsedFrameIndex > completedFrameIndex)
+        {
+            return false;
+        }
+        destroy(retired.image, retired.ownedHandle);
+        return true;
+    };
+    m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(), completed), m_retired.end());
+}
+
+void ImportCache::shrink(size_t maxEntries)
+{
+    while (m_entries.size() > maxEntries)
+    {
+        retire(std::prev(m_entries.end()));
+    }
+}
+
+ImportCache::EntryList::iterator ImportCache::find(HANDLE handle, const ImportKey& key)
+{
+    const auto found = m_lookup.find(key);
+    if (found != m_lookup.end())
+    {
+        // Handle values are recycled once the producer closes them, make sure the value still names the same surface
+        if (isSameObject(handle, found->second->ownedHandle))
+        {
+            return found->second;
+        }
+        retire(found->second);
+    }
+
+    // The same surface can arrive under a different handle value, e.g. after being duplicated again
+    for (EntryList::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        const ImportKey& entryKey = it->key;
+        if (entryKey.width == key.width && entryKey.height == key.height && entryKey.format == key.format && isSameObject(handle, it->ownedHandle))
+        {
+            m_lookup.erase(entryKey);
+            it->key = key;
+            m_lookup[key] = it;
+            return it;
+        }
+    }
+
+    return m_entries.end();
+}
+
+ImportedImage ImportCache::import(HANDLE handle, const ImportKey& key)
+{
+    ImportedImage imported;
+    imported.id = createImageId();
+
+    { // Create Image
+        VkExternalMemoryImageCreateInfo externalMemoryCreateInfo{};
+        externalMemoryCreateInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+        externalMemoryCreateInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_D3D11_TEXTURE_BIT;
+
+        VkImageCreateInfo imageCreateInfo{};
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.pNext = &externalMemoryCreateInfo;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = key.format;
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.extent.depth = 1;
+        imageCreateInfo.extent.width = key.width;
+        imageCreateInfo.extent.height = key.height;
+        imageCreateInfo.usage = c_importedImageUsage;
+        VK_CHECK(vkCreateImage(m_device, &imageCreateInfo, nullptr, &imported.image));
+    }
+
+    { // Allocate and bind memory
+        VkMemoryRequirements memRequirements{};
+        vkGetImageMemoryRequirements(m_device, imported.image, &memRequirements);
+
+        const MemoryTypeResult memoryTypeResult = findMemoryType(m_physicalDevice, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        CHECK(memoryTypeResult.found);
+
+        VkImportMemoryWin32HandleInfoKHR importInfo{};
+        importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_WIN32_HANDLE_INFO_KHR;
+        importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_D3D11_TEXTURE_BIT;
+        importInfo.handle = handle;
+
+        VkMemoryAllocateInfo memAllocInfo{};
+        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memAllocInfo.pNext = &importInfo;
+        memAllocInfo.allocationSize = memRequirements.size;
+        memAllocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+        imported.size = memRequirements.size;
+        imported.memoryTypeIndex = memoryTypeResult.typeIndex;
+
+        VK_CHECK(vkAllocateMemory(m_device, &memAllocInfo, nullptr, &imported.memory));
+        VK_CHECK(vkBindImageMemory(m_device, imported.image, imported.memory, 0));
+        m_memoryBudget.track(MemoryCategory::ImportedImages, imported.memoryTypeIndex, imported.size);
+    }
+
+    { // Create image view
+        VkImageViewCreateInfo viewCreateInfo{};
+        viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewCreateInfo.image = imported.image;
+        viewCreateInfo.format = key.format;
+        viewCreateInfo.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        VK_CHECK(vkCreateImageView(m_device, &viewCreateInfo, nullptr, &imported.view));
+    }
+
+    m_frameGraph.registerImage(imported.image, 1, VK_PIPELINE_STAGE_2_NONE, true);
+    return imported;
+}
+
+void ImportCache::retire(EntryList::iterator it)
+{
+    m_retired.push_back(RetiredImage{it->image, it->ownedHandle, it->lastUsedFrameIndex});
+    m_lookup.erase(it->key);
+    m_entries.erase(it);
+}
+
+void ImportCache::destroy(const ImportedImage& image, HANDLE ownedHandle)
+{
+    m_frameGraph.unregisterImage(image.image);
+    vkDestroyImageView(m_device, image.view, nullptr);
+    vkDestroyImage(m_device, image.image, nullptr);
+    vkFreeMemory(m_device, image.memory, nullptr);
+    m_memoryBudget.untrack(MemoryCategory::ImportedImages, image.memoryTypeIndex, image.size);
+    CloseHandle(ownedHandle);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "VulkanUtils.hpp"
+#include "FrameGraph.hpp"
+#include "MemoryBudget.hpp"
+#include <windows.h>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+struct ImportedImage
+{
+    // Never reused, unlike the handles whose values the driver may hand out again after destruction
+    uint64_t id = 0;
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    uint32_t memoryTypeIndex = 0;
+};
+
+// Ids for images whose contents or descriptors are cached by identity
+uint64_t createImageId();
+
+struct ImportKey
+{
+    uint64_t handle;
+    uint32_t width;
+    uint32_t height;
+    VkFormat format;
+
+    bool operator==(const ImportKey& other) const;
+};
+
+struct ImportKeyHash
+{
+    size_t operator()(const ImportKey& key) const;
+};
+
+// Keeps imported producer surfaces alive so that returning surfaces cost a lookup instead of a full import. Least
+// recently used entries are evicted and destroyed once the frame that last used them has completed. Imported images are
+// registered to the frame graph for their lifetime. Under memory pressure only the surface in use is kept.
+class ImportCache final
+{
+public:
+    ImportCache(VkDevice device, VkPhysicalDevice physicalDevice, FrameGraph& frameGraph, MemoryBudget& memoryBudget, size_t capacity);
+    ~ImportCache();
+
+    // Whether a shared D3D11 texture of the format can be imported with the usage the cache creates images with
+    static bool isImportSupported(VkPhysicalDevice physicalDevice, VkFormat format);
+
+    ImportedImage& acquire(HANDLE handle, uint32_t width, uint32_t height, VkFormat format, uint64_t frameIndex);
+    void collect(uint64_t completedFrameIndex);
+    // Retires least recently used surfaces until at most maxEntries are cached
+    void shrink(size_t maxEntries);
+
+private:
+    struct Entry
+    {
+        ImportKey key;
+        // Duplicate of the producer handle, keeps the object and handle value alive for identity checks
+        HANDLE ownedHandle;
+        ImportedImage image;
+        uint64_t lastUsedFrameIndex;
+    };
+
+    struct RetiredImage
+    {
+        ImportedImage image;
+        HANDLE ownedHandle;
+        uint64_t lastUsedFrameIndex;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    EntryList::iterator find(HANDLE handle, const ImportKey& key);
+    ImportedImage import(HANDLE handle, const ImportKey& key);
+    void retire(EntryList::iterator it);
+    void destroy(const ImportedImage& image, HANDLE ownedHandle);
+
+    VkDevice m_device;
+    VkPhysicalDevice m_physicalDevice;
+    FrameGraph& m_frameGraph;
+    MemoryBudget& m_memoryBudget;
+    size_t m_capacity;
+    // Most recently used first
+    EntryList m_entries;
+    std::unordered_map<ImportKey, EntryList::iterator, ImportKeyHash> m_lookup;
+    std::vector<RetiredImage> m_retired;
+    uint64_t m_importCount = 0;
+};
@@ -0,0 +1,209 @@
+#include "MemoryBudget.hpp"
+#include "Context.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+
+namespace
+{
+const uint64_t c_queryIntervalFrames = 30;
+// Fractions of the budget, pressure drops back to normal only well below the high threshold
+const double c_highPressureRatio = 0.85;
+const double c_criticalPressureRatio = 0.95;
+const double c_normalPressureRatio = 0.75;
+const double c_bytesPerMegabyte = 1024.0 * 1024.0;
+
+const char* const c_categoryNames[] = {"imported images", "mip chain", "host transfer", "swapchain (estimate)", "offscreen outputs"};
+// Counter names must be string literals, one per category
+const char* const c_categoryCounterNames[] = {"Imported images MB", "Mip chain MB", "Host transfer MB", "Swapchain MB", "Offscreen outputs MB"};
+
+const char* getPressureName(MemoryPressure pressure)
+{
+    switch (pressure)
+    {
+    case MemoryPressure::Normal:
+        return "normal";
+    case MemoryPressure::High:
+        return "high";
+    case MemoryPressure::Critical:
+        return "critical";
+    }
+    return "unknown";
+}
+
+int64_t toMegabytes(VkDeviceSize size)
+{
+    return static_cast<int64_t>(static_cast<double>(size) / c_bytesPerMegabyte);
+}
+} // namespace
+
+MemoryBudget::MemoryBudget(const Context& context) :
+    m_physicalDevice(context.getPhysicalDevice()),
+    m_budgetQueryEnabled(context.isDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+{
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);
+    for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+    {
+        m_heaps[i].budget = m_memoryProperties.memoryHeaps[i].size;
+        m_heaps[i].deviceLocal = (m_memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+
+    if (!m_budgetQueryEnabled)
+    {
+        LOGW("VK_EXT_memory_budget is not supported, memory pressure only counts our own allocations");
+    }
+    query();
+}
+
+void MemoryBudget::track(MemoryCategory category, uint32_t memoryTypeIndex, VkDeviceSize size)
+{
+    getHeap(memoryTypeIndex).tracked[static_cast<size_t>(category)] += size;
+}
+
+void MemoryBudget::untrack(MemoryCategory category, uint32_t memoryTypeIndex, VkDeviceSize size)
+{
+    VkDeviceSize& tracked = getHeap(memoryTypeIndex).tracked[static_cast<size_t>(category)];
+    CHECK(tracked >= size);
+    tracked -= size;
+}
+
+MemoryPressure MemoryBudget::update(uint64_t frameIndex)
+{
+    if (frameIndex - m_lastQueryFrameIndex < c_queryIntervalFrames)
+    {
+        return m_pressure;
+    }
+    m_lastQueryFrameIndex = frameIndex;
+    query();
+
+    double ratio = 0.0;
+    for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+    {
+        const Heap& heap = m_heaps[i];
+        if (heap.deviceLocal && heap.budget > 0)
+        {
+            ratio = std::max(ratio, static_cast<double>(getUsage(heap)) / static_cast<double>(heap.budget));
+        }
+    }
+
+    if (ratio >= c_criticalPressureRatio)
+    {
+        m_pressure = MemoryPressure::Critical;
+    }
+    else if (ratio >= c_highPressureRatio)
+    {
+        m_pressure = MemoryPressure::High;
+    }
+    else if (ratio < c_normalPressureRatio)
+    {
+        m_pressure = MemoryPressure::Normal;
+    }
+    else if (m_pressure == MemoryPressure::Critical)
+    {
+        m_pressure = MemoryPressure::High;
+    }
+
+    publishCounters();
+    return m_pressure;
+}
+
+void MemoryBudget::printReport() const
+{
+    printf("Memory pressure %s\n", getPressureName(m_pressure));
+    for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+    {
+        const Heap& heap = m_heaps[i];
+        printf("  heap %u%s: %.1f / %.1f MB used, %.1f MB ours", i, heap.deviceLocal ? " (device local)" : "", getUsage(heap) / c_bytesPerMegabyte, heap.budget / c_bytesPerMegabyte,
+               getTrackedTotal(heap) / c_bytesPerMegabyte);
+        for (size_t category = 0; category < c_categoryCount; ++category)
+        {
+            if (heap.tracked[category] > 0)
+            {
+                printf(", %s %.1f MB", c_categoryNames[category], heap.tracked[category] / c_bytesPerMegabyte);
+            }
+        }
+        printf("\n");
+    }
+}
+
+void MemoryBudget::query()
+{
+    if (!m_budgetQueryEnabled)
+    {
+        return;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budgetProperties;
+    vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &properties);
+
+    for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+    {
+        m_heaps[i].budget = budgetProperties.heapBudget[i];
+        m_heaps[i].usage = budgetProperties.heapUsage[i];
+    }
+}
+
+VkDeviceSize MemoryBudget::getTrackedTotal(const Heap& heap) const
+{
+    VkDeviceSize total = 0;
+    for (VkDeviceSize size : heap.tracked)
+    {
+        total += size;
+    }
+    return total;
+}
+
+VkDeviceSize MemoryBudget::getUsage(const Heap& heap) const
+{
+    // The driver usage covers the whole process, including D3D11 and allocations made since the last query
+    return m_budgetQueryEnabled ? std::max(heap.usage, getTrackedTotal(heap)) : getTrackedTotal(heap);
+}
+
+MemoryBudget::Heap& MemoryBudget::getHeap(uint32_t memoryTypeIndex)
+{
+    CHECK(memoryTypeIndex < m_memoryProperties.memoryTypeCount);
+    return m_heaps[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+}
+
+const MemoryBudget::Heap& MemoryBudget::getHeap(uint32_t memoryTypeIndex) const
+{
+    CHECK(memoryTypeIndex < m_memoryProperties.memoryTypeCount);
+    return m_heaps[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+}
+
+void MemoryBudget::publishCounters() const
+{
+    Tracer& tracer = Tracer::get();
+    if (!tracer.isEnabled())
+    {
+        return;
+    }
+
+    VkDeviceSize deviceLocalUsage = 0;
+    VkDeviceSize deviceLocalBudget = 0;
+    std::array<VkDeviceSize, c_categoryCount> tracked{};
+    for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+    {
+        const Heap& heap = m_heaps[i];
+        if (heap.deviceLocal)
+        {
+            deviceLocalUsage += getUsage(heap);
+            deviceLocalBudget += heap.budget;
+        }
+        for (size_t category = 0; category < c_categoryCount; ++category)
+        {
+            tracked[category] += heap.tracked[category];
+        }
+    }
+
+    tracer.addCounter("Device local usage MB", toMegabytes(deviceLocalUsage));
+    tracer.addCounter("Device local budget MB", toMegabytes(deviceLocalBudget));
+    for (size_t category = 0; category < c_categoryCount; ++category)
+    {
+        tracer.addCounter(c_categoryCounterNames[category], toMegabytes(tracked[category]));
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "VulkanUtils.hpp"
+#include <array>
+
+class Context;
+
+enum class MemoryCategory
+{
+    ImportedImages,
+    MipChain,
+    HostTransfer,
+    Swapchain,
+    Outputs,
+    Count
+};
+
+enum class MemoryPressure
+{
+    Normal,
+    High,
+    Critical
+};
+
+// Follows the device memory budget of every heap with VK_EXT_memory_budget and accounts our own allocations per
+// category. Without the extension the heap size is used as the budget and only our own allocations count as usage.
+// The pressure is derived from the fullest device local heap and has hysteresis so that it doesn't flip every frame.
+class MemoryBudget final
+{
+public:
+    explicit MemoryBudget(const Context& context);
+
+    void track(MemoryCategory category, uint32_t memoryTypeIndex, VkDeviceSize size);
+    void untrack(MemoryCategory category, uint32_t memoryTypeIndex, VkDeviceSize size);
+    // Re-queries the driver every few frames, also publishes the numbers as trace counters
+    MemoryPressure update(uint64_t frameIndex);
+    MemoryPressure getPressure() const { return m_pressure; }
+    void printReport() const;
+
+private:
+    static const size_t c_categoryCount = static_cast<size_t>(MemoryCategory::Count);
+
+    struct Heap
+    {
+        VkDeviceSize budget = 0;
+        VkDeviceSize usage = 0;
+        bool deviceLocal = false;
+        std::array<VkDeviceSize, c_categoryCount> tracked{};
+    };
+
+    void query();
+    VkDeviceSize getTrackedTotal(const Heap& heap) const;
+    VkDeviceSize getUsage(const Heap& heap) const;
+    Heap& getHeap(uint32_t memoryTypeIndex);
+    const Heap& getHeap(uint32_t memoryTypeIndex) const;
+    void publishCounters() const;
+
+    VkPhysicalDevice m_physicalDevice;
+    bool m_budgetQueryEnabled = false;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+    std::array<Heap, VK_MAX_MEMORY_HEAPS> m_heaps{};
+    uint64_t m_lastQueryFrameIndex = 0;
+    MemoryPressure m_pressure = MemoryPressure::Normal;
+};
@@ -0,0 +1,297 @@
+#include "OffscreenOutput.hpp"
+#include "Context.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+const char* c_outputsVariable = "DXVK_INTEROP_OUTPUTS";
+const uint32_t c_maxOutputExtent = 8192;
+} // namespace
+
+std::vector<OutputConfig> getOutputConfigsFromEnvironment()
+{
+    std::vector<OutputConfig> configs;
+    const char* value = std::getenv(c_outputsVariable);
+    if (value == nullptr)
+    {
+        return configs;
+    }
+
+    const char* token = value;
+    while (*token != '\0')
+    {
+        const char* end = std::strchr(token, ',');
+        const std::string entry(token, end != nullptr ? end - token : std::strlen(token));
+        token = end != nullptr ? end + 1 : token + entry.size();
+
+        const size_t colon = entry.find(':');
+        OutputConfig config{};
+        config.frameInterval = 1;
+        const bool valid = colon != std::string::npos && colon > 0 && std::sscanf(entry.c_str() + colon + 1, "%ux%u@%u", &config.width, &config.height, &config.frameInterval) >= 2;
+        if (!valid || config.width == 0 || config.height == 0 || config.width > c_maxOutputExtent || config.height > c_maxOutputExtent || config.frameInterval == 0)
+        {
+            printf("Ignoring invalid %s entry '%s', expected <name>:<width>x<height>[@<frame interval>]\n", c_outputsVariable, entry.c_str());
+            continue;
+        }
+        config.name = entry.substr(0, colon);
+        configs.push_back(config);
+    }
+    return configs;
+}
+
+OffscreenOutput::OffscreenOutput(const Context& context, FrameGraph& frameGraph, MemoryBudget& memoryBudget, VkRenderPass renderPass, const OutputConfig& config, uint32_t ringLength) :
+    m_context(context),
+    m_device(context.getDevice()),
+    m_frameGraph(frameGraph),
+    m_memoryBudget(memoryBudget),
+    m_config(config),
+    m_targets(ringLength)
+{
+    for (OutputTarget& target : m_targets)
+    {
+        createTarget(target, renderPass);
+    }
+    printf("Output %s: %ux%u every %u frame(s), %u images\n", m_config.name.c_str(), m_config.width, m_config.height, m_config.frameInterval, ringLength);
+}
+
+OffscreenOutput::~OffscreenOutput()
+{
+    for (const OutputTarget& target : m_targets)
+    {
+        m_frameGraph.unregisterImage(target.image);
+        vkDestroyFramebuffer(m_device, target.framebuffer, m_context.getAllocator(AllocationSite::Images));
+        vkDestroyImageView(m_device, target.view, m_context.getAllocator(AllocationSite::Images));
+        vkDestroyImage(m_device, target.image, m_context.getAllocator(AllocationSite::Images));
+        vkFreeMemory(m_device, target.memory, m_context.getAllocator(AllocationSite::Images));
+        m_memoryBudget.untrack(MemoryCategory::Outputs, m_memoryTypeIndex, m_memorySize);
+    }
+
+    if (m_readbackBuffer != VK_NULL_HANDLE)
+    {
+        vkDestroyBuffer(m_device, m_readbackBuffer, m_context.getAllocator(AllocationSite::Images));
+        vkFreeMemory(m_device, m_readbackMemory, m_context.getAllocator(AllocationSite::Images));
+        m_memoryBudget.untrack(MemoryCategory::Outputs, m_readbackMemoryTypeIndex, m_readbackMemorySize);
+    }
+
+    if (m_skippedFrameCount > 0)
+    {
+        printf("Output %s skipped %llu due frames, every image was in use\n", m_config.name.c_str(), static_cast<unsigned long long>(m_skippedFrameCount));
+    }
+}
+
+const OutputTarget* OffscreenOutput::beginFrame(uint64_t frameIndex, uint64_t completedFrameIndex, uint64_t contentVersion)
+{
+    if (frameIndex % m_config.frameInterval != 0 || contentVersion == m_contentVersion)
+    {
+        return nullptr;
+    }
+
+    // The oldest finished image, the newest one is left for readers
+    OutputTarget* selected = nullptr;
+    for (OutputTarget& target : m_targets)
+    {
+        if (target.frameIndex <= completedFrameIndex && (selected == nullptr || target.frameIndex < selected->frameIndex))
+        {
+            selected = &target;
+        }
+    }
+    if (selected == nullptr)
+    {
+        ++m_skippedFrameCount;
+        return nullptr;
+    }
+
+    selected->frameIndex = frameIndex;
+    m_contentVersion = contentVersion;
+    return selected;
+}
+
+const OutputTarget* OffscreenOutput::getLatest(uint64_t completedFrameIndex) const
+{
+    const OutputTarget* latest = nullptr;
+    for (const OutputTarget& target : m_targets)
+    {
+        if (target.frameIndex > 0 && target.frameIndex <= completedFrameIndex && (latest == nullptr || target.frameIndex > latest->frameIndex))
+        {
+            latest = &target;
+        }
+    }
+    return latest;
+}
+
+void OffscreenOutput::requestCapture()
+{
+    if (m_captureFrameIndex == 0)
+    {
+        m_captureRequested = true;
+    }
+}
+
+void OffscreenOutput::recordCapture(VkCommandBuffer cb, uint32_t queueFamilyIndex, uint64_t frameIndex, uint64_t completedFrameIndex)
+{
+    const OutputTarget* latest = m_captureRequested ? getLatest(completedFrameIndex) : nullptr;
+    if (latest == nullptr)
+    {
+        return;
+    }
+
+    if (m_readbackBuffer == VK_NULL_HANDLE)
+    {
+        createReadbackBuffer();
+    }
+    m_captureRequested = false;
+    m_captureFrameIndex = frameIndex;
+
+    const ImageAccess access{latest->image, ImageUsage::TransferRead};
+    m_frameGraph.beginPass(cb, queueFamilyIndex, Span<const ImageAccess>(access));
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = VkImageSubresourceLayers{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = VkExtent3D{m_config.width, m_config.height, 1};
+    vkCmdCopyImageToBuffer(cb, latest->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_readbackBuffer, 1, &region);
+
+    // The frame fence alone doesn't make the copy visible to the host
+    VkMemoryBarrier2 hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    hostBarrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    hostBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    hostBarrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.memoryBarrierCount = 1;
+    dependencyInfo.pMemoryBarriers = &hostBarrier;
+    vkCmdPipelineBarrier2(cb, &dependencyInfo);
+}
+
+void OffscreenOutput::finishCapture(uint64_t completedFrameIndex)
+{
+    if (m_captureFrameIndex == 0 || m_captureFrameIndex > completedFrameIndex)
+    {
+        return;
+    }
+    m_captureFrameIndex = 0;
+
+    // Binary PPM has no alpha and stores RGB, the images are BGRA
+    const std::string path = m_config.name + ".ppm";
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << m_config.width << " " << m_config.height << "\n255\n";
+    std::vector<uint8_t> row(size_t(m_config.width) * 3);
+    for (uint32_t y = 0; y < m_config.height; ++y)
+    {
+        const uint8_t* pixel = m_readbackData + size_t(y) * m_config.width * 4;
+        for (uint32_t x = 0; x < m_config.width; ++x, pixel += 4)
+        {
+            row[x * 3] = pixel[2];
+            row[x * 3 + 1] = pixel[1];
+            row[x * 3 + 2] = pixel[0];
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+
+    if (!file)
+    {
+        printf("WARNING: Failed to write the capture of output %s to %s\n", m_config.name.c_str(), path.c_str());
+        return;
+    }
+    printf("Output %s captured to %s\n", m_config.name.c_str(), path.c_str());
+}
+
+void OffscreenOutput::createTarget(OutputTarget& target, VkRenderPass renderPass)
+{
+    { // Create image
+        VkImageCreateInfo imageCreateInfo{};
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = c_surfaceFormat.format;
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.extent.depth = 1;
+        imageCreateInfo.extent.width = m_config.width;
+        imageCreateInfo.extent.height = m_config.height;
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VK_CHECK(vkCreateImage(m_device, &imageCreateInfo, m_context.getAllocator(AllocationSite::Images), &target.image));
+    }
+
+    { // Allocate and bind memory
+        VkMemoryRequirements memRequirements{};
+        vkGetImageMemoryRequirements(m_device, target.image, &memRequirements);
+
+        const MemoryTypeResult memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        CHECK(memoryTypeResult.found);
+
+        VkMemoryAllocateInfo memAllocInfo{};
+        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memAllocInfo.allocationSize = memRequirements.size;
+        memAllocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+        m_memoryTypeIndex = memoryTypeResult.typeIndex;
+        m_memorySize = memRequirements.size;
+
+        VK_CHECK(vkAllocateMemory(m_device, &memAllocInfo, m_context.getAllocator(AllocationSite::Images), &target.memory));
+        VK_CHECK(vkBindImageMemory(m_device, target.image, target.memory, 0));
+        m_memoryBudget.track(MemoryCategory::Outputs, m_memoryTypeIndex, m_memorySize);
+    }
+
+    { // Create image view
+        VkImageViewCreateInfo viewCreateInfo{};
+        viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewCreateInfo.image = target.image;
+        viewCreateInfo.format = c_surfaceFormat.format;
+        viewCreateInfo.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        VK_CHECK(vkCreateImageView(m_device, &viewCreateInfo, m_context.getAllocator(AllocationSite::Images), &target.view));
+    }
+
+    { // Create framebuffer
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &target.view;
+        framebufferInfo.width = m_config.width;
+        framebufferInfo.height = m_config.height;
+        framebufferInfo.layers = 1;
+        VK_CHECK(vkCreateFramebuffer(m_device, &framebufferInfo, m_context.getAllocator(AllocationSite::Images), &target.framebuffer));
+    }
+
+    m_frameGraph.registerImage(target.image, 1);
+}
+
+void OffscreenOutput::createReadbackBuffer()
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = VkDeviceSize(m_config.width) * m_config.height * 4;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VK_CHECK(vkCreateBuffer(m_device, &bufferInfo, m_context.getAllocator(AllocationSite::Images), &m_readbackBuffer));
+
+    VkMemoryRequirements memRequirements{};
+    vkGetBufferMemoryRequirements(m_device, m_readbackBuffer, &memRequirements);
+
+    const VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const MemoryTypeResult memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), memRequirements.memoryTypeBits, properties);
+    CHECK(memoryTypeResult.found);
+
+    VkMemoryAllocateInfo memAllocInfo{};
+    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memAllocInfo.allocationSize = memRequirements.size;
+    memAllocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
+    m_readbackMemoryTypeIndex = memoryTypeResult.typeIndex;
+    m_readbackMemorySize = memRequirements.size;
+
+    VK_CHECK(vkAllocateMemory(m_device, &memAllocInfo, m_context.getAllocator(AllocationSite::Images), &m_readbackMemory));
+    VK_CHECK(vkBindBufferMemory(m_device, m_readbackBuffer, m_readbackMemory, 0));
+    m_memoryBudget.track(MemoryCategory::Outputs, m_readbackMemoryTypeIndex, m_readbackMemorySize);
+
+    void* data = nullptr;
+    VK_CHECK(vkMapMemory(m_device, m_readbackMemory, 0, VK_WHOLE_SIZE, 0, &data));
+    m_readbackData = static_cast<const uint8_t*>(data);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "VulkanUtils.hpp"
+#include "FrameGraph.hpp"
+#include "MemoryBudget.hpp"
+#include <string>
+#include <vector>
+
+class Context;
+
+struct OutputConfig
+{
+    std::string name;
+    uint32_t width;
+    uint32_t height;
+    // Rendered every n:th frame
+    uint32_t frameInterval;
+};
+
+// Parsed from DXVK_INTEROP_OUTPUTS, e.g. "preview:640x360@1,capture:1920x1080@2"
+std::vector<OutputConfig> getOutputConfigsFromEnvironment();
+
+struct OutputTarget
+{
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    // Frame that last rendered to the image
+    uint64_t frameIndex = 0;
+};
+
+// Offscreen copy of the shown surface with its own size and rate, e.g. for a preview, capture or remote stream. The
+// renderer draws into it in the same command buffer as the window. A ring of images lets readers keep the latest
+// finished image while the next one is rendered. Readers declare their accesses to the frame graph. The built-in reader
+// is a capture that copies the latest finished image to host memory and writes it to <name>.ppm.
+class OffscreenOutput final
+{
+public:
+    OffscreenOutput(const Context& context, FrameGraph& frameGraph, MemoryBudget& memoryBudget, VkRenderPass renderPass, const OutputConfig& config, uint32_t ringLength);
+    ~OffscreenOutput();
+    OffscreenOutput(const OffscreenOutput&) = delete;
+    OffscreenOutput& operator=(const OffscreenOutput&) = delete;
+
+    // The image to render this frame, null when the output is not due, the content hasn't changed since the last
+    // render or every image is still in use by the GPU
+    const OutputTarget* beginFrame(uint64_t frameIndex, uint64_t completedFrameIndex, uint64_t contentVersion);
+    // Newest image the GPU has finished rendering, null before the first one
+    const OutputTarget* getLatest(uint64_t completedFrameIndex) const;
+    bool isUpToDate(uint64_t contentVersion) const { return contentVersion == m_contentVersion; }
+
+    // Ignored while a capture is in flight
+    void requestCapture();
+    // Copies the latest finished image for a requested capture. Recorded before the outputs are drawn so that it reads
+    // the image the GPU finished, the request stays until there is one.
+    void recordCapture(VkCommandBuffer cb, uint32_t queueFamilyIndex, uint64_t frameIndex, uint64_t completedFrameIndex);
+    // Writes the copy to disk once the frame that recorded it has completed
+    void finishCapture(uint64_t completedFrameIndex);
+    bool hasPendingCapture() const { return m_captureRequested || m_captureFrameIndex != 0; }
+    VkExtent2D getExtent() const { return VkExtent2D{m_config.width, m_config.height}; }
+    const std::string& getName() const { return m_config.name; }
+
+private:
+    void createTarget(OutputTarget& target, VkRenderPass renderPass);
+    void createReadbackBuffer();
+
+    const Context& m_context;
+    VkDevice m_device;
+    FrameGraph& m_frameGraph;
+    MemoryBudget& m_memoryBudget;
+    OutputConfig m_config;
+    std::vector<OutputTarget> m_targets;
+    uint32_t m_memoryTypeIndex = 0;
+    VkDeviceSize m_memorySize = 0;
+    uint64_t m_contentVersion = 0;
+    uint64_t m_skippedFrameCount = 0;
+    // Created on the first capture, stays mapped
+    VkBuffer m_readbackBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_readbackMemory = VK_NULL_HANDLE;
+    uint32_t m_readbackMemoryTypeIndex = 0;
+    VkDeviceSize m_readbackMemorySize = 0;
+    const uint8_t* m_readbackData = nullptr;
+    bool m_captureRequested = false;
+    // Frame that recorded the copy of the capture in flight, 0 when there is none
+    uint64_t m_captureFrameIndex = 0;
+};
@@ -0,0 +1,211 @@
+#include "PixelKernelsImpl.hpp"
+#include "Utils.hpp"
+#include <cstdio>
+#if PIXEL_KERNELS_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+const PixelKernelTable c_scalarPixelKernels{scalarFillTestPattern, scalarSwizzleRgbaBgra, scalarPremultiplyAlpha, scalarConvertRowPair};
+
+uint32_t testPatternPixel(size_t pixel)
+{
+    // Offset of the pixel in bytes, the pattern was originally written per byte
+    const size_t i = pixel * 4;
+    const uint32_t r = static_cast<uint32_t>(i % 200 + 20);
+    const uint32_t g = static_cast<uint32_t>(255 - i % 255);
+    const uint32_t b = static_cast<uint32_t>(128 + i % 127);
+    return r | g << 8 | b << 16 | 0xff000000u;
+}
+
+// Exact round(x / 255) for x <= 255 * 255
+uint32_t divideBy255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+uint8_t lumaFromRgb(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+uint8_t uFromRgb(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+uint8_t vFromRgb(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+#if PIXEL_KERNELS_X86
+bool isAvx2Supported()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    if (!osSavesYmm)
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+PixelIsa detectPixelIsa()
+{
+#if PIXEL_KERNELS_X86
+    return isAvx2Supported() ? PixelIsa::Avx2 : PixelIsa::Sse2;
+#elif PIXEL_KERNELS_NEON
+    return PixelIsa::Neon;
+#else
+    return PixelIsa::Scalar;
+#endif
+}
+
+const PixelKernelTable& getKernels()
+{
+    static const PixelKernelTable& table = *getPixelKernelTable(getPixelIsa());
+    return table;
+}
+} // namespace
+
+PixelIsa getPixelIsa()
+{
+    static const PixelIsa isa = detectPixelIsa();
+    return isa;
+}
+
+const char* getPixelIsaName(PixelIsa isa)
+{
+    switch (isa)
+    {
+    case PixelIsa::Scalar:
+        return "scalar";
+    case PixelIsa::Sse2:
+        return "SSE2";
+    case PixelIsa::Avx2:
+        return "AVX2";
+    case PixelIsa::Neon:
+        return "NEON";
+    }
+    return "unknown";
+}
+
+const PixelKernelTable* getPixelKernelTable(PixelIsa isa)
+{
+    switch (isa)
+    {
+    case PixelIsa::Scalar:
+        return &c_scalarPixelKernels;
+#if PIXEL_KERNELS_X86
+    case PixelIsa::Sse2:
+        return &c_sse2PixelKernels;
+    case PixelIsa::Avx2:
+        return isAvx2Supported() ? &c_avx2PixelKernels : nullptr;
+#elif PIXEL_KERNELS_NEON
+    case PixelIsa::Neon:
+        return &c_neonPixelKernels;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+void fillTestPattern(uint32_t* pixels, size_t count, size_t firstPixel)
+{
+    getKernels().fillTestPattern(pixels, count, firstPixel);
+}
+
+void swizzleRgbaBgra(const uint32_t* src, uint32_t* dst, size_t count)
+{
+    getKernels().swizzleRgbaBgra(src, dst, count);
+}
+
+void premultiplyAlpha(const uint32_t* src, uint32_t* dst, size_t count)
+{
+    getKernels().premultiplyAlpha(src, dst, count);
+}
+
+void convertRgbaToNv12(const uint8_t* src, uint32_t srcStride, uint32_t width, uint32_t height, uint8_t* dstY, uint32_t yStride, uint8_t* dstUv, uint32_t uvStride)
+{
+    convertRgbaToYuv420(getKernels(), src, srcStride, width, height, dstY, yStride, dstUv, dstUv + 1, uvStride, 2);
+}
+
+void convertRgbaToI420(const uint8_t* src, uint32_t srcStride, uint32_t width, uint32_t height, uint8_t* dstY, uint32_t yStride, uint8_t* dstU, uint8_t* dstV, uint32_t uvStride)
+{
+    convertRgbaToYuv420(getKernels(), src, srcStride, width, height, dstY, yStride, dstU, dstV, uvStride, 1);
+}
+
+void convertRgbaToYuv420(const PixelKernelTable& table, const uint8_t* src, uint32_t srcStride, uint32_t width, uint32_t height, uint8_t* dstY, uint32_t yStride, uint8_t* dstU,
+                         uint8_t* dstV, uint32_t uvStride, uint32_t uvStep)
+{
+    CHECK(width % 2 == 0 && height % 2 == 0);
+    for (uint32_t row = 0; row < height; row += 2)
+    {
+        const uint8_t* row0 = src + size_t(row) * srcStride;
+        uint8_t* y0 = dstY + size_t(row) * yStride;
+        const size_t uvOffset = size_t(row / 2) * uvStride;
+        table.convertRowPair(row0, row0 + srcStride, width, y0, y0 + yStride, dstU + uvOffset, dstV + uvOffset, uvStep);
+    }
+}
+
+void scalarFillTestPattern(uint32_t* pixels, size_t count, size_t firstPixel)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        pixels[i] = testPatternPixel(firstPixel + i);
+    }
+}
+
+void scalarSwizzleRgbaBgra(const uint32_t* src, uint32_t* dst, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint32_t p = src[i];
+        dst[i] = (p & 0xff00ff00u) | (p >> 16 & 0xffu) | (p & 0xffu) << 16;
+    }
+}
+
+void scalarPremultiplyAlpha(const uint32_t* src, uint32_t* dst, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint32_t p = src[i];
+        const uint32_t a = p >> 24;
+        const uint32_t r = divideBy255((p & 0xffu) * a);
+        const uint32_t g = divideBy255((p >> 8 & 0xffu) * a);
+        const uint32_t b = divideBy255((p >> 16 & 0xffu) * a);
+        dst[i] = r | g << 8 | b << 16 | a << 24;
+    }
+}
+
+void scalarConvertRowPair(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint32_t uvStep)
+{
+    for (uint32_t x = 0; x < width; x += 2)
+    {
+        const uint8_t* p00 = row0 + x * 4;
+        const uint8_t* p01 = p00 + 4;
+        const uint8_t* p10 = row1 + x * 4;
+        const uint8_t* p11 = p10 + 4;
+
+        y0[x] = lumaFromRgb(p00[0], p00[1], p00[2]);
+        y0[x + 1] = lumaFromRgb(p01[0], p01[1], p01[2]);
+        y1[x] = lumaFromRgb(p10[0], p10[1], p10[2]);
+        y1[x + 1] = lumaFromRgb(p11[0], p11[1], p11[2]);
+
+        const int r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+        const int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+        const int b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+        u[x / 2 * uvStep] = uFromRgb(r, g, b);
+        v[x / 2 * uvStep] = vFromRgb(r, g, b);
+    }
+}
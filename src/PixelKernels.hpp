@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CPU pixel kernels with SSE2, AVX2 and NEON versions, the fastest one the CPU supports is chosen on first use. Every
+// version writes exactly the same bytes as the scalar reference. Pixels are 8 bit RGBA packed into little endian uint32_t.
+enum class PixelIsa
+{
+    Scalar,
+    Sse2,
+    Avx2,
+    Neon
+};
+
+PixelIsa getPixelIsa();
+const char* getPixelIsaName(PixelIsa isa);
+
+// Gradient used as the initial content of the producer texture, firstPixel allows filling in parts
+void fillTestPattern(uint32_t* pixels, size_t count, size_t firstPixel = 0);
+// Swaps R and B, the same operation converts either way
+void swizzleRgbaBgra(const uint32_t* src, uint32_t* dst, size_t count);
+void premultiplyAlpha(const uint32_t* src, uint32_t* dst, size_t count);
+// BT.601 limited range with 2x2 box filtered chroma, width and height must be even
+void convertRgbaToNv12(const uint8_t* src, uint32_t srcStride, uint32_t width, uint32_t height, uint8_t* dstY, uint32_t yStride, uint8_t* dstUv, uint32_t uvStride);
+void convertRgbaToI420(const uint8_t* src, uint32_t srcStride, uint32_t width, uint32_t height, uint8_t* dstY, uint32_t yStride, uint8_t* dstU, uint8_t* dstV, uint32_t uvStride);
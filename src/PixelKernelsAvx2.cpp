@@ -0,0 +1,178 @@
+#include "PixelKernelsImpl.hpp"
+
+// Compiled with AVX2 code generation, only called after the CPU has been checked
+#if PIXEL_KERNELS_X86
+#include <immintrin.h>
+
+namespace
+{
+// 16 pixels with one channel per register in 16 bit lanes
+struct Planar
+{
+    __m256i r;
+    __m256i g;
+    __m256i b;
+};
+
+__m256i loadRemainders(size_t byteOffset, uint32_t modulus)
+{
+    int32_t lanes[8];
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        lanes[i] = static_cast<int32_t>((byteOffset + i * 4) % modulus);
+    }
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes));
+}
+
+// Advances the remainders by one vector of pixels, the step is smaller than the modulus so one subtraction wraps them
+__m256i advanceRemainders(__m256i remainders, int32_t modulus)
+{
+    const __m256i next = _mm256_add_epi32(remainders, _mm256_set1_epi32(32));
+    const __m256i wrapped = _mm256_cmpgt_epi32(next, _mm256_set1_epi32(modulus - 1));
+    return _mm256_sub_epi32(next, _mm256_and_si256(wrapped, _mm256_set1_epi32(modulus)));
+}
+
+__m256i premultiplyHalf(__m256i pixels)
+{
+    // The alpha lane is multiplied by 255 so the division gives back the original alpha
+    const __m256i alphaLanes = _mm256_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1);
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_blendv_epi8(alpha, _mm256_set1_epi16(255), alphaLanes);
+
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(pixels, alpha), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+// Packs work within 128 bit halves, this puts the 64 bit quarters back in order
+__m256i fixPackOrder(__m256i packed)
+{
+    return _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+Planar loadPlanar(const uint8_t* src)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+
+    Planar planar;
+    planar.r = fixPackOrder(_mm256_packs_epi32(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask)));
+    planar.g = fixPackOrder(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(a, 8), mask), _mm256_and_si256(_mm256_srli_epi32(b, 8), mask)));
+    planar.b = fixPackOrder(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(a, 16), mask), _mm256_and_si256(_mm256_srli_epi32(b, 16), mask)));
+    return planar;
+}
+
+// Returns the 16 luma bytes of the pixels
+__m128i luma(const Planar& p)
+{
+    // Wraps as signed but the sum fits in 16 bits unsigned
+    __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(p.r, _mm256_set1_epi16(66)), _mm256_mullo_epi16(p.g, _mm256_set1_epi16(129)));
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(p.b, _mm256_set1_epi16(25)));
+    y = _mm256_add_epi16(y, _mm256_set1_epi16(128));
+    y = _mm256_add_epi16(_mm256_srli_epi16(y, 8), _mm256_set1_epi16(16));
+    return _mm256_castsi256_si128(fixPackOrder(_mm256_packus_epi16(y, y)));
+}
+
+// Returns 8 chroma bytes in the low half
+__m128i chroma(__m128i r, __m128i g, __m128i b, int16_t cr, int16_t cg, int16_t cb)
+{
+    __m128i c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+    c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+    c = _mm_add_epi16(c, _mm_set1_epi16(128));
+    c = _mm_add_epi16(_mm_srai_epi16(c, 8), _mm_set1_epi16(128));
+    return _mm_packus_epi16(c, c);
+}
+
+// 2x2 average of 16 pixels of two rows, returns 8 values in 16 bit lanes
+__m128i average(__m256i top, __m256i bottom)
+{
+    const __m256i sum = _mm256_add_epi16(top, bottom);
+    const __m256i pairs = _mm256_add_epi32(_mm256_and_si256(sum, _mm256_set1_epi32(0xffff)), _mm256_srli_epi32(sum, 16));
+    const __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(pairs, _mm256_set1_epi32(2)), 2);
+    return _mm256_castsi256_si128(fixPackOrder(_mm256_packs_epi32(rounded, rounded)));
+}
+
+void fillTestPatternAvx2(uint32_t* pixels, size_t count, size_t firstPixel)
+{
+    const size_t vectorCount = count & ~size_t(7);
+    __m256i red = loadRemainders(firstPixel * 4, 200);
+    __m256i green = loadRemainders(firstPixel * 4, 255);
+    __m256i blue = loadRemainders(firstPixel * 4, 127);
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int32_t>(0xff000000u));
+    for (size_t i = 0; i < vectorCount; i += 8)
+    {
+        const __m256i r = _mm256_add_epi32(red, _mm256_set1_epi32(20));
+        const __m256i g = _mm256_sub_epi32(_mm256_set1_epi32(255), green);
+        const __m256i b = _mm256_add_epi32(blue, _mm256_set1_epi32(128));
+        const __m256i rgba = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(b, 16), alpha));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i), rgba);
+
+        red = advanceRemainders(red, 200);
+        green = advanceRemainders(green, 255);
+        blue = advanceRemainders(blue, 127);
+    }
+    scalarFillTestPattern(pixels + vectorCount, count - vectorCount, firstPixel + vectorCount);
+}
+
+void swizzleRgbaBgraAvx2(const uint32_t* src, uint32_t* dst, size_t count)
+{
+    const size_t vectorCount = count & ~size_t(7);
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    for (size_t i = 0; i < vectorCount; i += 8)
+    {
+        const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(p, shuffle));
+    }
+    scalarSwizzleRgbaBgra(src + vectorCount, dst + vectorCount, count - vectorCount);
+}
+
+void premultiplyAlphaAvx2(const uint32_t* src, uint32_t* dst, size_t count)
+{
+    const size_t vectorCount = count & ~size_t(7);
+    const __m256i zero = _mm256_setzero_si256();
+    for (size_t i = 0; i < vectorCount; i += 8)
+    {
+        // Unpack and pack both work within 128 bit halves so the pixel order is preserved
+        const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i lo = premultiplyHalf(_mm256_unpacklo_epi8(p, zero));
+        const __m256i hi = premultiplyHalf(_mm256_unpackhi_epi8(p, zero));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    scalarPremultiplyAlpha(src + vectorCount, dst + vectorCount, count - vectorCount);
+}
+
+void convertRowPairAvx2(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint32_t uvStep)
+{
+    const uint32_t vectorWidth = width & ~15u;
+    for (uint32_t x = 0; x < vectorWidth; x += 16)
+    {
+        const Planar top = loadPlanar(row0 + x * 4);
+        const Planar bottom = loadPlanar(row1 + x * 4);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), luma(top));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), luma(bottom));
+
+        const __m128i r = average(top.r, bottom.r);
+        const __m128i g = average(top.g, bottom.g);
+        const __m128i b = average(top.b, bottom.b);
+        const __m128i uBytes = chroma(r, g, b, -38, -74, 112);
+        const __m128i vBytes = chroma(r, g, b, 112, -94, -18);
+
+        const uint32_t uvOffset = x / 2 * uvStep;
+        if (uvStep == 2)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(u + uvOffset), _mm_unpacklo_epi8(uBytes, vBytes));
+        }
+        else
+        {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(u + uvOffset), uBytes);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(v + uvOffset), vBytes);
+        }
+    }
+
+    const uint32_t uvOffset = vectorWidth / 2 * uvStep;
+    scalarConvertRowPair(row0 + vectorWidth * 4, row1 + vectorWidth * 4, width - vectorWidth, y0 + vectorWidth, y1 + vectorWidth, u + uvOffset, v + uvOffset, uvStep);
+}
+} // namespace
+
+const PixelKernelTable c_avx2PixelKernels{fillTestPatternAvx2, swizzleRgbaBgraAvx2, premultiplyAlphaAvx2, convertRowPairAvx2};
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "PixelKernels.hpp"
+
+// Shared between the pixel kernel translation units. The SIMD files are compiled with their own instruction set flags,
+// so this header must not define inline functions that could be merged with the copies in other files.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_KERNELS_X86 1
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define PIXEL_KERNELS_NEON 1
+#endif
+
+struct PixelKernelTable
+{
+    void (*fillTestPattern)(uint32_t* pixels, size_t count, size_t firstPixel);
+    void (*swizzleRgbaBgra)(const uint32_t* src, uint32_t* dst, size_t count);
+    void (*premultiplyAlpha)(const uint32_t* src, uint32_t* dst, size_t count);
+    // Two source rows to two luma rows and one chroma row, chroma samples are uvStep bytes apart. With uvStep 2 the
+    // chroma is interleaved and v must be u + 1.
+    void (*convertRowPair)(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint32_t uvStep);
+};
+
+// nullptr when the version is not compiled in or the CPU can't run it
+const PixelKernelTable* getPixelKernelTable(PixelIsa isa);
+void convertRgbaToYuv420(const PixelKernelTable& table, const uint8_t* src, uint32_t srcStride, uint32_t width, uint32_t height, uint8_t* dstY, uint32_t yStride, uint8_t* dstU,
+                         uint8_t* dstV, uint32_t uvStride, uint32_t uvStep);
+
+// Scalar reference, the SIMD versions use these for the pixels that don't fill a whole vector
+void scalarFillTestPattern(uint32_t* pixels, size_t count, size_t firstPixel);
+void scalarSwizzleRgbaBgra(const uint32_t* src, uint32_t* dst, size_t count);
+void scalarPremultiplyAlpha(const uint32_t* src, uint32_t* dst, size_t count);
+void scalarConvertRowPair(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint32_t uvStep);
+
+#if PIXEL_KERNELS_X86
+extern const PixelKernelTable c_sse2PixelKernels;
+extern const PixelKernelTable c_avx2PixelKernels;
+#elif PIXEL_KERNELS_NEON
+extern const PixelKernelTable c_neonPixelKernels;
+#endif
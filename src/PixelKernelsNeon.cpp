@@ -0,0 +1,154 @@
+#include "PixelKernelsImpl.hpp"
+
+#if PIXEL_KERNELS_NEON
+#include <arm_neon.h>
+
+namespace
+{
+uint32x4_t loadRemainders(size_t byteOffset, uint32_t modulus)
+{
+    uint32_t lanes[4];
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        lanes[i] = static_cast<uint32_t>((byteOffset + i * 4) % modulus);
+    }
+    return vld1q_u32(lanes);
+}
+
+// Advances the remainders by one vector of pixels, the step is smaller than the modulus so one subtraction wraps them
+uint32x4_t advanceRemainders(uint32x4_t remainders, uint32_t modulus)
+{
+    const uint32x4_t next = vaddq_u32(remainders, vdupq_n_u32(16));
+    const uint32x4_t wrapped = vcgtq_u32(next, vdupq_n_u32(modulus - 1));
+    return vsubq_u32(next, vandq_u32(wrapped, vdupq_n_u32(modulus)));
+}
+
+// Rounded division by 255, same result as the scalar (x + 128 + ((x + 128) >> 8)) >> 8
+uint8x8_t divideBy255(uint16x8_t x)
+{
+    return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+uint8x16_t premultiplyChannel(uint8x16_t channel, uint8x16_t alpha)
+{
+    const uint8x8_t lo = divideBy255(vmull_u8(vget_low_u8(channel), vget_low_u8(alpha)));
+    const uint8x8_t hi = divideBy255(vmull_u8(vget_high_u8(channel), vget_high_u8(alpha)));
+    return vcombine_u8(lo, hi);
+}
+
+uint8x8_t lumaHalf(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+    uint16x8_t y = vmull_u8(r, vdup_n_u8(66));
+    y = vmlal_u8(y, g, vdup_n_u8(129));
+    y = vmlal_u8(y, b, vdup_n_u8(25));
+    return vrshrn_n_u16(y, 8);
+}
+
+uint8x16_t luma(const uint8x16x4_t& p)
+{
+    const uint8x8_t lo = lumaHalf(vget_low_u8(p.val[0]), vget_low_u8(p.val[1]), vget_low_u8(p.val[2]));
+    const uint8x8_t hi = lumaHalf(vget_high_u8(p.val[0]), vget_high_u8(p.val[1]), vget_high_u8(p.val[2]));
+    return vaddq_u8(vcombine_u8(lo, hi), vdupq_n_u8(16));
+}
+
+// 2x2 average of 16 pixels of two rows
+int16x8_t average(uint8x16_t top, uint8x16_t bottom)
+{
+    const uint16x8_t lo = vaddl_u8(vget_low_u8(top), vget_low_u8(bottom));
+    const uint16x8_t hi = vaddl_u8(vget_high_u8(top), vget_high_u8(bottom));
+    return vreinterpretq_s16_u16(vrshrq_n_u16(vpaddq_u16(lo, hi), 2));
+}
+
+uint8x8_t chroma(int16x8_t r, int16x8_t g, int16x8_t b, int16_t cr, int16_t cg, int16_t cb)
+{
+    int16x8_t c = vmulq_n_s16(r, cr);
+    c = vmlaq_n_s16(c, g, cg);
+    c = vmlaq_n_s16(c, b, cb);
+    c = vshrq_n_s16(vaddq_s16(c, vdupq_n_s16(128)), 8);
+    return vqmovun_s16(vaddq_s16(c, vdupq_n_s16(128)));
+}
+
+void fillTestPatternNeon(uint32_t* pixels, size_t count, size_t firstPixel)
+{
+    const size_t vectorCount = count & ~size_t(3);
+    uint32x4_t red = loadRemainders(firstPixel * 4, 200);
+    uint32x4_t green = loadRemainders(firstPixel * 4, 255);
+    uint32x4_t blue = loadRemainders(firstPixel * 4, 127);
+    for (size_t i = 0; i < vectorCount; i += 4)
+    {
+        const uint32x4_t r = vaddq_u32(red, vdupq_n_u32(20));
+        const uint32x4_t g = vsubq_u32(vdupq_n_u32(255), green);
+        const uint32x4_t b = vaddq_u32(blue, vdupq_n_u32(128));
+        const uint32x4_t rgba = vorrq_u32(vorrq_u32(r, vshlq_n_u32(g, 8)), vorrq_u32(vshlq_n_u32(b, 16), vdupq_n_u32(0xff000000u)));
+        vst1q_u32(pixels + i, rgba);
+
+        red = advanceRemainders(red, 200);
+        green = advanceRemainders(green, 255);
+        blue = advanceRemainders(blue, 127);
+    }
+    scalarFillTestPattern(pixels + vectorCount, count - vectorCount, firstPixel + vectorCount);
+}
+
+void swizzleRgbaBgraNeon(const uint32_t* src, uint32_t* dst, size_t count)
+{
+    const size_t vectorCount = count & ~size_t(15);
+    for (size_t i = 0; i < vectorCount; i += 16)
+    {
+        uint8x16x4_t p = vld4q_u8(reinterpret_cast<const uint8_t*>(src + i));
+        const uint8x16_t r = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = r;
+        vst4q_u8(reinterpret_cast<uint8_t*>(dst + i), p);
+    }
+    scalarSwizzleRgbaBgra(src + vectorCount, dst + vectorCount, count - vectorCount);
+}
+
+void premultiplyAlphaNeon(const uint32_t* src, uint32_t* dst, size_t count)
+{
+    const size_t vectorCount = count & ~size_t(15);
+    for (size_t i = 0; i < vectorCount; i += 16)
+    {
+        uint8x16x4_t p = vld4q_u8(reinterpret_cast<const uint8_t*>(src + i));
+        p.val[0] = premultiplyChannel(p.val[0], p.val[3]);
+        p.val[1] = premultiplyChannel(p.val[1], p.val[3]);
+        p.val[2] = premultiplyChannel(p.val[2], p.val[3]);
+        vst4q_u8(reinterpret_cast<uint8_t*>(dst + i), p);
+    }
+    scalarPremultiplyAlpha(src + vectorCount, dst + vectorCount, count - vectorCount);
+}
+
+void convertRowPairNeon(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint32_t uvStep)
+{
+    const uint32_t vectorWidth = width & ~15u;
+    for (uint32_t x = 0; x < vectorWidth; x += 16)
+    {
+        const uint8x16x4_t top = vld4q_u8(row0 + x * 4);
+        const uint8x16x4_t bottom = vld4q_u8(row1 + x * 4);
+        vst1q_u8(y0 + x, luma(top));
+        vst1q_u8(y1 + x, luma(bottom));
+
+        const int16x8_t r = average(top.val[0], bottom.val[0]);
+        const int16x8_t g = average(top.val[1], bottom.val[1]);
+        const int16x8_t b = average(top.val[2], bottom.val[2]);
+        const uint8x8_t uBytes = chroma(r, g, b, -38, -74, 112);
+        const uint8x8_t vBytes = chroma(r, g, b, 112, -94, -18);
+
+        const uint32_t uvOffset = x / 2 * uvStep;
+        if (uvStep == 2)
+        {
+            vst2_u8(u + uvOffset, uint8x8x2_t{{uBytes, vBytes}});
+        }
+        else
+        {
+            vst1_u8(u + uvOffset, uBytes);
+            vst1_u8(v + uvOffset, vBytes);
+        }
+    }
+
+    const uint32_t uvOffset = vectorWidth / 2 * uvStep;
+    scalarConvertRowPair(row0 + vectorWidth * 4, row1 + vectorWidth * 4, width - vectorWidth, y0 + vectorWidth, y1 + vectorWidth, u + uvOffset, v + uvOffset, uvStep);
+}
+} // namespace
+
+const PixelKernelTable c_neonPixelKernels{fillTestPatternNeon, swizzleRgbaBgraNeon, premultiplyAlphaNeon, convertRowPairNeon};
+#endif
@@ -0,0 +1,174 @@
+#include "PixelKernelsImpl.hpp"
+
+#if PIXEL_KERNELS_X86
+#include <emmintrin.h>
+#include <cstring>
+
+namespace
+{
+// 8 pixels with one channel per register in 16 bit lanes
+struct Planar
+{
+    __m128i r;
+    __m128i g;
+    __m128i b;
+};
+
+__m128i loadRemainders(size_t byteOffset, uint32_t modulus)
+{
+    int32_t lanes[4];
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        lanes[i] = static_cast<int32_t>((byteOffset + i * 4) % modulus);
+    }
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes));
+}
+
+// Advances the remainders by one vector of pixels, the step is smaller than the modulus so one subtraction wraps them
+__m128i advanceRemainders(__m128i remainders, int32_t modulus)
+{
+    const __m128i next = _mm_add_epi32(remainders, _mm_set1_epi32(16));
+    const __m128i wrapped = _mm_cmpgt_epi32(next, _mm_set1_epi32(modulus - 1));
+    return _mm_sub_epi32(next, _mm_and_si128(wrapped, _mm_set1_epi32(modulus)));
+}
+
+__m128i premultiplyHalf(__m128i pixels)
+{
+    // The alpha lane is multiplied by 255 so the division gives back the original alpha
+    const __m128i alphaLanes = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_or_si128(_mm_andnot_si128(alphaLanes, alpha), _mm_and_si128(alphaLanes, _mm_set1_epi16(255)));
+
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(pixels, alpha), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+Planar loadPlanar(const uint8_t* src)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+
+    Planar planar;
+    planar.r = _mm_packs_epi32(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+    planar.g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 8), mask), _mm_and_si128(_mm_srli_epi32(b, 8), mask));
+    planar.b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 16), mask), _mm_and_si128(_mm_srli_epi32(b, 16), mask));
+    return planar;
+}
+
+__m128i luma(const Planar& p)
+{
+    // Wraps as signed but the sum fits in 16 bits unsigned
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(p.r, _mm_set1_epi16(66)), _mm_mullo_epi16(p.g, _mm_set1_epi16(129)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(p.b, _mm_set1_epi16(25)));
+    y = _mm_add_epi16(y, _mm_set1_epi16(128));
+    return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+}
+
+__m128i chroma(__m128i r, __m128i g, __m128i b, int16_t cr, int16_t cg, int16_t cb)
+{
+    __m128i c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+    c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+    c = _mm_add_epi16(c, _mm_set1_epi16(128));
+    return _mm_add_epi16(_mm_srai_epi16(c, 8), _mm_set1_epi16(128));
+}
+
+// 2x2 average of 8 pixels of two rows, returns 4 values in the low 16 bit lanes
+__m128i average(__m128i top, __m128i bottom)
+{
+    const __m128i sum = _mm_add_epi16(top, bottom);
+    const __m128i pairs = _mm_add_epi32(_mm_and_si128(sum, _mm_set1_epi32(0xffff)), _mm_srli_epi32(sum, 16));
+    const __m128i rounded = _mm_srli_epi32(_mm_add_epi32(pairs, _mm_set1_epi32(2)), 2);
+    return _mm_packs_epi32(rounded, rounded);
+}
+
+void fillTestPatternSse2(uint32_t* pixels, size_t count, size_t firstPixel)
+{
+    const size_t vectorCount = count & ~size_t(3);
+    __m128i red = loadRemainders(firstPixel * 4, 200);
+    __m128i green = loadRemainders(firstPixel * 4, 255);
+    __m128i blue = loadRemainders(firstPixel * 4, 127);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int32_t>(0xff000000u));
+    for (size_t i = 0; i < vectorCount; i += 4)
+    {
+        const __m128i r = _mm_add_epi32(red, _mm_set1_epi32(20));
+        const __m128i g = _mm_sub_epi32(_mm_set1_epi32(255), green);
+        const __m128i b = _mm_add_epi32(blue, _mm_set1_epi32(128));
+        const __m128i rgba = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i), rgba);
+
+        red = advanceRemainders(red, 200);
+        green = advanceRemainders(green, 255);
+        blue = advanceRemainders(blue, 127);
+    }
+    scalarFillTestPattern(pixels + vectorCount, count - vectorCount, firstPixel + vectorCount);
+}
+
+void swizzleRgbaBgraSse2(const uint32_t* src, uint32_t* dst, size_t count)
+{
+    const size_t vectorCount = count & ~size_t(3);
+    const __m128i keep = _mm_set1_epi32(static_cast<int32_t>(0xff00ff00u));
+    const __m128i low = _mm_set1_epi32(0xff);
+    for (size_t i = 0; i < vectorCount; i += 4)
+    {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i swapped = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), low), _mm_slli_epi32(_mm_and_si128(p, low), 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(_mm_and_si128(p, keep), swapped));
+    }
+    scalarSwizzleRgbaBgra(src + vectorCount, dst + vectorCount, count - vectorCount);
+}
+
+void premultiplyAlphaSse2(const uint32_t* src, uint32_t* dst, size_t count)
+{
+    const size_t vectorCount = count & ~size_t(3);
+    const __m128i zero = _mm_setzero_si128();
+    for (size_t i = 0; i < vectorCount; i += 4)
+    {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i lo = premultiplyHalf(_mm_unpacklo_epi8(p, zero));
+        const __m128i hi = premultiplyHalf(_mm_unpackhi_epi8(p, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    scalarPremultiplyAlpha(src + vectorCount, dst + vectorCount, count - vectorCount);
+}
+
+void convertRowPairSse2(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, uint32_t uvStep)
+{
+    const uint32_t vectorWidth = width & ~7u;
+    for (uint32_t x = 0; x < vectorWidth; x += 8)
+    {
+        const Planar top = loadPlanar(row0 + x * 4);
+        const Planar bottom = loadPlanar(row1 + x * 4);
+
+        const __m128i yTop = luma(top);
+        const __m128i yBottom = luma(bottom);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(y0 + x), _mm_packus_epi16(yTop, yTop));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(y1 + x), _mm_packus_epi16(yBottom, yBottom));
+
+        const __m128i r = average(top.r, bottom.r);
+        const __m128i g = average(top.g, bottom.g);
+        const __m128i b = average(top.b, bottom.b);
+        const __m128i uBytes = _mm_packus_epi16(chroma(r, g, b, -38, -74, 112), _mm_setzero_si128());
+        const __m128i vBytes = _mm_packus_epi16(chroma(r, g, b, 112, -94, -18), _mm_setzero_si128());
+
+        const uint32_t uvOffset = x / 2 * uvStep;
+        if (uvStep == 2)
+        {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(u + uvOffset), _mm_unpacklo_epi8(uBytes, vBytes));
+        }
+        else
+        {
+            const int32_t uWord = _mm_cvtsi128_si32(uBytes);
+            const int32_t vWord = _mm_cvtsi128_si32(vBytes);
+            std::memcpy(u + uvOffset, &uWord, sizeof(uWord));
+            std::memcpy(v + uvOffset, &vWord, sizeof(vWord));
+        }
+    }
+
+    const uint32_t uvOffset = vectorWidth / 2 * uvStep;
+    scalarConvertRowPair(row0 + vectorWidth * 4, row1 + vectorWidth * 4, width - vectorWidth, y0 + vectorWidth, y1 + vectorWidth, u + uvOffset, v + uvOffset, uvStep);
+}
+} // namespace
+
+const PixelKernelTable c_sse2PixelKernels{fillTestPatternSse2, swizzleRgbaBgraSse2, premultiplyAlphaSse2, convertRowPairSse2};
+#endif
@@ -1,114 +1,437 @@
 #include "Renderer.hpp"
 #include "VulkanUtils.hpp"
 #include "Utils.hpp"
+#include "Trace.hpp"
+#include "StartupTimeline.hpp"
+#include <GLFW/glfw3.h>
 #include <vulkan/vulkan_win32.h>
 #include <array>
+#include <algorithm>
+#include <future>
 
 namespace
 {
 const size_t c_uniformBufferSize = sizeof(uint32_t);
 const VkImageSubresourceRange c_defaultSubresourceRance{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+// Copy the imported image into a consumer-owned mip chain every frame so that minified sampling stays cache friendly
+const bool c_generateMipmaps = true;
+const size_t c_importCacheCapacity = 8;
+// Use the host copy path even when the shared texture could be imported, for testing the fallback
+const bool c_forceHostTransfer = false;
+const DirtyRect c_fullTextureRect{0, 0, c_texWidth, c_texHeight};
+
+// The texture is stretched over the whole window, expand by one texel to cover linear filtering footprint
+DirtyRect textureToWindowRect(const DirtyRect& textureRect)
+{
+    const DirtyRect rect = clampRect(expandRect(textureRect, 1), c_texWidth, c_texHeight);
+    if (isEmpty(rect))
+    {
+        return rect;
+    }
+
+    DirtyRect windowRect;
+    windowRect.left = rect.left * c_windowWidth / c_texWidth;
+    windowRect.top = rect.top * c_windowHeight / c_texHeight;
+    windowRect.right = (rect.right * c_windowWidth + c_texWidth - 1) / c_texWidth;
+    windowRect.bottom = (rect.bottom * c_windowHeight + c_texHeight - 1) / c_texHeight;
+    return clampRect(windowRect, c_windowWidth, c_windowHeight);
+}
+
+VkRect2D toVkRect(const DirtyRect& rect)
+{
+    VkRect2D vkRect{};
+    vkRect.offset = {rect.left, rect.top};
+    vkRect.extent = {static_cast<uint32_t>(rect.right - rect.left), static_cast<uint32_t>(rect.bottom - rect.top)};
+    return vkRect;
+}
+
+// Layouts are handled by the frame graph, the attachment stays in the color attachment layout during the pass
+VkRenderPass createColorRenderPass(VkDevice device, VkAttachmentLoadOp loadOp, const VkAllocationCallbacks* allocator)
+{
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = nullptr;
+
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = c_surfaceFormat.format;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = loadOp;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    const std::array<VkAttachmentDescription, 1> attachments = {colorAttachment};
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = ui32Size(attachments);
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = 0;
+    renderPassInfo.pDependencies = nullptr;
+
+    VkRenderPass renderPass;
+    VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, allocator, &renderPass));
+    return renderPass;
+}
 } // namespace
 
-Renderer::Renderer(Context& context) :
+Renderer::Renderer(Context& context, FrameSource* source) :
     m_context(context),
     m_device(context.getDevice()),
+    m_source(source),
+    m_memoryBudget(context),
+    m_importCache(context.getDevice(), context.getPhysicalDevice(), m_frameGraph, m_memoryBudget, c_importCacheCapacity),
+    m_gpuTimer(context, ui32Size(context.getSwapchainImages())),
     m_lastRenderTime(std::chrono::high_resolution_clock::now())
 {
-    m_dx.init();
-    createRenderPass();
-    createSwapchainImageViews();
-    createFramebuffers();
-    createSampler();
-    createTextures();
-    createTexturesDescriptorSetLayouts();
-    createGraphicsPipeline();
-    createDescriptorPool();
-    createTextureDescriptorSet();
-    updateTexturesDescriptorSet();
-    allocateCommandBuffers();
+    m_pushDescriptors = context.isDeviceExtensionEnabled(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    if (m_pushDescriptors)
+    {
+        m_cmdPushDescriptorSet = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(vkGetDeviceProcAddr(m_device, "vkCmdPushDescriptorSetKHR"));
+        CHECK(m_cmdPushDescriptorSet);
+    }
+    printf("Texture descriptors: %s\n", m_pushDescriptors ? "push descriptors" : "one set per swapchain image");
+
+    try
+    {
+        createRenderPasses();
+        createTexturesDescriptorSetLayouts();
+        // Shader loading and pipeline compilation only need the render pass and layouts, the rest is set up meanwhile
+        std::future<void> pipeline = std::async(std::launch::async, [this]() {
+            StartupStep step("Graphics pipeline");
+            createGraphicsPipeline();
+        });
+
+        {
+            StartupStep step("Texture path");
+            selectTexturePath();
+        }
+        {
+            StartupStep step("Renderer resources");
+            createSwapchainImageViews();
+            createFramebuffers();
+            createSampler();
+            createMipImage();
+            trackSwapchainMemory();
+            createOutputs();
+            createDescriptorPool();
+            createTextureDescriptorSets();
+            allocateCommandBuffers();
+        }
+        pipeline.get();
+    }
+    catch (...)
+    {
+        // The pipeline future has been waited by now, so nothing else touches the members
+        destroy();
+        throw;
+    }
+    m_memoryBudget.printReport();
 }
 
 Renderer::~Renderer()
+{
+    destroy();
+}
+
+void Renderer::destroy()
 {
     vkDeviceWaitIdle(m_device);
 
-    vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
-    vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
-    vkDestroyDescriptorSetLayout(m_device, m_texturesDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_descriptorPool, m_context.getAllocator(AllocationSite::Descriptors));
+    m_outputs.clear();
+    m_blitPipelines.reset();
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_context.getAllocator(AllocationSite::Pipeline));
+    vkDestroyDescriptorSetLayout(m_device, m_texturesDescriptorSetLayout, m_context.getAllocator(AllocationSite::Descriptors));
 
-    vkDestroyImageView(m_device, m_imageView, nullptr);
-    vkDestroyImage(m_device, m_image, nullptr);
-    vkFreeMemory(m_device, m_imageMemory, nullptr);
+    if (m_mipmapsEnabled)
+    {
+        destroyMipImage();
+    }
 
-    vkDestroySampler(m_device, m_sampler, nullptr);
+    vkDestroySampler(m_device, m_sampler, m_context.getAllocator(AllocationSite::Descriptors));
 
     for (const VkFramebuffer& framebuffer : m_framebuffers)
     {
-        vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+        vkDestroyFramebuffer(m_device, framebuffer, m_context.getAllocator(AllocationSite::Images));
     }
 
     for (const VkImageView& imageView : m_swapchainImageViews)
     {
-        vkDestroyImageView(m_device, imageView, nullptr);
+        vkDestroyImageView(m_device, imageView, m_context.getAllocator(AllocationSite::Images));
     }
 
-    vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+    vkDestroyRenderPass(m_device, m_discardRenderPass, m_context.getAllocator(AllocationSite::Pipeline));
+    vkDestroyRenderPass(m_device, m_renderPass, m_context.getAllocator(AllocationSite::Pipeline));
 }
 
 bool Renderer::render()
 {
-    const uint32_t imageIndex = m_context.acquireNextSwapchainImage();
+    updateMemoryPressure();
+    if (!m_sourceConfigured)
+    {
+        configureSource();
+    }
 
-    if (!update(imageIndex))
+    if (!update())
     {
         return false;
     }
 
+    if (m_shaderWatcher && m_shaderWatcher->takeCompiledUpdate())
+    {
+        m_blitPipelines->reload();
+    }
+    if (m_blitPipelines->beginFrame(m_context.getDeletionQueue(), m_context.getFrameIndex()))
+    {
+        // Everything shown was drawn with the previous shaders
+        ++m_contentVersion;
+        std::fill(m_swapchainDamage.begin(), m_swapchainDamage.end(), c_fullTextureRect);
+    }
+    updateCaptures();
+
+    // Frames without changes are neither recorded nor presented, the swapchain images keep showing the same content
+    if (!hasFrameWork())
+    {
+        return true;
+    }
+
+    uint32_t imageIndex = 0;
+    if (!m_context.acquireNextSwapchainImage(imageIndex))
+    {
+        // Kept so that the region is still uploaded and drawn when the next frame gets an image
+        for (const DirtyRect& rect : m_source->getDirtyRects())
+        {
+            m_skippedDirtyRect = unite(m_skippedDirtyRect, rect);
+        }
+        return true;
+    }
+    if (m_swapchainGeneration != m_context.getSwapchainGeneration())
+    {
+        recreateSwapchainResources();
+    }
+    m_shownSharedHandle = m_source->getSharedHandle();
+    if (m_sharedFences)
+    {
+        m_sharedFences->addToBatch(m_context.getGraphicsBatch());
+    }
+
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
     beginInfo.pInheritanceInfo = nullptr;
 
+    TraceScope recordScope("Record commands");
     VkCommandBuffer cb = m_commandBuffers[imageIndex];
     vkResetCommandBuffer(cb, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
     vkBeginCommandBuffer(cb, &beginInfo);
+    m_gpuTimer.beginFrame(cb, imageIndex);
+    const uint32_t frameSpan = m_gpuTimer.beginSpan(cb, "GPU frame");
 
+    DirtyRect producerDirtyRect = m_skippedDirtyRect;
+    m_skippedDirtyRect = DirtyRect{};
+    for (const DirtyRect& rect : m_source->getDirtyRects())
     {
-        std::array<VkClearValue, 2> clearValues{};
-        clearValues[0].color = {0.0f, 0.0f, 0.2f, 1.0f};
-        clearValues[1].depthStencil = {1.0f, 0};
+        producerDirtyRect = unite(producerDirtyRect, rect);
+    }
 
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = m_renderPass;
-        renderPassInfo.framebuffer = m_framebuffers[imageIndex];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = c_windowExtent;
-        renderPassInfo.clearValueCount = ui32Size(clearValues);
-        renderPassInfo.pClearValues = clearValues.data();
+    const uint32_t queueFamilyIndex = m_context.getGraphicsQueueFamilyIndex();
+    const VkImage swapchainImage = m_swapchainImages[imageIndex];
 
-        vkCmdBeginRenderPass(cb, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+    m_importCache.collect(m_context.getCompletedFrameIndex());
+    const ImageUsage importedImageUsage = m_mipmapsEnabled ? ImageUsage::TransferRead : ImageUsage::SampledRead;
+    const ImportedImage& importedImage = m_hostTransfer ? m_hostTransfer->upload(cb, queueFamilyIndex, m_source->getSharedHandle(), imageIndex, producerDirtyRect, importedImageUsage)
+                                                        : m_importCache.acquire(m_source->getSharedHandle(), c_texWidth, c_texHeight, m_surfaceFormat->vkFormat, m_context.getFrameIndex());
+    if (importedImage.id != m_importedImageId)
+    {
+        // A different surface is shown, none of the previous content can be reused
+        m_importedImageId = importedImage.id;
+        m_mipChainValid = false;
+        ++m_contentVersion;
+        std::fill(m_swapchainDamage.begin(), m_swapchainDamage.end(), c_fullTextureRect);
+    }
 
-        const std::vector<VkDescriptorSet> descriptorSets{m_texturesDescriptorSet};
-        vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, ui32Size(descriptorSets), descriptorSets.data(), 0, nullptr);
-        vkCmdDraw(cb, 3, 1, 0, 0);
+    // Each swapchain image still shows the content from when it was last rendered, so it needs every change since then
+    for (DirtyRect& damage : m_swapchainDamage)
+    {
+        damage = unite(damage, producerDirtyRect);
+    }
+    if (!isEmpty(producerDirtyRect))
+    {
+        ++m_contentVersion;
+    }
+    // The host copy image is empty until its first read back succeeds, nothing is drawn from it and the damage is kept
+    const bool textureHasContent = m_frameGraph.hasContent(importedImage.image);
+    const DirtyRect windowDamage = textureHasContent ? textureToWindowRect(m_swapchainDamage[imageIndex]) : DirtyRect{};
+    if (textureHasContent)
+    {
+        m_swapchainDamage[imageIndex] = DirtyRect{};
+    }
 
-        vkCmdEndRenderPass(cb);
+    if (m_mipmapsEnabled && textureHasContent)
+    {
+        const DirtyRect mipDirtyRect = m_mipChainValid ? producerDirtyRect : c_fullTextureRect;
+        if (!isEmpty(mipDirtyRect))
+        {
+            const uint32_t mipSpan = m_gpuTimer.beginSpan(cb, "GPU mip chain");
+            recordMipChainGeneration(cb, importedImage.image, mipDirtyRect);
+            m_gpuTimer.endSpan(cb, mipSpan);
+            m_mipChainValid = true;
+        }
     }
 
+    const VkImage textureImage = m_mipmapsEnabled ? m_mipImage : importedImage.image;
+    const VkImageView textureView = m_mipmapsEnabled ? m_mipImageView : importedImage.view;
+    const uint64_t textureId = m_mipmapsEnabled ? m_mipImageId : importedImage.id;
+    if (!isEmpty(windowDamage))
+    {
+        // Decided before the pass marks the image as written
+        const VkAttachmentLoadOp loadOp = m_frameGraph.getLoadOp(swapchainImage);
+
+        const std::array<ImageAccess, 2> accesses = {
+            ImageAccess{textureImage, ImageUsage::SampledRead},
+            ImageAccess{swapchainImage, ImageUsage::ColorAttachmentWrite},
+        };
+        m_frameGraph.beginPass(cb, queueFamilyIndex, accesses);
+
+        const uint32_t drawSpan = m_gpuTimer.beginSpan(cb, "GPU draw");
+        const VkRenderPass renderPass = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? m_renderPass : m_discardRenderPass;
+        recordBlit(cb, renderPass, m_framebuffers[imageIndex], c_windowExtent, toVkRect(windowDamage), imageIndex, textureView, textureId);
+        m_gpuTimer.endSpan(cb, drawSpan);
+    }
+
+    if (!m_outputs.empty() && textureHasContent)
+    {
+        const uint32_t outputSpan = m_gpuTimer.beginSpan(cb, "GPU offscreen outputs");
+        recordOutputs(cb, imageIndex, textureImage, textureView, textureId);
+        m_gpuTimer.endSpan(cb, outputSpan);
+    }
+
+    const ImageAccess presentAccess{swapchainImage, ImageUsage::Present};
+    m_frameGraph.beginPass(cb, queueFamilyIndex, Span<const ImageAccess>(presentAccess));
+
+    m_gpuTimer.endSpan(cb, frameSpan);
     VK_CHECK(vkEndCommandBuffer(cb));
+    recordScope.end();
 
-    m_context.submitCommandBuffers({cb});
+    m_context.submitCommandBuffers(Span<const VkCommandBuffer>(cb));
 
     return true;
 }
 
-bool Renderer::update(uint32_t imageIndex)
+void Renderer::recordBlit(VkCommandBuffer cb, VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent, const VkRect2D& renderArea, uint32_t imageIndex, VkImageView textureView, uint64_t textureId)
 {
-    m_dx.update();
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = renderPass;
+    renderPassInfo.framebuffer = framebuffer;
+    renderPassInfo.renderArea = renderArea;
+    renderPassInfo.clearValueCount = 0;
+    renderPassInfo.pClearValues = nullptr;
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    vkCmdBeginRenderPass(cb, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    const uint32_t blitVariantKey = m_blitVariant.getKey();
+    vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_blitPipelines->get(m_blitVariant));
+    vkCmdPushConstants(cb, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(blitVariantKey), &blitVariantKey);
+    vkCmdSetViewport(cb, 0, 1, &viewport);
+    vkCmdSetScissor(cb, 0, 1, &renderArea);
+
+    bindTexture(cb, imageIndex, textureView, textureId);
+    vkCmdDraw(cb, 3, 1, 0, 0);
+
+    vkCmdEndRenderPass(cb);
+}
+
+void Renderer::recordOutputs(VkCommandBuffer cb, uint32_t imageIndex, VkImage textureImage, VkImageView textureView, uint64_t textureId)
+{
+    const uint32_t queueFamilyIndex = m_context.getGraphicsQueueFamilyIndex();
+    // Copied before the outputs are drawn, so a capture reads the image as the GPU finished it
+    for (const std::unique_ptr<OffscreenOutput>& output : m_outputs)
+    {
+        output->recordCapture(cb, queueFamilyIndex, m_context.getFrameIndex(), m_context.getCompletedFrameIndex());
+    }
+
+    for (const std::unique_ptr<OffscreenOutput>& output : m_outputs)
+    {
+        const OutputTarget* target = output->beginFrame(m_context.getFrameIndex(), m_context.getCompletedFrameIndex(), m_contentVersion);
+        if (target == nullptr)
+        {
+            continue;
+        }
+
+        // The whole output is drawn, so the previous content is discarded
+        const std::array<ImageAccess, 2> accesses = {
+            ImageAccess{textureImage, ImageUsage::SampledRead},
+            ImageAccess{target->image, ImageUsage::ColorAttachmentWrite},
+        };
+        m_frameGraph.beginPass(cb, queueFamilyIndex, accesses);
+
+        const VkExtent2D extent = output->getExtent();
+        recordBlit(cb, m_discardRenderPass, target->framebuffer, extent, VkRect2D{{0, 0}, extent}, imageIndex, textureView, textureId);
+    }
+}
+
+void Renderer::updateCaptures()
+{
+    for (const Context::KeyEvent& event : m_context.getKeyEvents())
+    {
+        if (event.key != GLFW_KEY_F12 || event.action != GLFW_RELEASE)
+        {
+            continue;
+        }
+        if (m_outputs.empty())
+        {
+            printf("Nothing to capture, DXVK_INTEROP_OUTPUTS has no outputs\n");
+        }
+        for (const std::unique_ptr<OffscreenOutput>& output : m_outputs)
+        {
+            output->requestCapture();
+        }
+    }
+
+    for (const std::unique_ptr<OffscreenOutput>& output : m_outputs)
+    {
+        output->finishCapture(m_context.getCompletedFrameIndex());
+    }
+}
+
+void Renderer::createOutputs()
+{
+    const uint32_t ringLength = ui32Size(m_context.getSwapchainImages());
+    for (const OutputConfig& config : getOutputConfigsFromEnvironment())
+    {
+        m_outputs.push_back(std::make_unique<OffscreenOutput>(m_context, m_frameGraph, m_memoryBudget, m_discardRenderPass, config, ringLength));
+    }
+}
+
+bool Renderer::update()
+{
+    m_source->update();
+    if (!m_source->isConnected())
+    {
+        // The producer's surface is no longer updated and its handle may be reused, so nothing valid is left to show
+        printf("Frame source disconnected, stopping\n");
+        return false;
+    }
+
     bool running = m_context.update();
     if (!running)
     {
@@ -118,60 +441,150 @@ bool Renderer::update(uint32_t imageIndex)
     return true;
 }
 
-void Renderer::createRenderPass()
+bool Renderer::hasFrameWork() const
 {
-    VkAttachmentReference colorAttachmentRef{};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    if (!m_source->getDirtyRects().empty() || !isEmpty(m_skippedDirtyRect) || m_source->getSharedHandle() != m_shownSharedHandle)
+    {
+        return true;
+    }
+    if (m_context.isSwapchainOutOfDate())
+    {
+        return true;
+    }
+    for (const DirtyRect& damage : m_swapchainDamage)
+    {
+        if (!isEmpty(damage))
+        {
+            return true;
+        }
+    }
+    for (const std::unique_ptr<OffscreenOutput>& output : m_outputs)
+    {
+        // A capture needs frames until its copy has completed
+        if (!output->isUpToDate(m_contentVersion) || output->hasPendingCapture())
+        {
+            return true;
+        }
+    }
 
-    VkSubpassDescription subpass{};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
-    subpass.pDepthStencilAttachment = nullptr;
+    const bool mipChainPending = m_mipmapsEnabled && !m_mipChainValid;
+    const bool uploadPending = m_hostTransfer && m_hostTransfer->hasPendingUpload();
+    const bool releasePending = m_sharedFences && m_sharedFences->hasPendingRelease();
+    // Setup commands and transfer handoffs go out with the next frame
+    return mipChainPending || uploadPending || releasePending || !m_context.getGraphicsBatch().isEmpty() || !m_context.getTransferBatch().isEmpty();
+}
 
-    VkAttachmentDescription colorAttachment{};
-    colorAttachment.format = c_surfaceFormat.format;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+void Renderer::selectTexturePath()
+{
+    const VkPhysicalDevice physicalDevice = m_context.getPhysicalDevice();
+    if (m_context.isDeviceExtensionEnabled(VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME))
+    {
+        for (const SurfaceFormat& format : c_surfaceFormats)
+        {
+            if (ImportCache::isImportSupported(physicalDevice, format.vkFormat))
+            {
+                m_acceptedFormats.push_back(format.dxgiFormat);
+            }
+        }
+        std::stable_partition(m_acceptedFormats.begin(), m_acceptedFormats.end(),
+                              [physicalDevice](DXGI_FORMAT format) { return hasLinearBlitSupport(physicalDevice, findSurfaceFormat(format)->vkFormat); });
+    }
 
-    VkSubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    const bool importSupported = !m_acceptedFormats.empty();
+    if (importSupported && !c_forceHostTransfer)
+    {
+        printf("Texture path: zero-copy import\n");
+        return;
+    }
 
-    const std::array<VkAttachmentDescription, 1> attachments = {colorAttachment};
+    // The host copy path only handles the default format
+    m_acceptedFormats.assign(1, c_surfaceFormats[0].dxgiFormat);
 
-    VkRenderPassCreateInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = ui32Size(attachments);
-    renderPassInfo.pAttachments = attachments.data();
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    const uint32_t slotCount = ui32Size(m_context.getSwapchainImages());
+    m_hostTransfer = std::make_unique<HostTransfer>(m_device, physicalDevice, m_frameGraph, m_memoryBudget, m_context.getPreferredAdapter(), slotCount);
+    if (m_context.hasTransferQueue())
+    {
+        m_hostTransfer->useTransferQueue(m_context);
+    }
+    printf("Texture path: %s%s%s\n", m_hostTransfer->getPathName(), importSupported ? ", forced" : ", D3D11 texture import not supported",
+           m_context.hasTransferQueue() ? ", copies on the transfer queue" : "");
+}
 
-    VK_CHECK(vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_renderPass));
+void Renderer::configureSource()
+{
+    m_sourceConfigured = true;
+    negotiateSurfaceFormat();
+    selectSyncPath();
+}
+
+void Renderer::negotiateSurfaceFormat()
+{
+    if (m_source->getFormat() != m_acceptedFormats.front())
+    {
+        m_source->requestFormat(m_acceptedFormats);
+    }
+
+    const SurfaceFormat* format = findSurfaceFormat(m_source->getFormat());
+    if (format == nullptr || std::find(m_acceptedFormats.begin(), m_acceptedFormats.end(), format->dxgiFormat) == m_acceptedFormats.end())
+    {
+        LOGE("The producer has no texture format the renderer can use");
+    }
+    printf("Surface format: %s\n", format->name);
+
+    if (format != m_surfaceFormat)
+    {
+        m_surfaceFormat = format;
+        if (m_mipmapsEnabled)
+        {
+            destroyMipImage();
+        }
+        createMipImage();
+    }
+}
+
+void Renderer::selectSyncPath()
+{
+    // The host copy path reads the texture on its own D3D11 device under the keyed mutex
+    if (m_hostTransfer || m_source->getReadyFenceHandle() == nullptr)
+    {
+        return;
+    }
+
+    const VkExternalSemaphoreFeatureFlags features = VK_EXTERNAL_SEMAPHORE_FEATURE_IMPORTABLE_BIT | VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT;
+    if (!m_context.isDeviceExtensionEnabled(VK_KHR_EXTERNAL_SEMAPHORE_WIN32_EXTENSION_NAME)
+        || !isExternalTimelineSemaphoreSupported(m_context.getPhysicalDevice(), SharedFences::c_handleType, features))
+    {
+        LOGW("Shared D3D11 fences can't be imported, the renderer is not synchronized with the producer");
+        return;
+    }
+
+    m_sharedFences = std::make_unique<SharedFences>(m_context, *m_source);
+    printf("Producer sync: shared fences\n");
+}
+
+void Renderer::createRenderPasses()
+{
+    // Only the damaged area is redrawn so the previous content is loaded, the frame graph picks the discarding pass
+    // while a swapchain image has no content yet
+    m_renderPass = createColorRenderPass(m_device, VK_ATTACHMENT_LOAD_OP_LOAD, m_context.getAllocator(AllocationSite::Pipeline));
+    m_discardRenderPass = createColorRenderPass(m_device, VK_ATTACHMENT_LOAD_OP_DONT_CARE, m_context.getAllocator(AllocationSite::Pipeline));
 }
 
 void Renderer::createSwapchainImageViews()
 {
-    const std::vector<VkImage>& swapchainImages = m_context.getSwapchainImages();
+    m_swapchainImages = m_context.getSwapchainImages();
+    m_swapchainGeneration = m_context.getSwapchainGeneration();
 
-    m_swapchainImageViews.resize(swapchainImages.size());
-    for (size_t i = 0; i < swapchainImages.size(); ++i)
+    m_swapchainImageViews.resize(m_swapchainImages.size());
+    m_swapchainDamage.assign(m_swapchainImages.size(), c_fullTextureRect);
+    for (size_t i = 0; i < m_swapchainImages.size(); ++i)
     {
+        // First use is chained to the acquire semaphore wait
+        m_frameGraph.registerImage(m_swapchainImages[i], 1, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
+
         VkImageViewCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        createInfo.image = swapchainImages[i];
+        createInfo.image = m_swapchainImages[i];
         createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
         createInfo.format = c_surfaceFormat.format;
         createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -180,7 +593,7 @@ void Renderer::createSwapchainImageViews()
         createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
         createInfo.subresourceRange = c_defaultSubresourceRance;
 
-        VK_CHECK(vkCreateImageView(m_device, &createInfo, nullptr, &m_swapchainImageViews[i]));
+        VK_CHECK(vkCreateImageView(m_device, &createInfo, m_context.getAllocator(AllocationSite::Images), &m_swapchainImageViews[i]));
     }
 }
 
@@ -201,19 +614,38 @@ void Renderer::createFramebuffers()
         framebufferInfo.attachmentCount = ui32Size(attachments);
         framebufferInfo.pAttachments = attachments.data();
 
-        VK_CHECK(vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &m_framebuffers[i]));
+        VK_CHECK(vkCreateFramebuffer(m_device, &framebufferInfo, m_context.getAllocator(AllocationSite::Images), &m_framebuffers[i]));
     }
 }
 
+void Renderer::recreateSwapchainResources()
+{
+    // Frames in flight may still render to the old framebuffers
+    DeletionQueue& deletionQueue = m_context.getDeletionQueue();
+    const uint64_t frameIndex = m_context.getFrameIndex();
+    for (size_t i = 0; i < m_swapchainImages.size(); ++i)
+    {
+        m_frameGraph.unregisterImage(m_swapchainImages[i]);
+        deletionQueue.retire(m_framebuffers[i], m_context.getAllocator(AllocationSite::Images), frameIndex);
+        deletionQueue.retire(m_swapchainImageViews[i], m_context.getAllocator(AllocationSite::Images), frameIndex);
+    }
+
+    // The new images have no content, so the damage starts out as the whole window
+    createSwapchainImageViews();
+    createFramebuffers();
+    ++m_contentVersion;
+}
+
 void Renderer::createSampler()
 {
     VkSamplerCreateInfo samplerInfo{};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
     samplerInfo.magFilter = VK_FILTER_LINEAR;
     samplerInfo.minFilter = VK_FILTER_LINEAR;
-    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    // Clamped so that filtering at an edge never reads the opposite edge, the damage expansion only covers neighbours
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
     samplerInfo.anisotropyEnable = VK_FALSE;
     samplerInfo.maxAnisotropy = 16;
     samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
@@ -225,87 +657,133 @@ void Renderer::createSampler()
     samplerInfo.minLod = 0.0f;
     samplerInfo.maxLod = 512.0f;
 
-    VK_CHECK(vkCreateSampler(m_device, &samplerInfo, nullptr, &m_sampler));
+    VK_CHECK(vkCreateSampler(m_device, &samplerInfo, m_context.getAllocator(AllocationSite::Descriptors), &m_sampler));
 }
 
-void Renderer::createTextures()
+void Renderer::createMipImage()
 {
-    const VkExternalFenceHandleTypeFlags handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_D3D11_TEXTURE_BIT;
-    { // Create Image
-        VkExternalMemoryImageCreateInfo externalMemoryCreateInfo{};
-        externalMemoryCreateInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
-        externalMemoryCreateInfo.handleTypes = handleType;
+    m_mipmapsEnabled = c_generateMipmaps && hasLinearBlitSupport(m_context.getPhysicalDevice(), m_surfaceFormat->vkFormat);
+    if (c_generateMipmaps && !m_mipmapsEnabled)
+    {
+        LOGW("Linear blits are not supported for the texture format, mip chain generation disabled");
+    }
+    if (!m_mipmapsEnabled)
+    {
+        return;
+    }
 
+    m_mipLevels = getMipLevelCount(c_texWidth, c_texHeight);
+
+    { // Create image
         VkImageCreateInfo imageCreateInfo{};
         imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageCreateInfo.pNext = &externalMemoryCreateInfo;
         imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.format = m_surfaceFormat->vkFormat;
+        imageCreateInfo.mipLevels = m_mipLevels;
         imageCreateInfo.arrayLayers = 1;
         imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         imageCreateInfo.extent.depth = 1;
         imageCreateInfo.extent.width = c_texWidth;
         imageCreateInfo.extent.height = c_texHeight;
-        imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-        VK_CHECK(vkCreateImage(m_device, &imageCreateInfo, nullptr, &m_image));
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VK_CHECK(vkCreateImage(m_device, &imageCreateInfo, m_context.getAllocator(AllocationSite::Images), &m_mipImage));
     }
 
     { // Allocate and bind memory
         VkMemoryRequirements memRequirements{};
-        vkGetImageMemoryRequirements(m_device, m_image, &memRequirements);
+        vkGetImageMemoryRequirements(m_device, m_mipImage, &memRequirements);
 
         const MemoryTypeResult memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
         CHECK(memoryTypeResult.found);
 
-        VkImportMemoryWin32HandleInfoKHR importInfo{};
-        importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_WIN32_HANDLE_INFO_KHR;
-        importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_D3D11_TEXTURE_BIT;
-        importInfo.handle = m_dx.getSharedHandle();
-
         VkMemoryAllocateInfo memAllocInfo{};
         memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memAllocInfo.pNext = &importInfo;
         memAllocInfo.allocationSize = memRequirements.size;
         memAllocInfo.memoryTypeIndex = memoryTypeResult.typeIndex;
-        m_imageSize = memRequirements.size;
+        m_mipImageMemoryTypeIndex = memoryTypeResult.typeIndex;
+        m_mipImageMemorySize = memRequirements.size;
 
-        VK_CHECK(vkAllocateMemory(m_device, &memAllocInfo, nullptr, &m_imageMemory));
-        VK_CHECK(vkBindImageMemory(m_device, m_image, m_imageMemory, 0));
+        VK_CHECK(vkAllocateMemory(m_device, &memAllocInfo, m_context.getAllocator(AllocationSite::Images), &m_mipImageMemory));
+        VK_CHECK(vkBindImageMemory(m_device, m_mipImage, m_mipImageMemory, 0));
+        m_memoryBudget.track(MemoryCategory::MipChain, m_mipImageMemoryTypeIndex, m_mipImageMemorySize);
     }
 
     { // Create image view
         VkImageViewCreateInfo viewCreateInfo{};
         viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewCreateInfo.image = m_image;
-        viewCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-        viewCreateInfo.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-        vkCreateImageView(m_device, &viewCreateInfo, nullptr, &m_imageView);
+        viewCreateInfo.image = m_mipImage;
+        viewCreateInfo.format = m_surfaceFormat->vkFormat;
+        viewCreateInfo.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, m_mipLevels, 0, 1};
+        VK_CHECK(vkCreateImageView(m_device, &viewCreateInfo, m_context.getAllocator(AllocationSite::Images), &m_mipImageView));
     }
 
-    { // Image layout transform
-        VkImageMemoryBarrier barrier{};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = m_image;
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        barrier.newLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.levelCount = 1;
-        barrier.subresourceRange.layerCount = 1;
+    m_frameGraph.registerImage(m_mipImage, m_mipLevels);
+    m_mipImageId = createImageId();
+}
 
-        const VkPipelineStageFlags sourceStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        const VkPipelineStageFlags destinationStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+void Renderer::destroyMipImage()
+{
+    // Frames in flight may still sample the mip image
+    DeletionQueue& deletionQueue = m_context.getDeletionQueue();
+    const uint64_t frameIndex = m_context.getFrameIndex();
+    m_frameGraph.unregisterImage(m_mipImage);
+    deletionQueue.retire(m_mipImageView, m_context.getAllocator(AllocationSite::Images), frameIndex);
+    deletionQueue.retire(m_mipImage, m_context.getAllocator(AllocationSite::Images), frameIndex);
+    deletionQueue.retire(m_mipImageMemory, m_context.getAllocator(AllocationSite::Images), frameIndex);
+    m_memoryBudget.untrack(MemoryCategory::MipChain, m_mipImageMemoryTypeIndex, m_mipImageMemorySize);
+
+    m_mipImage = VK_NULL_HANDLE;
+    m_mipImageView = VK_NULL_HANDLE;
+    m_mipImageMemory = VK_NULL_HANDLE;
+    m_mipImageId = 0;
+    m_mipmapsEnabled = false;
+    m_mipChainValid = false;
+}
 
-        const SingleTimeCommand command = beginSingleTimeCommands(m_context.getGraphicsCommandPool(), m_device);
+void Renderer::trackSwapchainMemory()
+{
+    // Swapchain images are allocated by the driver, estimate them as uncompressed device local images
+    const MemoryTypeResult memoryTypeResult = findMemoryType(m_context.getPhysicalDevice(), ~0u, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (memoryTypeResult.found)
+    {
+        const VkDeviceSize imageSize = VkDeviceSize(c_windowWidth) * c_windowHeight * 4;
+        m_memoryBudget.track(MemoryCategory::Swapchain, memoryTypeResult.typeIndex, imageSize * m_context.getSwapchainImages().size());
+    }
+}
 
-        vkCmdPipelineBarrier(command.commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+void Renderer::updateMemoryPressure()
+{
+    const MemoryPressure pressure = m_memoryBudget.update(m_context.getFrameIndex());
+    if (pressure == m_memoryPressure)
+    {
+        return;
+    }
+    m_memoryPressure = pressure;
+    m_memoryBudget.printReport();
 
-        endSingleTimeCommands(m_context.getGraphicsQueue(), command);
+    if (pressure != MemoryPressure::Normal)
+    {
+        // Keep only the surface currently shown, the rest are imported again when they come back
+        m_importCache.shrink(1);
+    }
+
+    const bool shedMipImage = pressure == MemoryPressure::Critical && m_mipmapsEnabled;
+    const bool restoreMipImage = pressure == MemoryPressure::Normal && m_mipImageShed;
+    if (shedMipImage || restoreMipImage)
+    {
+        if (shedMipImage)
+        {
+            LOGW("Device memory is critically low, mip chain generation disabled");
+            destroyMipImage();
+        }
+        else
+        {
+            createMipImage();
+        }
+        m_mipImageShed = shedMipImage;
     }
 }
 
@@ -325,152 +803,48 @@ void Renderer::createTexturesDescriptorSetLayouts()
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.flags = m_pushDescriptors ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0;
     layoutInfo.bindingCount = ui32Size(bindings);
     layoutInfo.pBindings = bindings.data();
 
-    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_texturesDescriptorSetLayout));
+    VK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, m_context.getAllocator(AllocationSite::Descriptors), &m_texturesDescriptorSetLayout));
 }
 
 void Renderer::createGraphicsPipeline()
 {
     const std::array<VkDescriptorSetLayout, 1> descriptorSetLayouts{m_texturesDescriptorSetLayout};
+
+    // Blit variant key for the generic shader
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(uint32_t);
+
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = ui32Size(descriptorSetLayouts);
     pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
-    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
-
-    VkPipelineVertexInputStateCreateInfo vertexInputState{};
-    vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputState.vertexBindingDescriptionCount = 0;
-    vertexInputState.pVertexBindingDescriptions = nullptr;
-    vertexInputState.vertexAttributeDescriptionCount = 0;
-    vertexInputState.pVertexAttributeDescriptions = nullptr;
+    VK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_context.getAllocator(AllocationSite::Pipeline), &m_pipelineLayout));
 
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState{};
-    inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssemblyState.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(c_windowExtent.width);
-    viewport.height = static_cast<float>(c_windowExtent.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = c_windowExtent;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
-    viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizationState{};
-    rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizationState.depthClampEnable = VK_FALSE;
-    rasterizationState.rasterizerDiscardEnable = VK_FALSE;
-    rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizationState.lineWidth = 1.0f;
-    rasterizationState.cullMode = VK_CULL_MODE_FRONT_BIT;
-    rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizationState.depthBiasEnable = VK_FALSE;
-    rasterizationState.depthBiasConstantFactor = 0.0f;
-    rasterizationState.depthBiasClamp = 0.0f;
-    rasterizationState.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampleState{};
-    multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampleState.sampleShadingEnable = VK_FALSE;
-    multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampleState.minSampleShading = 1.0f;
-    multisampleState.pSampleMask = nullptr;
-    multisampleState.alphaToCoverageEnable = VK_FALSE;
-    multisampleState.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineDepthStencilStateCreateInfo depthStencilState{};
-    depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencilState.depthTestEnable = VK_TRUE;
-    depthStencilState.depthWriteEnable = VK_TRUE;
-    depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthStencilState.depthBoundsTestEnable = VK_FALSE;
-    depthStencilState.stencilTestEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachmentState{};
-    colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachmentState.blendEnable = VK_FALSE;
-    colorBlendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
-
-    VkPipelineColorBlendStateCreateInfo colorBlendState{};
-    colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlendState.logicOpEnable = VK_FALSE;
-    colorBlendState.logicOp = VK_LOGIC_OP_COPY;
-    colorBlendState.attachmentCount = 1;
-    colorBlendState.pAttachments = &colorBlendAttachmentState;
-    colorBlendState.blendConstants[0] = 0.0f;
-    colorBlendState.blendConstants[1] = 0.0f;
-    colorBlendState.blendConstants[2] = 0.0f;
-    colorBlendState.blendConstants[3] = 0.0f;
-
-    VkShaderModule vertexShaderModule = createShaderModule(m_device, "shaders/shader.vert.spv");
-    VkShaderModule fragmentShaderModule = createShaderModule(m_device, "shaders/shader.frag.spv");
-
-    VkPipelineShaderStageCreateInfo vertexShaderStageInfo{};
-    vertexShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertexShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertexShaderStageInfo.module = vertexShaderModule;
-    vertexShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragmentShaderStageInfo{};
-    fragmentShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragmentShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragmentShaderStageInfo.module = fragmentShaderModule;
-    fragmentShaderStageInfo.pName = "main";
-
-    std::vector<VkPipelineShaderStageCreateInfo> shaderStages{vertexShaderStageInfo, fragmentShaderStageInfo};
-
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = ui32Size(shaderStages);
-    pipelineInfo.pStages = shaderStages.data();
-    pipelineInfo.pVertexInputState = &vertexInputState;
-    pipelineInfo.pInputAssemblyState = &inputAssemblyState;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizationState;
-    pipelineInfo.pMultisampleState = &multisampleState;
-    pipelineInfo.pDepthStencilState = &depthStencilState;
-    pipelineInfo.pColorBlendState = &colorBlendState;
-    pipelineInfo.pDynamicState = nullptr;
-    pipelineInfo.layout = m_pipelineLayout;
-    pipelineInfo.renderPass = m_renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
-
-    VK_CHECK(vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline));
-
-    for (const VkPipelineShaderStageCreateInfo& stage : shaderStages)
-    {
-        vkDestroyShaderModule(m_device, stage.module, nullptr);
-    }
+    m_blitPipelines = std::make_unique<BlitPipelines>(m_context, m_renderPass, m_pipelineLayout);
+    // Compiled before the first frame so that the generic pipeline is rarely used
+    m_blitPipelines->prepare(m_blitVariant);
+    m_shaderWatcher = ShaderWatcher::createFromEnvironment();
 }
 
 void Renderer::createDescriptorPool()
 {
+    if (m_pushDescriptors)
+    {
+        return;
+    }
+
     const uint32_t swapchainLength = static_cast<uint32_t>(m_context.getSwapchainImages().size());
 
-    const uint32_t descriptorCount = 1;
+    const uint32_t descriptorCount = swapchainLength;
 
     std::array<VkDescriptorPoolSize, 1> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -484,41 +858,78 @@ void Renderer::createDescriptorPool()
     poolInfo.pPoolSizes = poolSizes.data();
     poolInfo.maxSets = maxSets;
 
-    VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool));
+    VK_CHECK(vkCreateDescriptorPool(m_device, &poolInfo, m_context.getAllocator(AllocationSite::Descriptors), &m_descriptorPool));
 }
 
-void Renderer::createTextureDescriptorSet()
+void Renderer::createTextureDescriptorSets()
 {
-    std::vector<VkDescriptorSetLayout> layouts{m_texturesDescriptorSetLayout};
+    if (m_pushDescriptors)
+    {
+        return;
+    }
+
+    const size_t swapchainLength = m_context.getSwapchainImages().size();
+    std::vector<VkDescriptorSetLayout> layouts(swapchainLength, m_texturesDescriptorSetLayout);
 
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = m_descriptorPool;
     allocInfo.descriptorSetCount = ui32Size(layouts);
     allocInfo.pSetLayouts = layouts.data();
-    VK_ERROR_FRAGMENTED_POOL;
-    VK_CHECK(vkAllocateDescriptorSets(m_device, &allocInfo, &m_texturesDescriptorSet));
+
+    m_texturesDescriptorSets.resize(swapchainLength);
+    VK_CHECK(vkAllocateDescriptorSets(m_device, &allocInfo, m_texturesDescriptorSets.data()));
+    m_descriptorSetImageIds.assign(swapchainLength, 0);
 }
 
-void Renderer::updateTexturesDescriptorSet()
+void Renderer::updateTexturesDescriptorSet(uint32_t imageIndex, VkImageView imageView, uint64_t imageId)
 {
-    std::vector<VkWriteDescriptorSet> descriptorWrites(1);
-    std::vector<VkDescriptorImageInfo> imageInfos(descriptorWrites.size());
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = FrameGraph::getLayout(ImageUsage::SampledRead);
+    imageInfo.imageView = imageView;
+    imageInfo.sampler = m_sampler;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = m_texturesDescriptorSets[imageIndex];
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+    m_descriptorSetImageIds[imageIndex] = imageId;
+}
+
+void Renderer::bindTexture(VkCommandBuffer cb, uint32_t imageIndex, VkImageView imageView, uint64_t imageId)
+{
+    if (!m_pushDescriptors)
+    {
+        // Compared by id since a recreated view may get the handle value of a destroyed one
+        if (m_descriptorSetImageIds[imageIndex] != imageId)
+        {
+            updateTexturesDescriptorSet(imageIndex, imageView, imageId);
+        }
+        vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_texturesDescriptorSets[imageIndex], 0, nullptr);
+        return;
+    }
 
-    VkDescriptorImageInfo& imageInfo = imageInfos[0];
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = m_imageView;
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = FrameGraph::getLayout(ImageUsage::SampledRead);
+    imageInfo.imageView = imageView;
     imageInfo.sampler = m_sampler;
 
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = m_texturesDescriptorSet;
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pImageInfo = &imageInfo;
+    // The write is recorded into the command buffer, the destination set is ignored
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
 
-    vkUpdateDescriptorSets(m_device, ui32Size(descriptorWrites), descriptorWrites.data(), 0, nullptr);
+    m_cmdPushDescriptorSet(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &descriptorWrite);
 }
 
 void Renderer::allocateCommandBuffers()
@@ -533,3 +944,61 @@ void Renderer::allocateCommandBuffers()
 
     VK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffers.data()));
 }
+
+void Renderer::recordMipChainGeneration(VkCommandBuffer cb, VkImage sourceImage, const DirtyRect& dirtyRect)
+{
+    const uint32_t queueFamilyIndex = m_context.getGraphicsQueueFamilyIndex();
+
+    { // Base level is a plain copy of the imported image, content outside the dirty rect is kept
+        const std::array<ImageAccess, 2> accesses = {
+            ImageAccess{sourceImage, ImageUsage::TransferRead},
+            ImageAccess{m_mipImage, ImageUsage::TransferWrite, 0, 1},
+        };
+        m_frameGraph.beginPass(cb, queueFamilyIndex, accesses);
+
+        VkImageCopy region{};
+        region.srcSubresource = VkImageSubresourceLayers{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.srcOffset = VkOffset3D{dirtyRect.left, dirtyRect.top, 0};
+        region.dstSubresource = VkImageSubresourceLayers{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.dstOffset = region.srcOffset;
+        region.extent = VkExtent3D{static_cast<uint32_t>(dirtyRect.right - dirtyRect.left), static_cast<uint32_t>(dirtyRect.bottom - dirtyRect.top), 1};
+        vkCmdCopyImage(cb, sourceImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_mipImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    }
+
+    int32_t width = c_texWidth;
+    int32_t height = c_texHeight;
+    DirtyRect rect = dirtyRect;
+
+    for (uint32_t level = 1; level < m_mipLevels; ++level)
+    {
+        const std::array<ImageAccess, 2> accesses = {
+            ImageAccess{m_mipImage, ImageUsage::TransferRead, level - 1, 1},
+            ImageAccess{m_mipImage, ImageUsage::TransferWrite, level, 1},
+        };
+        m_frameGraph.beginPass(cb, queueFamilyIndex, accesses);
+
+        const int32_t nextWidth = std::max(width / 2, 1);
+        const int32_t nextHeight = std::max(height / 2, 1);
+
+        // Destination rect covers every texel whose footprint touches the dirty source texels
+        DirtyRect nextRect;
+        nextRect.left = rect.left / 2;
+        nextRect.top = rect.top / 2;
+        nextRect.right = (rect.right + 1) / 2;
+        nextRect.bottom = (rect.bottom + 1) / 2;
+        nextRect = clampRect(nextRect, nextWidth, nextHeight);
+
+        VkImageBlit blit{};
+        blit.srcSubresource = VkImageSubresourceLayers{VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+        blit.srcOffsets[0] = VkOffset3D{nextRect.left * 2, nextRect.top * 2, 0};
+        blit.srcOffsets[1] = VkOffset3D{std::min(nextRect.right * 2, width), std::min(nextRect.bottom * 2, height), 1};
+        blit.dstSubresource = VkImageSubresourceLayers{VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        blit.dstOffsets[0] = VkOffset3D{nextRect.left, nextRect.top, 0};
+        blit.dstOffsets[1] = VkOffset3D{nextRect.right, nextRect.bottom, 1};
+        vkCmdBlitImage(cb, m_mipImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_mipImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        width = nextWidth;
+        height = nextHeight;
+        rect = nextRect;
+    }
+}
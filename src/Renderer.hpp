@@ -1,7 +1,17 @@
 #pragma once
 
 #include "Context.hpp"
-#include "DX.hpp"
+#include "FrameSource.hpp"
+#include "FrameGraph.hpp"
+#include "MemoryBudget.hpp"
+#include "ImportCache.hpp"
+#include "HostTransfer.hpp"
+#include "SharedFences.hpp"
+#include "SurfaceFormat.hpp"
+#include "GpuTimer.hpp"
+#include "BlitPipelines.hpp"
+#include "OffscreenOutput.hpp"
+#include "ShaderWatcher.hpp"
 #include <winnt.h>
 #include <vector>
 #include <chrono>
@@ -11,46 +21,116 @@
 class Renderer final
 {
 public:
-    Renderer(Context& context);
+    // Imports the texture of the given source, the source only has to be ready when the first frame is rendered
+    Renderer(Context& context, FrameSource* source);
     ~Renderer();
 
     bool render();
 
 private:
-    bool update(uint32_t imageIndex);
+    // Also runs when the constructor throws, so every handle it touches starts out null
+    void destroy();
+    bool update();
+    // False when every swapchain image and output already shows the current content and nothing waits for submission
+    bool hasFrameWork() const;
 
-    void createRenderPass();
+    // Probes which shared formats can be imported and sets up the host copy path when none can
+    void selectTexturePath();
+    // Called on the first frame since the source may start up later than the renderer
+    void configureSource();
+    // Asks the producer for the best accepted format and rebuilds the mip image if the format changes
+    void negotiateSurfaceFormat();
+    // Uses shared fences when the producer has them
+    void selectSyncPath();
+    void createRenderPasses();
     void createSwapchainImageViews();
     void createFramebuffers();
+    // Retires the views and framebuffers of the previous swapchain and creates them for the current images
+    void recreateSwapchainResources();
     void createSampler();
-    void createTextures();
+    void createMipImage();
+    void destroyMipImage();
+    void trackSwapchainMemory();
+    // Sheds cached imports and the mip chain while device memory is short and brings the mip chain back afterwards
+    void updateMemoryPressure();
     void createTexturesDescriptorSetLayouts();
     void createGraphicsPipeline();
     void createDescriptorPool();
-    void createTextureDescriptorSet();
-    void updateTexturesDescriptorSet();
+    void createTextureDescriptorSets();
+    void updateTexturesDescriptorSet(uint32_t imageIndex, VkImageView imageView, uint64_t imageId);
+    void bindTexture(VkCommandBuffer cb, uint32_t imageIndex, VkImageView imageView, uint64_t imageId);
     void allocateCommandBuffers();
+    void createOutputs();
+    // Requests a capture of every output on F12 and writes the finished ones
+    void updateCaptures();
+    // Draws the texture into the framebuffer stretched over the given extent
+    void recordBlit(VkCommandBuffer cb, VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent, const VkRect2D& renderArea, uint32_t imageIndex, VkImageView textureView, uint64_t textureId);
+    void recordOutputs(VkCommandBuffer cb, uint32_t imageIndex, VkImage textureImage, VkImageView textureView, uint64_t textureId);
+    void recordMipChainGeneration(VkCommandBuffer cb, VkImage sourceImage, const DirtyRect& dirtyRect);
 
     Context& m_context;
     VkDevice m_device;
 
-    DX m_dx;
+    FrameSource* m_source;
+    // Declared before everything that registers images to it
+    FrameGraph m_frameGraph;
+    MemoryBudget m_memoryBudget;
+    ImportCache m_importCache;
+    std::unique_ptr<HostTransfer> m_hostTransfer;
+    std::unique_ptr<SharedFences> m_sharedFences;
+    bool m_sourceConfigured = false;
+    // Formats of the texture path, those that can also be blitted for the mip chain first
+    std::vector<DXGI_FORMAT> m_acceptedFormats;
+    const SurfaceFormat* m_surfaceFormat = &c_surfaceFormats[0];
+    GpuTimer m_gpuTimer;
 
     std::chrono::steady_clock::time_point m_lastRenderTime;
-    VkRenderPass m_renderPass;
+    VkRenderPass m_renderPass = VK_NULL_HANDLE;
+    VkRenderPass m_discardRenderPass = VK_NULL_HANDLE;
+    // Images of the swapchain generation the views and framebuffers were created for
+    std::vector<VkImage> m_swapchainImages;
+    uint64_t m_swapchainGeneration = 0;
     std::vector<VkImageView> m_swapchainImageViews;
     std::vector<VkFramebuffer> m_framebuffers;
-    VkSampler m_sampler;
-    VkImage m_image;
-    VkDeviceSize m_imageSize;
-    HANDLE m_imageMemoryHandle;
-    VkDeviceMemory m_imageMemory;
-    VkImageView m_imageView;
-    VkDescriptorSetLayout m_texturesDescriptorSetLayout;
-    VkPipelineLayout m_pipelineLayout;
-    VkPipeline m_graphicsPipeline;
-    VkDescriptorPool m_descriptorPool;
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    // Id of the imported image the mip chain was generated from
+    uint64_t m_importedImageId = 0;
+    bool m_mipmapsEnabled = false;
+    uint32_t m_mipLevels = 1;
+    VkImage m_mipImage = VK_NULL_HANDLE;
+    VkDeviceMemory m_mipImageMemory = VK_NULL_HANDLE;
+    VkImageView m_mipImageView = VK_NULL_HANDLE;
+    uint64_t m_mipImageId = 0;
+    uint32_t m_mipImageMemoryTypeIndex = 0;
+    VkDeviceSize m_mipImageMemorySize = 0;
+    bool m_mipChainValid = false;
+    // Dropped because of memory pressure, recreated once the pressure is normal again
+    bool m_mipImageShed = false;
+    MemoryPressure m_memoryPressure = MemoryPressure::Normal;
+    std::vector<DirtyRect> m_swapchainDamage;
+    // Producer changes of frames that were skipped because no swapchain image could be acquired
+    DirtyRect m_skippedDirtyRect;
+    // Shared handle of the surface the frames were last rendered from
+    HANDLE m_shownSharedHandle = nullptr;
+    // Incremented whenever the shown content changes, outputs that are up to date are not drawn again
+    uint64_t m_contentVersion = 0;
+    std::vector<std::unique_ptr<OffscreenOutput>> m_outputs;
+    VkDescriptorSetLayout m_texturesDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    std::unique_ptr<BlitPipelines> m_blitPipelines;
+    std::unique_ptr<ShaderWatcher> m_shaderWatcher;
+    // Conversion from the surface to the swapchain, the same for every surface format
+    BlitVariant m_blitVariant = selectBlitVariant(c_surfaceFormat.format, c_compositeAlpha);
+    // The texture is pushed into the command buffer when VK_KHR_push_descriptor is available, so switching textures
+    // every frame costs no descriptor set updates
+    bool m_pushDescriptors = false;
+    PFN_vkCmdPushDescriptorSetKHR m_cmdPushDescriptorSet = nullptr;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
     std::vector<VkDescriptorSet> m_uboDescriptorSets;
-    VkDescriptorSet m_texturesDescriptorSet;
+    // Without push descriptors, one set per swapchain image, a set is only rewritten after the fence of its image has
+    // been waited so that a set in use by an in-flight frame is never touched
+    std::vector<VkDescriptorSet> m_texturesDescriptorSets;
+    // Id of the image each set was written with
+    std::vector<uint64_t> m_descriptorSetImageIds;
     std::vector<VkCommandBuffer> m_commandBuffers;
 };
@@ -0,0 +1,136 @@
+#include "ShaderWatcher.hpp"
+#include "Utils.hpp"
+#include "Trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+const char* c_shaderReloadVariable = "DXVK_INTEROP_SHADER_RELOAD";
+const std::chrono::milliseconds c_pollInterval(250);
+// Same location the build writes the SPIR-V to, relative to the working directory
+const std::filesystem::path c_outputDirectory("shaders");
+
+bool isShaderSource(const std::filesystem::path& path)
+{
+    return path.extension() == ".vert" || path.extension() == ".frag";
+}
+} // namespace
+
+std::unique_ptr<ShaderWatcher> ShaderWatcher::createFromEnvironment()
+{
+    const char* directory = std::getenv(c_shaderReloadVariable);
+    if (directory == nullptr || directory[0] == '\0')
+    {
+        return nullptr;
+    }
+
+    std::error_code error;
+    if (!std::filesystem::is_directory(directory, error))
+    {
+        printf("WARNING: %s is not a directory, shader reload is disabled\n", directory);
+        return nullptr;
+    }
+    return std::make_unique<ShaderWatcher>(directory);
+}
+
+ShaderWatcher::ShaderWatcher(const std::filesystem::path& sourceDirectory) :
+    m_sourceDirectory(sourceDirectory)
+{
+    const char* sdk = std::getenv("VULKAN_SDK");
+    m_compiler = sdk != nullptr ? std::filesystem::path(sdk) / "Bin" / "glslc.exe" : std::filesystem::path("glslc");
+
+    // The first scan only records the current state, the SPIR-V from the build is assumed to be up to date
+    scan();
+    printf("Watching shaders in %s\n", std::filesystem::absolute(m_sourceDirectory).string().c_str());
+    m_watchThread = std::thread(&ShaderWatcher::watchLoop, this);
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+    m_stopRequested = true;
+    m_watchThread.join();
+}
+
+bool ShaderWatcher::takeCompiledUpdate()
+{
+    return m_compiledUpdate.exchange(false);
+}
+
+void ShaderWatcher::watchLoop()
+{
+    Tracer::get().setThreadName("Shader watcher");
+    while (!m_stopRequested)
+    {
+        std::this_thread::sleep_for(c_pollInterval);
+        scan();
+    }
+}
+
+void ShaderWatcher::scan()
+{
+    bool changed = false;
+    bool succeeded = true;
+    std::error_code error;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(m_sourceDirectory, error))
+    {
+        if (!entry.is_regular_file(error) || !isShaderSource(entry.path()))
+        {
+            continue;
+        }
+
+        // Editors may still be writing the file, an unreadable time is retried on the next poll
+        const std::filesystem::file_time_type writeTime = entry.last_write_time(error);
+        if (error)
+        {
+            continue;
+        }
+
+        std::filesystem::file_time_type& knownTime = m_writeTimes[entry.path().filename().string()];
+        if (knownTime == writeTime)
+        {
+            continue;
+        }
+        const bool known = knownTime != std::filesystem::file_time_type{};
+        knownTime = writeTime;
+        if (known)
+        {
+            changed = true;
+            succeeded = compile(entry.path()) && succeeded;
+        }
+    }
+
+    // A failed compile keeps the previous SPIR-V, the pipelines are rebuilt after the next good save
+    if (changed && succeeded)
+    {
+        m_compiledUpdate = true;
+    }
+}
+
+bool ShaderWatcher::compile(const std::filesystem::path& source) const
+{
+    TRACE_SCOPE("Shader compile");
+    const std::filesystem::path output = c_outputDirectory / (source.filename().string() + ".spv");
+    // glslc writes the file in pieces, so it goes to a temporary file that replaces the output in one rename. A reload
+    // running at the same time then reads either the previous SPIR-V or the new one, never a partial file.
+    const std::filesystem::path temporary = c_outputDirectory / (source.filename().string() + ".spv.tmp");
+    // cmd strips the outermost quotes, so the whole command is quoted once more
+    const std::string command = "\"\"" + m_compiler.string() + "\" \"" + source.string() + "\" -o \"" + temporary.string() + "\"\"";
+    printf("Compiling %s\n", source.filename().string().c_str());
+    if (std::system(command.c_str()) != 0)
+    {
+        printf("WARNING: Failed to compile %s, keeping the previous shaders\n", source.filename().string().c_str());
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, output, error);
+    if (error)
+    {
+        printf("WARNING: Failed to replace %s: %s\n", output.string().c_str(), error.message().c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Watches the GLSL sources for changes and compiles the changed ones with glslc into the SPIR-V files the pipelines
+// are loaded from. Polling and compiling happen on a background thread, the renderer only checks for a finished update.
+class ShaderWatcher final
+{
+public:
+    // Enabled when DXVK_INTEROP_SHADER_RELOAD is set to the directory of the GLSL sources, null otherwise
+    static std::unique_ptr<ShaderWatcher> createFromEnvironment();
+
+    explicit ShaderWatcher(const std::filesystem::path& sourceDirectory);
+    ~ShaderWatcher();
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    // True once after changed shaders have been compiled without errors
+    bool takeCompiledUpdate();
+
+private:
+    void watchLoop();
+    // Compiles the shaders that changed since the previous scan
+    void scan();
+    bool compile(const std::filesystem::path& source) const;
+
+    std::filesystem::path m_sourceDirectory;
+    std::filesystem::path m_compiler;
+    std::unordered_map<std::string, std::filesystem::file_time_type> m_writeTimes;
+    std::atomic<bool> m_stopRequested{false};
+    std::atomic<bool> m_compiledUpdate{false};
+    std::thread m_watchThread;
+};
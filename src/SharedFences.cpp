@@ -0,0 +1,94 @@
+#include "SharedFences.hpp"
+#include "Context.hpp"
+#include "SubmitBatch.hpp"
+#include <vulkan/vulkan_win32.h>
+
+namespace
+{
+// The imported texture is first read by the mip chain copy or the fragment shader
+const VkPipelineStageFlags2 c_readyWaitStages = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+} // namespace
+
+SharedFences::SharedFences(const Context& context, FrameSource& source) :
+    m_device(context.getDevice()),
+    m_allocator(context.getAllocator(AllocationSite::Sync)),
+    m_source(source),
+    m_waitedValue(source.getReadyFenceValue())
+{
+    CHECK(source.getReadyFenceHandle() != nullptr);
+
+    { // Import ready fence
+        auto vkImportSemaphoreWin32HandleKHR = (PFN_vkImportSemaphoreWin32HandleKHR)vkGetDeviceProcAddr(m_device, "vkImportSemaphoreWin32HandleKHR");
+        CHECK(vkImportSemaphoreWin32HandleKHR);
+
+        m_readySemaphore = createTimelineSemaphore(m_device, m_allocator, 0, nullptr);
+
+        // The handle stays owned by the producer
+        VkImportSemaphoreWin32HandleInfoKHR importInfo{};
+        importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_WIN32_HANDLE_INFO_KHR;
+        importInfo.semaphore = m_readySemaphore;
+        importInfo.handleType = c_handleType;
+        importInfo.handle = source.getReadyFenceHandle();
+        VK_CHECK(vkImportSemaphoreWin32HandleKHR(m_device, &importInfo));
+    }
+
+    { // Export release fence
+        auto vkGetSemaphoreWin32HandleKHR = (PFN_vkGetSemaphoreWin32HandleKHR)vkGetDeviceProcAddr(m_device, "vkGetSemaphoreWin32HandleKHR");
+        CHECK(vkGetSemaphoreWin32HandleKHR);
+
+        VkExportSemaphoreCreateInfo exportInfo{};
+        exportInfo.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO;
+        exportInfo.handleTypes = c_handleType;
+
+        // Starts at the current ready value so that the next producer wait is already satisfied, also after recovery
+        m_releaseSemaphore = createTimelineSemaphore(m_device, m_allocator, m_waitedValue, &exportInfo);
+
+        VkSemaphoreGetWin32HandleInfoKHR getHandleInfo{};
+        getHandleInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_WIN32_HANDLE_INFO_KHR;
+        getHandleInfo.semaphore = m_releaseSemaphore;
+        getHandleInfo.handleType = c_handleType;
+        VK_CHECK(vkGetSemaphoreWin32HandleKHR(m_device, &getHandleInfo, &m_releaseHandle));
+    }
+
+    m_source.setReleaseFenceHandle(m_releaseHandle);
+}
+
+SharedFences::~SharedFences()
+{
+    // The device is idle, but after device loss the submitted release signals may never have executed while the producer
+    // GPU already waits for them. The latest ready value is the highest one it can wait for, so it is signaled from the host.
+    const uint64_t readyValue = m_source.getReadyFenceValue();
+    uint64_t releasedValue = 0;
+    const VkResult counterResult = vkGetSemaphoreCounterValue(m_device, m_releaseSemaphore, &releasedValue);
+    if (counterResult != VK_SUCCESS || releasedValue < readyValue)
+    {
+        VkSemaphoreSignalInfo signalInfo{};
+        signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+        signalInfo.semaphore = m_releaseSemaphore;
+        signalInfo.value = readyValue;
+        if (vkSignalSemaphore(m_device, &signalInfo) != VK_SUCCESS)
+        {
+            printf("WARNING: Could not signal release value %llu, the producer may stall\n", static_cast<unsigned long long>(readyValue));
+        }
+    }
+
+    m_source.setReleaseFenceHandle(nullptr);
+    CloseHandle(m_releaseHandle);
+    vkDestroySemaphore(m_device, m_releaseSemaphore, m_allocator);
+    vkDestroySemaphore(m_device, m_readySemaphore, m_allocator);
+}
+
+void SharedFences::addToBatch(SubmitBatch& batch)
+{
+    // Without a new update the producer hasn't written anything and the release value can't be signaled twice
+    const uint64_t readyValue = m_source.getReadyFenceValue();
+    if (readyValue == m_waitedValue)
+    {
+        return;
+    }
+
+    m_waitedValue = readyValue;
+    batch.addWait(m_readySemaphore, c_readyWaitStages, m_waitedValue);
+    // Added now but signaled after the frame's command buffers, a signal only covers work submitted before it
+    batch.addFinalSignal(m_releaseSemaphore, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, m_waitedValue);
+}
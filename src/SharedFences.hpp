@@ -0,0 +1,35 @@
+#pragma once
+
+#include "VulkanUtils.hpp"
+#include "FrameSource.hpp"
+
+class Context;
+class SubmitBatch;
+
+// Explicit synchronization with the producer through shared D3D11 fences imported as timeline semaphores. The frame
+// submission waits for the ready fence value of the latest producer update and, after the frame's command buffers,
+// signals the same value on the release fence, which the producer waits for on its GPU before writing again. Neither
+// side blocks on the CPU.
+class SharedFences final
+{
+public:
+    static const VkExternalSemaphoreHandleTypeFlagBits c_handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_D3D11_FENCE_BIT;
+
+    // The source must have a ready fence
+    SharedFences(const Context& context, FrameSource& source);
+    ~SharedFences();
+
+    // Called after the source has been updated, before the frame is submitted
+    void addToBatch(SubmitBatch& batch);
+    // True when the producer has updated since the last submission, it can't write again until the release is signaled
+    bool hasPendingRelease() const { return m_source.getReadyFenceValue() != m_waitedValue; }
+
+private:
+    VkDevice m_device;
+    const VkAllocationCallbacks* m_allocator;
+    FrameSource& m_source;
+    VkSemaphore m_readySemaphore = VK_NULL_HANDLE;
+    VkSemaphore m_releaseSemaphore = VK_NULL_HANDLE;
+    HANDLE m_releaseHandle = nullptr;
+    uint64_t m_waitedValue = 0;
+};
@@ -0,0 +1,72 @@
+#include "StartupTimeline.hpp"
+#include "Trace.hpp"
+#include <windows.h>
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+double toMs(uint64_t ns)
+{
+    return static_cast<double>(ns) / 1'000'000.0;
+}
+} // namespace
+
+StartupTimeline& StartupTimeline::get()
+{
+    static StartupTimeline timeline;
+    return timeline;
+}
+
+void StartupTimeline::start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_startNs = Tracer::now();
+    m_steps.clear();
+    m_reported = false;
+}
+
+void StartupTimeline::addStep(const char* name, uint64_t beginNs, uint64_t endNs)
+{
+    Tracer::get().addSpan(name, beginNs, endNs);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_reported)
+    {
+        m_steps.push_back(Step{name, beginNs, endNs, GetCurrentThreadId()});
+    }
+}
+
+void StartupTimeline::markFirstFrame()
+{
+    const uint64_t firstFrameNs = Tracer::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_reported)
+    {
+        return;
+    }
+    m_reported = true;
+
+    std::sort(m_steps.begin(), m_steps.end(), [](const Step& a, const Step& b) { return a.beginNs < b.beginNs; });
+
+    printf("Startup timeline, first frame presented at %.1f ms\n", toMs(firstFrameNs - m_startNs));
+    printf("%10s %10s %10s %8s  %s\n", "begin", "end", "duration", "thread", "step");
+    for (const Step& step : m_steps)
+    {
+        printf("%7.1f ms %7.1f ms %7.1f ms %8u  %s\n", toMs(step.beginNs - m_startNs), toMs(step.endNs - m_startNs), toMs(step.endNs - step.beginNs), step.threadId, step.name);
+    }
+    m_steps.clear();
+    m_steps.shrink_to_fit();
+}
+
+StartupStep::StartupStep(const char* name) :
+    m_name(name),
+    m_beginNs(Tracer::now())
+{
+}
+
+StartupStep::~StartupStep()
+{
+    StartupTimeline::get().addStep(m_name, m_beginNs, Tracer::now());
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Collects the startup steps from every thread and prints them once the first frame has been presented, so it can be
+// seen which steps overlap and which one bounds the time to first frame. Steps are also recorded to the trace.
+class StartupTimeline final
+{
+public:
+    static StartupTimeline& get();
+
+    // Start of the timeline, called first thing in main
+    void start();
+    // Name must be a string literal
+    void addStep(const char* name, uint64_t beginNs, uint64_t endNs);
+    // Prints the report the first time it is called
+    void markFirstFrame();
+
+private:
+    struct Step
+    {
+        const char* name;
+        uint64_t beginNs;
+        uint64_t endNs;
+        uint32_t threadId;
+    };
+
+    StartupTimeline() = default;
+
+    std::mutex m_mutex;
+    std::vector<Step> m_steps;
+    uint64_t m_startNs = 0;
+    bool m_reported = false;
+};
+
+// Adds a step from construction to destruction on the calling thread
+class StartupStep final
+{
+public:
+    explicit StartupStep(const char* name);
+    ~StartupStep();
+
+private:
+    const char* m_name;
+    uint64_t m_beginNs;
+};
@@ -0,0 +1,151 @@
+#include "SubmitBatch.hpp"
+#include "Trace.hpp"
+
+namespace
+{
+VkSemaphoreSubmitInfo createSemaphoreSubmitInfo(VkSemaphore semaphore, VkPipelineStageFlags2 stageMask, uint64_t value)
+{
+    VkSemaphoreSubmitInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+    info.semaphore = semaphore;
+    info.value = value;
+    info.stageMask = stageMask;
+    info.deviceIndex = 0;
+    return info;
+}
+} // namespace
+
+void SubmitBatch::addWait(VkSemaphore semaphore, VkPipelineStageFlags2 stageMask, uint64_t value)
+{
+    CHECK(m_waitCount < c_maxSemaphores);
+
+    // A wait applies to every command buffer of the submit, do not let it hold back work that was added before it
+    const SubmitRange* range = m_submitCount > 0 ? &m_ranges[m_submitCount - 1] : nullptr;
+    if (range == nullptr || range->commandBufferCount > 0 || range->signalCount > 0)
+    {
+        beginSubmit();
+    }
+
+    m_waits[m_waitCount++] = createSemaphoreSubmitInfo(semaphore, stageMask, value);
+    ++currentSubmit().waitCount;
+}
+
+void SubmitBatch::addCommandBuffer(VkCommandBuffer commandBuffer)
+{
+    CHECK(m_commandBufferCount < c_maxCommandBuffers);
+
+    // Signals are executed after all command buffers of a submit, keep them from waiting for later work
+    const SubmitRange* range = m_submitCount > 0 ? &m_ranges[m_submitCount - 1] : nullptr;
+    if (range == nullptr || range->signalCount > 0)
+    {
+        beginSubmit();
+    }
+
+    VkCommandBufferSubmitInfo& info = m_commandBuffers[m_commandBufferCount++];
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+    info.commandBuffer = commandBuffer;
+    info.deviceMask = 0;
+    ++currentSubmit().commandBufferCount;
+}
+
+void SubmitBatch::addCommandBuffers(Span<const VkCommandBuffer> commandBuffers)
+{
+    for (VkCommandBuffer commandBuffer : commandBuffers)
+    {
+        addCommandBuffer(commandBuffer);
+    }
+}
+
+void SubmitBatch::addSignal(VkSemaphore semaphore, VkPipelineStageFlags2 stageMask, uint64_t value)
+{
+    CHECK(m_signalCount < c_maxSemaphores);
+
+    if (m_submitCount == 0)
+    {
+        beginSubmit();
+    }
+
+    m_signals[m_signalCount++] = createSemaphoreSubmitInfo(semaphore, stageMask, value);
+    ++currentSubmit().signalCount;
+}
+
+void SubmitBatch::addFinalSignal(VkSemaphore semaphore, VkPipelineStageFlags2 stageMask, uint64_t value)
+{
+    CHECK(m_finalSignalCount < c_maxSemaphores);
+    m_finalSignals[m_finalSignalCount++] = createSemaphoreSubmitInfo(semaphore, stageMask, value);
+}
+
+void SubmitBatch::setFence(VkFence fence)
+{
+    CHECK(m_fence == VK_NULL_HANDLE);
+    m_fence = fence;
+}
+
+bool SubmitBatch::isEmpty() const
+{
+    return m_submitCount == 0 && m_finalSignalCount == 0 && m_fence == VK_NULL_HANDLE;
+}
+
+void SubmitBatch::flush(VkQueue queue)
+{
+    if (isEmpty())
+    {
+        return;
+    }
+
+    // The signals of the last submit are the last ones in the array, so the final signals extend them
+    for (uint32_t i = 0; i < m_finalSignalCount; ++i)
+    {
+        addSignal(m_finalSignals[i].semaphore, m_finalSignals[i].stageMask, m_finalSignals[i].value);
+    }
+
+    for (uint32_t i = 0; i < m_submitCount; ++i)
+    {
+        const SubmitRange& range = m_ranges[i];
+
+        VkSubmitInfo2& submitInfo = m_submitInfos[i];
+        submitInfo = VkSubmitInfo2{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.waitSemaphoreInfoCount = range.waitCount;
+        submitInfo.pWaitSemaphoreInfos = m_waits.data() + range.firstWait;
+        submitInfo.commandBufferInfoCount = range.commandBufferCount;
+        submitInfo.pCommandBufferInfos = m_commandBuffers.data() + range.firstCommandBuffer;
+        submitInfo.signalSemaphoreInfoCount = range.signalCount;
+        submitInfo.pSignalSemaphoreInfos = m_signals.data() + range.firstSignal;
+    }
+
+    const VkFence fence = m_fence;
+    const uint32_t submitCount = m_submitCount;
+    clear();
+
+    TRACE_SCOPE("vkQueueSubmit2");
+    VK_CHECK(vkQueueSubmit2(queue, submitCount, m_submitInfos.data(), fence));
+}
+
+void SubmitBatch::clear()
+{
+    m_waitCount = 0;
+    m_commandBufferCount = 0;
+    m_signalCount = 0;
+    m_finalSignalCount = 0;
+    m_submitCount = 0;
+    m_fence = VK_NULL_HANDLE;
+}
+
+SubmitBatch::SubmitRange& SubmitBatch::currentSubmit()
+{
+    return m_ranges[m_submitCount - 1];
+}
+
+void SubmitBatch::beginSubmit()
+{
+    CHECK(m_submitCount < c_maxSubmits);
+
+    SubmitRange& range = m_ranges[m_submitCount++];
+    range.firstWait = m_waitCount;
+    range.waitCount = 0;
+    range.firstCommandBuffer = m_commandBufferCount;
+    range.commandBufferCount = 0;
+    range.firstSignal = m_signalCount;
+    range.signalCount = 0;
+}
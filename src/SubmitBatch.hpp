@@ -0,0 +1,53 @@
+#pragma once
+
+#include "VulkanUtils.hpp"
+#include <array>
+
+// Collects the command buffers, semaphores and fence of all stages of a frame for one queue and flushes them with a
+// single vkQueueSubmit2. A new VkSubmitInfo2 is only started when merging would delay a signal or widen a wait.
+class SubmitBatch final
+{
+public:
+    void addWait(VkSemaphore semaphore, VkPipelineStageFlags2 stageMask, uint64_t value = 0);
+    void addCommandBuffer(VkCommandBuffer commandBuffer);
+    void addCommandBuffers(Span<const VkCommandBuffer> commandBuffers);
+    void addSignal(VkSemaphore semaphore, VkPipelineStageFlags2 stageMask, uint64_t value = 0);
+    // Signaled by the last submit of the flush, after every command buffer of the batch including ones added later. For
+    // signals that must cover the frame's work but are known before the frame is recorded.
+    void addFinalSignal(VkSemaphore semaphore, VkPipelineStageFlags2 stageMask, uint64_t value = 0);
+    void setFence(VkFence fence);
+    bool isEmpty() const;
+    void flush(VkQueue queue);
+    void clear();
+
+private:
+    struct SubmitRange
+    {
+        uint32_t firstWait;
+        uint32_t waitCount;
+        uint32_t firstCommandBuffer;
+        uint32_t commandBufferCount;
+        uint32_t firstSignal;
+        uint32_t signalCount;
+    };
+
+    static const uint32_t c_maxSubmits = 8;
+    static const uint32_t c_maxSemaphores = 16;
+    static const uint32_t c_maxCommandBuffers = 32;
+
+    SubmitRange& currentSubmit();
+    void beginSubmit();
+
+    std::array<VkSemaphoreSubmitInfo, c_maxSemaphores> m_waits{};
+    std::array<VkCommandBufferSubmitInfo, c_maxCommandBuffers> m_commandBuffers{};
+    std::array<VkSemaphoreSubmitInfo, c_maxSemaphores> m_signals{};
+    std::array<VkSemaphoreSubmitInfo, c_maxSemaphores> m_finalSignals{};
+    std::array<SubmitRange, c_maxSubmits> m_ranges{};
+    std::array<VkSubmitInfo2, c_maxSubmits> m_submitInfos{};
+    uint32_t m_waitCount = 0;
+    uint32_t m_commandBufferCount = 0;
+    uint32_t m_signalCount = 0;
+    uint32_t m_finalSignalCount = 0;
+    uint32_t m_submitCount = 0;
+    VkFence m_fence = VK_NULL_HANDLE;
+};
@@ -0,0 +1,347 @@
+#include "SurfaceChannel.hpp"
+#include "Trace.hpp"
+#include <dxgi.h>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+namespace
+{
+const char* c_pipeName = "\\\\.\\pipe\\dxvk-interop";
+const DWORD c_pipeBufferSize = 4096;
+const DWORD c_connectTimeoutMs = 100;
+
+enum MessageType : uint32_t
+{
+    HelloMessageType = 1,
+    SurfaceMessageType = 2,
+    FrameReadyMessageType = 3,
+    FormatRequestMessageType = 4
+};
+
+struct HelloMessage
+{
+    uint32_t type;
+    uint32_t consumerProcessId;
+};
+
+struct SurfaceMessage
+{
+    uint32_t type;
+    uint32_t padding;
+    SurfaceInfo info;
+};
+
+struct FrameReadyMessage
+{
+    uint32_t type;
+    uint32_t padding;
+    uint64_t frameIndex;
+    DirtyRect dirtyRect;
+};
+
+struct FormatRequestMessage
+{
+    uint32_t type;
+    uint32_t formatCount;
+    uint32_t formats[c_maxRequestedFormats];
+};
+
+// Frame messages are drained with a single read, older notifications are folded into the newest one
+const size_t c_maxFrameMessagesPerRead = 16;
+
+bool writeAll(HANDLE pipe, const void* data, DWORD size)
+{
+    DWORD written = 0;
+    return WriteFile(pipe, data, size, &written, nullptr) && written == size;
+}
+
+bool readAll(HANDLE pipe, void* data, DWORD size)
+{
+    uint8_t* bytes = static_cast<uint8_t*>(data);
+    DWORD total = 0;
+    while (total < size)
+    {
+        DWORD read = 0;
+        if (!ReadFile(pipe, bytes + total, size - total, &read, nullptr))
+        {
+            return false;
+        }
+        total += read;
+    }
+    return true;
+}
+} // namespace
+
+SurfaceProducerChannel::SurfaceProducerChannel(ID3D11Texture2D* texture, HANDLE sharedHandle) :
+    m_sharedHandle(sharedHandle)
+{
+    D3D11_TEXTURE2D_DESC desc{};
+    texture->GetDesc(&desc);
+
+    m_surfaceInfo.width = desc.Width;
+    m_surfaceInfo.height = desc.Height;
+    m_surfaceInfo.dxgiFormat = desc.Format;
+    m_surfaceInfo.rowPitch = desc.Width * c_texChannels;
+    m_surfaceInfo.modifier = 0;
+    m_surfaceInfo.producerProcessId = GetCurrentProcessId();
+
+    // Adapter identity
+    ID3D11Device* device = nullptr;
+    texture->GetDevice(&device);
+    IDXGIDevice* dxgiDevice = nullptr;
+    CHECK(SUCCEEDED(device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice)));
+    IDXGIAdapter* adapter = nullptr;
+    CHECK(SUCCEEDED(dxgiDevice->GetAdapter(&adapter)));
+    DXGI_ADAPTER_DESC adapterDesc{};
+    adapter->GetDesc(&adapterDesc);
+    std::memcpy(m_surfaceInfo.adapterLuid, &adapterDesc.AdapterLuid, sizeof(m_surfaceInfo.adapterLuid));
+    adapter->Release();
+    dxgiDevice->Release();
+    device->Release();
+
+    m_pipe = CreateNamedPipeA(c_pipeName, PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, c_pipeBufferSize, c_pipeBufferSize, 0, nullptr);
+    CHECK(m_pipe != INVALID_HANDLE_VALUE);
+}
+
+SurfaceProducerChannel::~SurfaceProducerChannel()
+{
+    DisconnectNamedPipe(m_pipe);
+    CloseHandle(m_pipe);
+}
+
+void SurfaceProducerChannel::waitForConsumer()
+{
+    if (m_consumerConnected)
+    {
+        // Discards whatever the previous consumer left unread so the pipe instance can accept the next one
+        DisconnectNamedPipe(m_pipe);
+        m_consumerConnected = false;
+    }
+
+    printf("Waiting for consumer on %s\n", c_pipeName);
+    const BOOL connected = ConnectNamedPipe(m_pipe, nullptr);
+    CHECK(connected || GetLastError() == ERROR_PIPE_CONNECTED);
+    m_consumerConnected = true;
+
+    HelloMessage hello{};
+    CHECK(readAll(m_pipe, &hello, sizeof(hello)));
+    CHECK(hello.type == HelloMessageType);
+    m_consumerProcessId = hello.consumerProcessId;
+
+    sendSurface(nullptr, m_sharedHandle);
+    printf("Consumer %u connected\n", hello.consumerProcessId);
+}
+
+bool SurfaceProducerChannel::receiveFormatRequest(std::vector<DXGI_FORMAT>& formats)
+{
+    DWORD available = 0;
+    if (!PeekNamedPipe(m_pipe, nullptr, 0, nullptr, &available, nullptr) || available < sizeof(FormatRequestMessage))
+    {
+        return false;
+    }
+
+    FormatRequestMessage message{};
+    CHECK(readAll(m_pipe, &message, sizeof(message)));
+    CHECK(message.type == FormatRequestMessageType && message.formatCount <= c_maxRequestedFormats);
+
+    formats.clear();
+    for (uint32_t i = 0; i < message.formatCount; ++i)
+    {
+        formats.push_back(static_cast<DXGI_FORMAT>(message.formats[i]));
+    }
+    return true;
+}
+
+void SurfaceProducerChannel::sendSurface(ID3D11Texture2D* texture, HANDLE sharedHandle)
+{
+    if (texture != nullptr)
+    {
+        D3D11_TEXTURE2D_DESC desc{};
+        texture->GetDesc(&desc);
+        m_surfaceInfo.dxgiFormat = desc.Format;
+        m_sharedHandle = sharedHandle;
+    }
+
+    // Equivalent of passing a descriptor with SCM_RIGHTS, the handle is duplicated directly into the consumer process
+    HANDLE consumerProcess = OpenProcess(PROCESS_DUP_HANDLE, FALSE, m_consumerProcessId);
+    CHECK(consumerProcess != nullptr);
+    HANDLE remoteHandle = nullptr;
+    const BOOL duplicated = DuplicateHandle(GetCurrentProcess(), m_sharedHandle, consumerProcess, &remoteHandle, 0, FALSE, DUPLICATE_SAME_ACCESS);
+    CloseHandle(consumerProcess);
+    CHECK(duplicated);
+
+    SurfaceMessage message{};
+    message.type = SurfaceMessageType;
+    message.info = m_surfaceInfo;
+    message.info.memoryHandle = reinterpret_cast<uint64_t>(remoteHandle);
+    CHECK(writeAll(m_pipe, &message, sizeof(message)));
+}
+
+bool SurfaceProducerChannel::sendFrameReady(uint64_t frameIndex, const std::vector<DirtyRect>& dirtyRects)
+{
+    TRACE_SCOPE("sendFrameReady");
+    FrameReadyMessage message{};
+    message.type = FrameReadyMessageType;
+    message.frameIndex = frameIndex;
+    for (const DirtyRect& rect : dirtyRects)
+    {
+        message.dirtyRect = unite(message.dirtyRect, rect);
+    }
+    return writeAll(m_pipe, &message, sizeof(message));
+}
+
+SurfaceConsumerChannel::SurfaceConsumerChannel()
+{
+    printf("Connecting to producer on %s\n", c_pipeName);
+    for (;;)
+    {
+        m_pipe = CreateFileA(c_pipeName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (m_pipe != INVALID_HANDLE_VALUE)
+        {
+            break;
+        }
+        CHECK(GetLastError() == ERROR_PIPE_BUSY || GetLastError() == ERROR_FILE_NOT_FOUND);
+        if (!WaitNamedPipeA(c_pipeName, c_connectTimeoutMs))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(c_connectTimeoutMs));
+        }
+    }
+
+    HelloMessage hello{};
+    hello.type = HelloMessageType;
+    hello.consumerProcessId = GetCurrentProcessId();
+    CHECK(writeAll(m_pipe, &hello, sizeof(hello)));
+
+    m_dirtyRects.reserve(1);
+    receiveSurface();
+}
+
+SurfaceConsumerChannel::~SurfaceConsumerChannel()
+{
+    CloseHandle(reinterpret_cast<HANDLE>(m_surfaceInfo.memoryHandle));
+    CloseHandle(m_pipe);
+}
+
+const SurfaceInfo& SurfaceConsumerChannel::getSurfaceInfo() const
+{
+    return m_surfaceInfo;
+}
+
+bool SurfaceConsumerChannel::isConnected() const
+{
+    return m_connected;
+}
+
+uint64_t SurfaceConsumerChannel::getLastFrameIndex() const
+{
+    return m_lastFrameIndex;
+}
+
+void SurfaceConsumerChannel::update()
+{
+    TRACE_SCOPE("receiveFrameReady");
+    m_dirtyRects.clear();
+    if (!m_connected)
+    {
+        return;
+    }
+
+    DWORD available = 0;
+    if (!PeekNamedPipe(m_pipe, nullptr, 0, nullptr, &available, nullptr))
+    {
+        printf("Producer disconnected\n");
+        m_connected = false;
+        return;
+    }
+
+    const DWORD messageCount = std::min<DWORD>(available / sizeof(FrameReadyMessage), c_maxFrameMessagesPerRead);
+    if (messageCount == 0)
+    {
+        return;
+    }
+
+    std::array<FrameReadyMessage, c_maxFrameMessagesPerRead> messages;
+    if (!readAll(m_pipe, messages.data(), messageCount * sizeof(FrameReadyMessage)))
+    {
+        printf("Producer disconnected\n");
+        m_connected = false;
+        return;
+    }
+
+    DirtyRect dirtyRect;
+    for (DWORD i = 0; i < messageCount; ++i)
+    {
+        CHECK(messages[i].type == FrameReadyMessageType);
+        dirtyRect = unite(dirtyRect, messages[i].dirtyRect);
+        m_lastFrameIndex = messages[i].frameIndex;
+    }
+
+    if (!isEmpty(dirtyRect))
+    {
+        m_dirtyRects.push_back(dirtyRect);
+    }
+}
+
+HANDLE SurfaceConsumerChannel::getSharedHandle()
+{
+    return reinterpret_cast<HANDLE>(m_surfaceInfo.memoryHandle);
+}
+
+DXGI_FORMAT SurfaceConsumerChannel::getFormat() const
+{
+    return static_cast<DXGI_FORMAT>(m_surfaceInfo.dxgiFormat);
+}
+
+void SurfaceConsumerChannel::requestFormat(Span<const DXGI_FORMAT> formats)
+{
+    FormatRequestMessage request{};
+    request.type = FormatRequestMessageType;
+    request.formatCount = static_cast<uint32_t>(std::min<size_t>(formats.size(), c_maxRequestedFormats));
+    for (uint32_t i = 0; i < request.formatCount; ++i)
+    {
+        request.formats[i] = formats[i];
+    }
+    CHECK(writeAll(m_pipe, &request, sizeof(request)));
+
+    // Frames sent before the producer saw the request are for the old surface, the new one is dirty as a whole anyway
+    for (;;)
+    {
+        uint32_t type = 0;
+        CHECK(readAll(m_pipe, &type, sizeof(type)));
+        if (type == SurfaceMessageType)
+        {
+            break;
+        }
+        CHECK(type == FrameReadyMessageType);
+        FrameReadyMessage message{};
+        CHECK(readAll(m_pipe, reinterpret_cast<uint8_t*>(&message) + sizeof(type), sizeof(message) - sizeof(type)));
+        m_lastFrameIndex = message.frameIndex;
+    }
+
+    // The renderer has duplicated the old handle if it imported it
+    CloseHandle(reinterpret_cast<HANDLE>(m_surfaceInfo.memoryHandle));
+    receiveSurface(sizeof(uint32_t));
+}
+
+const std::vector<DirtyRect>& SurfaceConsumerChannel::getDirtyRects() const
+{
+    return m_dirtyRects;
+}
+
+void SurfaceConsumerChannel::receiveSurface(size_t typeBytesRead)
+{
+    SurfaceMessage message{};
+    message.type = SurfaceMessageType;
+    CHECK(readAll(m_pipe, reinterpret_cast<uint8_t*>(&message) + typeBytesRead, static_cast<DWORD>(sizeof(message) - typeBytesRead)));
+    CHECK(message.type == SurfaceMessageType);
+    m_surfaceInfo = message.info;
+
+    // Everything is considered dirty until the next frame message arrives
+    m_dirtyRects.clear();
+    m_dirtyRects.push_back(DirtyRect{0, 0, static_cast<int>(m_surfaceInfo.width), static_cast<int>(m_surfaceInfo.height)});
+
+    printf("Received surface %ux%u format %u from producer %u\n", m_surfaceInfo.width, m_surfaceInfo.height, m_surfaceInfo.dxgiFormat, m_surfaceInfo.producerProcessId);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "FrameSource.hpp"
+#include <d3d11.h>
+#include <cstdint>
+#include <vector>
+
+// Transport of a shared texture from a producer process to a consumer process over a named pipe. The producer
+// duplicates its shared NT handle into the consumer process once and afterwards only streams small frame messages. The
+// consumer can ask for a different format, the producer then recreates the texture and sends the new surface.
+
+// Most formats a consumer can list in one request
+const uint32_t c_maxRequestedFormats = 8;
+
+struct SurfaceInfo
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t dxgiFormat;
+    uint32_t rowPitch;
+    // DXGI does not expose format modifiers, always 0 but kept so the message describes the layout completely
+    uint64_t modifier;
+    // Handle value that is valid in the consumer process
+    uint64_t memoryHandle;
+    uint32_t producerProcessId;
+    uint32_t padding;
+    // LUID of the adapter the texture lives on, the consumer must create its Vulkan device on the same adapter
+    uint8_t adapterLuid[8];
+};
+
+class SurfaceProducerChannel final
+{
+public:
+    SurfaceProducerChannel(ID3D11Texture2D* texture, HANDLE sharedHandle);
+    ~SurfaceProducerChannel();
+
+    // Blocks until a consumer connects and has received the surface, a previous consumer is disconnected first
+    void waitForConsumer();
+    // Returns false when the consumer has disconnected
+    bool sendFrameReady(uint64_t frameIndex, const std::vector<DirtyRect>& dirtyRects);
+    // Returns true with the formats in consumer preference order when the consumer has asked for another format, the
+    // consumer waits until sendSurface has been called
+    bool receiveFormatRequest(std::vector<DXGI_FORMAT>& formats);
+    void sendSurface(ID3D11Texture2D* texture, HANDLE sharedHandle);
+
+private:
+    HANDLE m_pipe;
+    bool m_consumerConnected = false;
+    HANDLE m_sharedHandle;
+    DWORD m_consumerProcessId = 0;
+    SurfaceInfo m_surfaceInfo{};
+};
+
+class SurfaceConsumerChannel final : public FrameSource
+{
+public:
+    // Blocks until connected to a producer and the surface has been received
+    SurfaceConsumerChannel();
+    ~SurfaceConsumerChannel();
+
+    const SurfaceInfo& getSurfaceInfo() const;
+    uint64_t getLastFrameIndex() const;
+
+    void update() override;
+    bool isConnected() const override;
+    HANDLE getSharedHandle() override;
+    DXGI_FORMAT getFormat() const override;
+    // Blocks until the producer has answered with its surface
+    void requestFormat(Span<const DXGI_FORMAT> formats) override;
+    const std::vector<DirtyRect>& getDirtyRects() const override;
+
+private:
+    // Reads the surface message, the first bytes of it may already have been read to find the message type
+    void receiveSurface(size_t typeBytesRead = 0);
+
+    HANDLE m_pipe;
+    SurfaceInfo m_surfaceInfo{};
+    bool m_connected = true;
+    uint64_t m_lastFrameIndex = 0;
+    std::vector<DirtyRect> m_dirtyRects;
+};
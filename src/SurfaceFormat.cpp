@@ -0,0 +1,13 @@
+#include "SurfaceFormat.hpp"
+
+const SurfaceFormat* findSurfaceFormat(DXGI_FORMAT format)
+{
+    for (const SurfaceFormat& surfaceFormat : c_surfaceFormats)
+    {
+        if (surfaceFormat.dxgiFormat == format)
+        {
+            return &surfaceFormat;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <dxgiformat.h>
+#include <array>
+
+// Format of the shared texture on both APIs. All of them have 4 bytes per texel, so the host copy path and the dirty
+// rectangle math work the same for each.
+struct SurfaceFormat
+{
+    DXGI_FORMAT dxgiFormat;
+    VkFormat vkFormat;
+    const char* name;
+};
+
+const std::array<SurfaceFormat, 3> c_surfaceFormats = {{
+    {DXGI_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_UNORM, "R8G8B8A8_UNORM"}, //
+    {DXGI_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_B8G8R8A8_UNORM, "B8G8R8A8_UNORM"}, //
+    {DXGI_FORMAT_R10G10B10A2_UNORM, VK_FORMAT_A2B10G10R10_UNORM_PACK32, "R10G10B10A2_UNORM"} //
+}};
+
+// Returns null for formats that can't be shared
+const SurfaceFormat* findSurfaceFormat(DXGI_FORMAT format);
@@ -0,0 +1,204 @@
+#include "Trace.hpp"
+#include "Utils.hpp"
+#include <windows.h>
+#include <chrono>
+#include <cstdlib>
+
+namespace
+{
+const std::chrono::milliseconds c_flushInterval(50);
+
+uint64_t getCounterFrequency()
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return static_cast<uint64_t>(frequency.QuadPart);
+}
+} // namespace
+
+Tracer& Tracer::get()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::startFromEnvironment()
+{
+    const char* prefix = std::getenv("DXVK_INTEROP_TRACE");
+    if (prefix == nullptr || prefix[0] == '\0')
+    {
+        return;
+    }
+
+    char path[MAX_PATH];
+    std::snprintf(path, sizeof(path), "%s-%lu.json", prefix, GetCurrentProcessId());
+    get().start(path);
+}
+
+Tracer::~Tracer()
+{
+    stop();
+}
+
+void Tracer::start(const char* path)
+{
+    CHECK(!isEnabled());
+
+    m_file = std::fopen(path, "w");
+    if (m_file == nullptr)
+    {
+        printf("WARNING: Unable to open trace file %s\n", path);
+        return;
+    }
+
+    m_processId = GetCurrentProcessId();
+    m_firstEvent = true;
+    std::fprintf(m_file, "{\"traceEvents\":[\n");
+    writeEvent(Event{"GPU graphics queue", 0, 0, c_gpuQueueThreadId, EventType::ThreadName, 0});
+
+    m_stopRequested = false;
+    m_enabled = true;
+    m_flushThread = std::thread(&Tracer::flushLoop, this);
+    printf("Tracing to %s\n", path);
+}
+
+void Tracer::stop()
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    m_enabled = false;
+    m_stopRequested = true;
+    m_flushThread.join();
+    drain();
+
+    std::fprintf(m_file, "\n]}\n");
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+uint64_t Tracer::now()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counterToNanoseconds(static_cast<uint64_t>(counter.QuadPart));
+}
+
+uint64_t Tracer::counterToNanoseconds(uint64_t ticks)
+{
+    static const uint64_t frequency = getCounterFrequency();
+    // Split to avoid overflowing the multiplication
+    return ticks / frequency * 1'000'000'000 + ticks % frequency * 1'000'000'000 / frequency;
+}
+
+void Tracer::setThreadName(const char* name)
+{
+    if (isEnabled())
+    {
+        push(Event{name, 0, 0, getThreadRing().threadId, EventType::ThreadName, 0});
+    }
+}
+
+void Tracer::addSpan(const char* name, uint64_t beginNs, uint64_t endNs, uint32_t threadId)
+{
+    if (isEnabled())
+    {
+        ThreadRing& ring = getThreadRing();
+        push(Event{name, beginNs, endNs, threadId != 0 ? threadId : ring.threadId, EventType::Span, 0});
+    }
+}
+
+void Tracer::addCounter(const char* name, int64_t value)
+{
+    if (isEnabled())
+    {
+        const uint64_t nowNs = now();
+        push(Event{name, nowNs, nowNs, getThreadRing().threadId, EventType::Counter, value});
+    }
+}
+
+Tracer::ThreadRing& Tracer::getThreadRing()
+{
+    // Registered once per thread, rings are kept until the tracer is destroyed so the flusher can still drain them
+    thread_local ThreadRing* t_ring = nullptr;
+    if (t_ring == nullptr)
+    {
+        std::unique_ptr<ThreadRing> ring = std::make_unique<ThreadRing>();
+        ring->threadId = GetCurrentThreadId();
+        t_ring = ring.get();
+
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        m_rings.push_back(std::move(ring));
+    }
+    return *t_ring;
+}
+
+void Tracer::push(const Event& event)
+{
+    ThreadRing& ring = getThreadRing();
+    const uint32_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) == c_ringCapacity)
+    {
+        // The flusher has fallen behind, dropping keeps the hot path from ever waiting on it
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ring.events[head % c_ringCapacity] = event;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::flushLoop()
+{
+    while (!m_stopRequested.load())
+    {
+        drain();
+        std::this_thread::sleep_for(c_flushInterval);
+    }
+}
+
+void Tracer::drain()
+{
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    for (const std::unique_ptr<ThreadRing>& ring : m_rings)
+    {
+        const uint32_t head = ring->head.load(std::memory_order_acquire);
+        uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+        for (; tail != head; ++tail)
+        {
+            writeEvent(ring->events[tail % c_ringCapacity]);
+        }
+        ring->tail.store(tail, std::memory_order_release);
+
+        const uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0)
+        {
+            printf("WARNING: Dropped %llu trace events on thread %u\n", static_cast<unsigned long long>(dropped), ring->threadId);
+        }
+    }
+    std::fflush(m_file);
+}
+
+void Tracer::writeEvent(const Event& event)
+{
+    const char* separator = m_firstEvent ? "" : ",\n";
+    m_firstEvent = false;
+
+    if (event.type == EventType::ThreadName)
+    {
+        std::fprintf(m_file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", separator, m_processId, event.threadId, event.name);
+        return;
+    }
+    if (event.type == EventType::Counter)
+    {
+        const double timeUs = static_cast<double>(event.beginNs) / 1000.0;
+        std::fprintf(m_file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%u,\"ts\":%.3f,\"args\":{\"value\":%lld}}", separator, event.name, m_processId, timeUs, static_cast<long long>(event.value));
+        return;
+    }
+
+    const char* category = event.threadId == c_gpuQueueThreadId ? "gpu" : "cpu";
+    const double beginUs = static_cast<double>(event.beginNs) / 1000.0;
+    const double durationUs = static_cast<double>(event.endNs - event.beginNs) / 1000.0;
+    std::fprintf(m_file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", separator, event.name, category, m_processId, event.threadId, beginUs, durationUs);
+}
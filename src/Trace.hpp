@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Chrome Trace Event JSON export, the files can be opened in Perfetto or chrome://tracing. Every thread records into
+// its own single producer single consumer ring and a background thread drains the rings into the file, so recording
+// an event is a few stores without locks or allocations. Names must be string literals, only the pointer is stored.
+class Tracer final
+{
+public:
+    // Thread id used for spans measured on the GPU graphics queue
+    static const uint32_t c_gpuQueueThreadId = 0xffff0000;
+
+    static Tracer& get();
+    // Enabled when DXVK_INTEROP_TRACE is set, the trace is written to "<value>-<process id>.json"
+    static void startFromEnvironment();
+
+    ~Tracer();
+
+    void start(const char* path);
+    void stop();
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+    // Nanoseconds on the QueryPerformanceCounter time base, the same one GPU timestamps are calibrated to
+    static uint64_t now();
+    static uint64_t counterToNanoseconds(uint64_t ticks);
+
+    void setThreadName(const char* name);
+    void addSpan(const char* name, uint64_t beginNs, uint64_t endNs, uint32_t threadId = 0);
+    // Shown as a graph over time in the trace viewer
+    void addCounter(const char* name, int64_t value);
+
+private:
+    enum class EventType
+    {
+        Span,
+        ThreadName,
+        Counter
+    };
+
+    struct Event
+    {
+        const char* name;
+        uint64_t beginNs;
+        uint64_t endNs;
+        uint32_t threadId;
+        EventType type;
+        int64_t value;
+    };
+
+    static const uint32_t c_ringCapacity = 4096;
+
+    struct ThreadRing
+    {
+        Event events[c_ringCapacity];
+        std::atomic<uint32_t> head{0};
+        std::atomic<uint32_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        uint32_t threadId = 0;
+    };
+
+    Tracer() = default;
+    ThreadRing& getThreadRing();
+    void push(const Event& event);
+    void flushLoop();
+    void drain();
+    void writeEvent(const Event& event);
+
+    std::atomic<bool> m_enabled{false};
+    std::atomic<bool> m_stopRequested{false};
+    std::mutex m_ringsMutex;
+    std::vector<std::unique_ptr<ThreadRing>> m_rings;
+    std::thread m_flushThread;
+    FILE* m_file = nullptr;
+    bool m_firstEvent = true;
+    uint32_t m_processId = 0;
+};
+
+// Records a CPU span from construction to destruction on the calling thread
+class TraceScope final
+{
+public:
+    explicit TraceScope(const char* name) :
+        m_name(name),
+        m_beginNs(Tracer::get().isEnabled() ? Tracer::now() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        end();
+    }
+
+    // Ends the span before the scope does
+    void end()
+    {
+        if (m_beginNs != 0)
+        {
+            Tracer::get().addSpan(m_name, m_beginNs, Tracer::now());
+            m_beginNs = 0;
+        }
+    }
+
+private:
+    const char* m_name;
+    uint64_t m_beginNs;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -1 +1,51 @@
-#include "Utils.hpp"
\ No newline at end of file
+#include "Utils.hpp"
+#include <algorithm>
+
+bool isEmpty(const DirtyRect& rect)
+{
+    return rect.right <= rect.left || rect.bottom <= rect.top;
+}
+
+DirtyRect unite(const DirtyRect& a, const DirtyRect& b)
+{
+    if (isEmpty(a))
+    {
+        return b;
+    }
+    if (isEmpty(b))
+    {
+        return a;
+    }
+
+    DirtyRect rect;
+    rect.left = std::min(a.left, b.left);
+    rect.top = std::min(a.top, b.top);
+    rect.right = std::max(a.right, b.right);
+    rect.bottom = std::max(a.bottom, b.bottom);
+    return rect;
+}
+
+DirtyRect clampRect(const DirtyRect& rect, int width, int height)
+{
+    DirtyRect clamped;
+    clamped.left = std::clamp(rect.left, 0, width);
+    clamped.top = std::clamp(rect.top, 0, height);
+    clamped.right = std::clamp(rect.right, 0, width);
+    clamped.bottom = std::clamp(rect.bottom, 0, height);
+    return clamped;
+}
+
+DirtyRect expandRect(const DirtyRect& rect, int amount)
+{
+    if (isEmpty(rect))
+    {
+        return rect;
+    }
+
+    DirtyRect expanded;
+    expanded.left = rect.left - amount;
+    expanded.top = rect.top - amount;
+    expanded.right = rect.right + amount;
+    expanded.bottom = rect.bottom + amount;
+    return expanded;
+}
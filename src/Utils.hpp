@@ -2,6 +2,9 @@
 
 #include <cstdint>
 #include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 #define CHECK(f)                                                           \
     do                                                                     \
@@ -33,8 +36,66 @@ const int c_texChannels = 4;
 const int c_windowWidth = 1600;
 const int c_windowHeight = 1200;
 
+// Thrown for failures that can be handled by rebuilding the device level objects, e.g. device loss
+class RecoverableError : public std::runtime_error
+{
+public:
+    explicit RecoverableError(const std::string& what) :
+        std::runtime_error(what)
+    {
+    }
+};
+
+struct DirtyRect
+{
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+};
+
+bool isEmpty(const DirtyRect& rect);
+DirtyRect unite(const DirtyRect& a, const DirtyRect& b);
+DirtyRect clampRect(const DirtyRect& rect, int width, int height);
+DirtyRect expandRect(const DirtyRect& rect, int amount);
+
 template<typename T>
 uint32_t ui32Size(const T& container)
 {
     return static_cast<uint32_t>(container.size());
-}
\ No newline at end of file
+}
+
+// Non-owning view over contiguous elements, lets hot paths pass arrays without building temporary containers
+template<typename T>
+class Span
+{
+public:
+    Span() = default;
+    Span(T* data, size_t size) :
+        m_data(data),
+        m_size(size)
+    {
+    }
+    explicit Span(T& element) :
+        m_data(&element),
+        m_size(1)
+    {
+    }
+    template<typename Container, typename = decltype(std::declval<Container&>().data())>
+    Span(Container& container) :
+        m_data(container.data()),
+        m_size(container.size())
+    {
+    }
+
+    T* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    T* begin() const { return m_data; }
+    T* end() const { return m_data + m_size; }
+    T& operator[](size_t index) const { return m_data[index]; }
+
+private:
+    T* m_data = nullptr;
+    size_t m_size = 0;
+};
@@ -2,6 +2,21 @@
 #include <set>
 #include <string>
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+bool isRecoverableResult(VkResult result)
+{
+    return result == VK_ERROR_DEVICE_LOST || result == VK_ERROR_SURFACE_LOST_KHR;
+}
+
+void throwRecoverableError(const char* call, const char* file, int line, VkResult result)
+{
+    char message[512];
+    snprintf(message, sizeof(message), "%s failed at %s:%d. Result = %d", call, file, line, result);
+    throw RecoverableError(message);
+}
 
 void printInstanceLayers()
 {
@@ -72,6 +87,19 @@ QueueFamilyIndices getQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKH
         }
     }
 
+    for (unsigned int i = 0; i < queueFamilies.size(); ++i)
+    {
+        const VkQueueFlags flags = queueFamilies[i].queueFlags;
+        // Dirty rectangles start and end at any texel, a coarser granularity (or 0, whole mip levels only) can't copy them
+        const VkExtent3D& granularity = queueFamilies[i].minImageTransferGranularity;
+        const bool texelGranularity = granularity.width == 1 && granularity.height == 1 && granularity.depth == 1;
+        if (queueFamilies[i].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && texelGranularity)
+        {
+            indices.transferFamily = i;
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -92,6 +120,23 @@ bool hasDeviceExtensionSupport(VkPhysicalDevice physicalDevice)
     return requiredExtensions.empty();
 }
 
+bool hasDeviceExtension(VkPhysicalDevice physicalDevice, const char* extensionName)
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions)
+    {
+        if (std::strcmp(extension.extensionName, extensionName) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 SwapchainCapabilities getSwapchainCapabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
 {
     SwapchainCapabilities capabilities;
@@ -121,12 +166,82 @@ bool areSwapchainCapabilitiesAdequate(const SwapchainCapabilities& capabilities)
     return !capabilities.formats.empty() && !capabilities.presentModes.empty();
 }
 
+bool hasRequiredFeatures(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_3)
+    {
+        return false;
+    }
+
+    VkPhysicalDeviceVulkan13Features vulkan13Features{};
+    vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &vulkan13Features;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    return vulkan13Features.synchronization2 == VK_TRUE;
+}
+
 bool isDeviceSuitable(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
 {
     const bool allQueueFamilies = hasAllQueueFamilies(getQueueFamilies(physicalDevice, surface));
     const bool deviceExtensionSupport = hasDeviceExtensionSupport(physicalDevice);
     const bool swapchainCapabilitiesAdequate = areSwapchainCapabilitiesAdequate(getSwapchainCapabilities(physicalDevice, surface));
-    return allQueueFamilies && deviceExtensionSupport && swapchainCapabilitiesAdequate;
+    return allQueueFamilies && deviceExtensionSupport && swapchainCapabilitiesAdequate && hasRequiredFeatures(physicalDevice);
+}
+
+VkPhysicalDeviceIDProperties getPhysicalDeviceIdProperties(VkPhysicalDevice physicalDevice)
+{
+    VkPhysicalDeviceIDProperties idProperties{};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &idProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+    return idProperties;
+}
+
+bool findDeviceLuid(const uint8_t* uuid, uint8_t* luid)
+{
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.apiVersion = VK_API_VERSION_1_1;
+
+    VkInstanceCreateInfo instanceCreateInfo{};
+    instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceCreateInfo.pApplicationInfo = &appInfo;
+
+    VkInstance instance = VK_NULL_HANDLE;
+    if (vkCreateInstance(&instanceCreateInfo, nullptr, &instance) != VK_SUCCESS)
+    {
+        return false;
+    }
+
+    uint32_t deviceCount = 0;
+    vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+    bool found = false;
+    for (VkPhysicalDevice device : devices)
+    {
+        const VkPhysicalDeviceIDProperties idProperties = getPhysicalDeviceIdProperties(device);
+        if (idProperties.deviceLUIDValid && std::memcmp(idProperties.deviceUUID, uuid, VK_UUID_SIZE) == 0)
+        {
+            std::memcpy(luid, idProperties.deviceLUID, VK_LUID_SIZE);
+            found = true;
+            break;
+        }
+    }
+
+    vkDestroyInstance(instance, nullptr);
+    return found;
 }
 
 MemoryTypeResult findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties)
@@ -148,67 +263,123 @@ MemoryTypeResult findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFi
     return result;
 }
 
-SingleTimeCommand beginSingleTimeCommands(VkCommandPool commandPool, VkDevice device)
+bool isExternalImageImportSupported(VkPhysicalDevice physicalDevice, VkFormat format, VkImageUsageFlags usage, VkExternalMemoryHandleTypeFlagBits handleType)
 {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer));
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo));
-
-    SingleTimeCommand command;
-    command.commandBuffer = commandBuffer;
-    command.commandPool = commandPool;
-    command.device = device;
-    return command;
+    VkPhysicalDeviceExternalImageFormatInfo externalFormatInfo{};
+    externalFormatInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO;
+    externalFormatInfo.handleType = handleType;
+
+    VkPhysicalDeviceImageFormatInfo2 formatInfo{};
+    formatInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2;
+    formatInfo.pNext = &externalFormatInfo;
+    formatInfo.format = format;
+    formatInfo.type = VK_IMAGE_TYPE_2D;
+    formatInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    formatInfo.usage = usage;
+
+    VkExternalImageFormatProperties externalProperties{};
+    externalProperties.sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES;
+
+    VkImageFormatProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2;
+    properties.pNext = &externalProperties;
+
+    if (vkGetPhysicalDeviceImageFormatProperties2(physicalDevice, &formatInfo, &properties) != VK_SUCCESS)
+    {
+        return false;
+    }
+    return (externalProperties.externalMemoryProperties.externalMemoryFeatures & VK_EXTERNAL_MEMORY_FEATURE_IMPORTABLE_BIT) != 0;
 }
 
-void endSingleTimeCommands(VkQueue queue, SingleTimeCommand command)
+bool isExternalTimelineSemaphoreSupported(VkPhysicalDevice physicalDevice, VkExternalSemaphoreHandleTypeFlagBits handleType, VkExternalSemaphoreFeatureFlags features)
 {
-    VK_CHECK(vkEndCommandBuffer(command.commandBuffer));
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+
+    VkPhysicalDeviceExternalSemaphoreInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    semaphoreInfo.handleType = handleType;
+
+    VkExternalSemaphoreProperties properties{};
+    properties.sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES;
+    vkGetPhysicalDeviceExternalSemaphoreProperties(physicalDevice, &semaphoreInfo, &properties);
+    return (properties.externalSemaphoreFeatures & features) == features;
+}
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &command.commandBuffer;
+VkSemaphore createTimelineSemaphore(VkDevice device, const VkAllocationCallbacks* allocator, uint64_t initialValue, const void* next)
+{
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.pNext = next;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = initialValue;
+
+    VkSemaphoreCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    createInfo.pNext = &typeInfo;
+
+    VkSemaphore semaphore;
+    VK_CHECK(vkCreateSemaphore(device, &createInfo, allocator, &semaphore));
+    return semaphore;
+}
 
-    VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-    VK_CHECK(vkQueueWaitIdle(queue));
+uint32_t getMipLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    uint32_t size = std::max(width, height);
+    while (size > 1)
+    {
+        size >>= 1;
+        ++levels;
+    }
+    return levels;
+}
+
+bool hasLinearBlitSupport(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
 
-    vkFreeCommandBuffers(command.device, command.commandPool, 1, &command.commandBuffer);
+    const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures;
 }
 
-VkShaderModule createShaderModule(VkDevice device, const std::filesystem::path& path)
+bool readSpirvFile(const std::filesystem::path& path, std::vector<uint32_t>& code)
 {
-    printf("Creating shader module from %s\n", std::filesystem::absolute(path).string().c_str());
+    printf("Reading SPIR-V from %s\n", std::filesystem::absolute(path).string().c_str());
 
     std::ifstream file(path.string().c_str(), std::ios::ate | std::ios::binary);
-    CHECK(file.is_open());
+    if (!file.is_open())
+    {
+        return false;
+    }
 
     const size_t fileSize = static_cast<size_t>(file.tellg());
-    std::vector<char> buffer(fileSize);
+    if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0)
+    {
+        return false;
+    }
+    code.resize(fileSize / sizeof(uint32_t));
     file.seekg(0);
-    file.read(buffer.data(), fileSize);
-    file.close();
+    file.read(reinterpret_cast<char*>(code.data()), fileSize);
+    return static_cast<bool>(file);
+}
 
+VkResult createShaderModule(VkDevice device, const std::vector<uint32_t>& code, VkShaderModule& shaderModule)
+{
     VkShaderModuleCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = buffer.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(buffer.data());
+    createInfo.codeSize = code.size() * sizeof(uint32_t);
+    createInfo.pCode = code.data();
 
-    VkShaderModule shaderModule;
-    VK_CHECK(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule));
-
-    return shaderModule;
+    const VkResult result = vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule);
+    if (result != VK_SUCCESS)
+    {
+        shaderModule = VK_NULL_HANDLE;
+    }
+    return result;
 }
 
 StagingBuffer createStagingBuffer(VkDevice device, VkPhysicalDevice physicalDevice, const void* data, uint64_t size)
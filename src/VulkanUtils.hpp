@@ -19,6 +19,7 @@ const std::vector<const char*> c_deviceExtensions = {
 
 const VkExtent2D c_windowExtent{c_windowWidth, c_windowHeight};
 const VkSurfaceFormatKHR c_surfaceFormat{VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+const VkCompositeAlphaFlagBitsKHR c_compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 const VkFormat c_depthFormat = VK_FORMAT_D24_UNORM_S8_UINT;
 const uint32_t c_swapchainImageCount = 3;
 
@@ -26,6 +27,10 @@ const uint32_t c_swapchainImageCount = 3;
     do                                                                                          \
     {                                                                                           \
         const VkResult result = (f);                                                            \
+        if (isRecoverableResult(result))                                                        \
+        {                                                                                       \
+            throwRecoverableError(#f, __FILE__, __LINE__, result);                              \
+        }                                                                                       \
         if (result != VK_SUCCESS)                                                               \
         {                                                                                       \
             printf("Abort. %s failed at %s:%d. Result = %d\n", #f, __FILE__, __LINE__, result); \
@@ -38,6 +43,9 @@ struct QueueFamilyIndices
     int graphicsFamily = -1;
     int computeFamily = -1;
     int presentFamily = -1;
+    // Optional, a family with transfer but neither graphics nor compute, usually backed by a DMA engine. Only families
+    // that can copy single texels are used.
+    int transferFamily = -1;
 };
 
 struct SwapchainCapabilities
@@ -72,18 +80,32 @@ struct BarrierStageFlags
     VkPipelineStageFlags dst;
 };
 
+bool isRecoverableResult(VkResult result);
+[[noreturn]] void throwRecoverableError(const char* call, const char* file, int line, VkResult result);
 void printInstanceLayers();
 void printDeviceExtensions(VkPhysicalDevice physicalDevice);
 void printPhysicalDeviceName(VkPhysicalDeviceProperties properties);
 bool hasAllQueueFamilies(const QueueFamilyIndices& indices);
 QueueFamilyIndices getQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
 bool hasDeviceExtensionSupport(VkPhysicalDevice physicalDevice);
+bool hasDeviceExtension(VkPhysicalDevice physicalDevice, const char* extensionName);
 SwapchainCapabilities getSwapchainCapabilities(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
 bool areSwapchainCapabilitiesAdequate(const SwapchainCapabilities& capabilities);
+bool hasRequiredFeatures(VkPhysicalDevice physicalDevice);
 bool isDeviceSuitable(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
+VkPhysicalDeviceIDProperties getPhysicalDeviceIdProperties(VkPhysicalDevice physicalDevice);
+// Looks up the LUID of the device with the given UUID through a temporary instance, false if no device has both
+bool findDeviceLuid(const uint8_t* uuid, uint8_t* luid);
 MemoryTypeResult findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
-SingleTimeCommand beginSingleTimeCommands(VkCommandPool commandPool, VkDevice device);
-void endSingleTimeCommands(VkQueue queue, SingleTimeCommand command);
-VkShaderModule createShaderModule(VkDevice device, const std::filesystem::path& path);
+// Checks that an image with the given format and usage can be bound to imported memory of the handle type
+bool isExternalImageImportSupported(VkPhysicalDevice physicalDevice, VkFormat format, VkImageUsageFlags usage, VkExternalMemoryHandleTypeFlagBits handleType);
+// Checks that a timeline semaphore of the handle type has all the given import and export features
+bool isExternalTimelineSemaphoreSupported(VkPhysicalDevice physicalDevice, VkExternalSemaphoreHandleTypeFlagBits handleType, VkExternalSemaphoreFeatureFlags features);
+VkSemaphore createTimelineSemaphore(VkDevice device, const VkAllocationCallbacks* allocator, uint64_t initialValue, const void* next = nullptr);
+uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+bool hasLinearBlitSupport(VkPhysicalDevice physicalDevice, VkFormat format);
+// False if the file can't be read or isn't made of whole 32-bit words
+bool readSpirvFile(const std::filesystem::path& path, std::vector<uint32_t>& code);
+VkResult createShaderModule(VkDevice device, const std::vector<uint32_t>& code, VkShaderModule& shaderModule);
 StagingBuffer createStagingBuffer(VkDevice device, VkPhysicalDevice physicalDevice, const void* data, uint64_t size);
 void releaseStagingBuffer(VkDevice device, const StagingBuffer& buffer);
\ No newline at end of file
@@ -1,17 +1,242 @@
-
 #include "Context.hpp"
 #include "Renderer.hpp"
+#include "DX.hpp"
+#include "AllocationCounter.hpp"
+#include "SurfaceChannel.hpp"
+#include "Trace.hpp"
+#include "StartupTimeline.hpp"
+#include "FrameRecording.hpp"
+#include "FramePacer.hpp"
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+
+namespace
+{
+const int c_maxRecoveryAttempts = 3;
+const std::chrono::milliseconds c_producerFrameInterval(16);
+// Fail if the frame loop thread touches the heap once it has warmed up, needs the counting operator new
+#ifdef DXVK_INTEROP_COUNT_ALLOCATIONS
+const bool c_checkSteadyStateAllocations = true;
+#else
+const bool c_checkSteadyStateAllocations = false;
+#endif
+const uint64_t c_warmupFrameCount = 100;
+const uint64_t c_defaultRecordFrameCount = 600;
+
+void checkSteadyStateAllocations(uint64_t frameCount, uint64_t& warmupAllocationCount)
+{
+    if (frameCount < c_warmupFrameCount)
+    {
+        return;
+    }
+
+    const uint64_t allocationCount = getHeapAllocationCount();
+    if (frameCount == c_warmupFrameCount)
+    {
+        warmupAllocationCount = allocationCount;
+        return;
+    }
+
+    if (allocationCount != warmupAllocationCount)
+    {
+        printf("%llu heap allocations in steady state frame %llu\n", static_cast<unsigned long long>(allocationCount - warmupAllocationCount), static_cast<unsigned long long>(frameCount));
+        LOGE("Heap allocation in the frame loop");
+    }
+}
+
+void recover(Context& context, FrameSource* source, std::unique_ptr<Renderer>& renderer)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-int main(void)
+    for (int attempt = 1; attempt <= c_maxRecoveryAttempts; ++attempt)
+    {
+        try
+        {
+            renderer.reset();
+            context.recover();
+            renderer = std::make_unique<Renderer>(context, source);
+
+            const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+            printf("Recovered in %.1f ms (attempt %d)\n", duration.count(), attempt);
+            return;
+        }
+        catch (const RecoverableError& error)
+        {
+            printf("Recovery attempt %d failed: %s\n", attempt, error.what());
+        }
+    }
+
+    LOGE("Unable to recover");
+}
+
+// Renders the given source, or an in-process DX producer when none is given. The in-process producer replays the
+// recording if one is given.
+int runRenderer(FrameSource* source, const AdapterId& adapter, FrameReplay* replay = nullptr)
 {
-    Context context;
-    Renderer renderer(context);
+    // The in-process producer only shares the adapter with Vulkan, its device is created while Vulkan starts up
+    std::unique_ptr<DX> dx;
+    std::future<void> dxInit;
+    if (source == nullptr)
+    {
+        dx = std::make_unique<DX>();
+        source = dx.get();
+        dx->setFrameReplay(replay);
+        dxInit = std::async(std::launch::async, [&dx, &adapter]() {
+            StartupStep step("D3D11 producer");
+            dx->init(adapter);
+        });
+    }
+
+    Context context(adapter);
+    std::unique_ptr<Renderer> renderer = std::make_unique<Renderer>(context, source);
+    if (dxInit.valid())
+    {
+        dxInit.get();
+    }
+
+    // Max rate replays are benchmarks, they render as fast as the swapchain allows
+    std::unique_ptr<FramePacer> pacer = replay != nullptr && replay->isMaxRate() ? nullptr : FramePacer::createFromEnvironment();
+
+    uint64_t frameCount = 0;
+    uint64_t warmupAllocationCount = 0;
 
     bool running = true;
     while (running)
     {
-        running = renderer.render();
+        try
+        {
+            if (pacer)
+            {
+                pacer->waitForNextFrame();
+            }
+            running = renderer->render();
+            if (pacer)
+            {
+                pacer->endFrame(!source->getDirtyRects().empty());
+            }
+            ++frameCount;
+            if (frameCount == 1)
+            {
+                StartupTimeline::get().markFirstFrame();
+            }
+        }
+        catch (const RecoverableError& error)
+        {
+            printf("Recoverable error: %s\n", error.what());
+            recover(context, source, renderer);
+            frameCount = 0;
+        }
+
+        if (c_checkSteadyStateAllocations)
+        {
+            checkSteadyStateAllocations(frameCount, warmupAllocationCount);
+        }
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+// Runs only the DX side and streams frame notifications to a consumer process
+int runProducer()
+{
+    DX dx;
+    dx.init(DX::selectAdapter(getAdapterOverride()));
+
+    SurfaceProducerChannel channel(dx.getTexture(), dx.getSharedHandle());
+    channel.waitForConsumer();
+
+    std::vector<DXGI_FORMAT> requestedFormats;
+    uint64_t frameIndex = 0;
+    for (;;)
+    {
+        if (channel.receiveFormatRequest(requestedFormats))
+        {
+            dx.requestFormat(requestedFormats);
+            channel.sendSurface(dx.getTexture(), dx.getSharedHandle());
+        }
+        dx.update();
+        if (!channel.sendFrameReady(++frameIndex, dx.getDirtyRects()))
+        {
+            // Keeps producing for the next consumer, which gets the current surface when it connects
+            printf("Consumer disconnected\n");
+            channel.waitForConsumer();
+        }
+        std::this_thread::sleep_for(c_producerFrameInterval);
+    }
+}
+
+// Runs only the DX side and writes its frames to a recording
+int runRecorder(const char* path, uint64_t frameCount)
+{
+    DX dx;
+    dx.init(DX::selectAdapter(getAdapterOverride()));
+
+    FrameRecorder recorder(path, dx.getFormat());
+    dx.setFrameRecorder(&recorder);
+    while (recorder.getFrameCount() < frameCount)
+    {
+        dx.update();
+        std::this_thread::sleep_for(c_producerFrameInterval);
+    }
+    dx.setFrameRecorder(nullptr);
+    return 0;
+}
+
+int runConsumer()
+{
+    SurfaceConsumerChannel channel;
+
+    const SurfaceInfo& info = channel.getSurfaceInfo();
+    // The format is negotiated by the renderer
+    CHECK(info.width == c_texWidth && info.height == c_texHeight);
+
+    // The producer decides the adapter, the shared texture can only be imported on the same one
+    AdapterId adapter;
+    adapter.luidValid = true;
+    std::memcpy(adapter.luid, info.adapterLuid, sizeof(adapter.luid));
+
+    return runRenderer(&channel, adapter);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    StartupTimeline::get().start();
+    Tracer::startFromEnvironment();
+
+    int result = 0;
+    if (argc > 1 && std::strcmp(argv[1], "--producer") == 0)
+    {
+        Tracer::get().setThreadName("producer");
+        result = runProducer();
+    }
+    else if (argc > 1 && std::strcmp(argv[1], "--consumer") == 0)
+    {
+        Tracer::get().setThreadName("consumer render");
+        result = runConsumer();
+    }
+    else if (argc > 2 && std::strcmp(argv[1], "--record") == 0)
+    {
+        Tracer::get().setThreadName("recorder");
+        const uint64_t frameCount = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : c_defaultRecordFrameCount;
+        result = runRecorder(argv[2], frameCount);
+    }
+    else if (argc > 2 && std::strcmp(argv[1], "--replay") == 0)
+    {
+        Tracer::get().setThreadName("render");
+        FrameReplay replay(argv[2], argc > 3 && std::strcmp(argv[3], "--max-rate") == 0);
+        result = runRenderer(nullptr, DX::selectAdapter(getAdapterOverride()), &replay);
+    }
+    else
+    {
+        Tracer::get().setThreadName("render");
+        result = runRenderer(nullptr, DX::selectAdapter(getAdapterOverride()));
+    }
+
+    Tracer::get().stop();
+    return result;
+}
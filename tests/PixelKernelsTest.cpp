@@ -0,0 +1,156 @@
+// Checks that every SIMD pixel kernel version the CPU supports writes exactly the same bytes as the scalar reference.
+// Counts and widths go past several vector widths so that every remainder handled by the scalar tails is covered, and
+// the buffers are offset so that unaligned loads and stores are exercised as well.
+#include "PixelKernelsImpl.hpp"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+const size_t c_maxCount = 80;
+const size_t c_maxOffset = 3;
+const size_t c_firstPixels[] = {0, 1, 7, 37, 1000003};
+const uint32_t c_maxWidth = 70;
+const uint32_t c_heights[] = {2, 6};
+
+const PixelIsa c_simdIsas[] = {PixelIsa::Sse2, PixelIsa::Avx2, PixelIsa::Neon};
+
+// Covers every byte value and translucent alpha, the test pattern alone is always opaque
+std::vector<uint32_t> createSource(size_t count)
+{
+    std::vector<uint32_t> source(count);
+    uint32_t state = 0x12345678;
+    for (uint32_t& pixel : source)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        pixel = state;
+    }
+    return source;
+}
+
+bool report(const char* kernel, PixelIsa isa, const char* parameters, bool matches)
+{
+    if (!matches)
+    {
+        printf("MISMATCH: %s %s, %s\n", kernel, getPixelIsaName(isa), parameters);
+    }
+    return matches;
+}
+
+bool testFill(const PixelKernelTable& table, PixelIsa isa)
+{
+    const PixelKernelTable* scalar = getPixelKernelTable(PixelIsa::Scalar);
+    bool matches = true;
+    for (size_t firstPixel : c_firstPixels)
+    {
+        for (size_t offset = 0; offset <= c_maxOffset; ++offset)
+        {
+            for (size_t count = 0; count <= c_maxCount; ++count)
+            {
+                std::vector<uint32_t> expected(offset + count + 1, 0xdeadbeef);
+                std::vector<uint32_t> actual(expected);
+                scalar->fillTestPattern(expected.data() + offset, count, firstPixel);
+                table.fillTestPattern(actual.data() + offset, count, firstPixel);
+
+                char parameters[128];
+                snprintf(parameters, sizeof(parameters), "count %zu, offset %zu, first pixel %zu", count, offset, firstPixel);
+                matches = report("fill", isa, parameters, expected == actual) && matches;
+            }
+        }
+    }
+    return matches;
+}
+
+bool testPixelKernel(const char* kernel, void (*reference)(const uint32_t*, uint32_t*, size_t), void (*tested)(const uint32_t*, uint32_t*, size_t), PixelIsa isa)
+{
+    const std::vector<uint32_t> source = createSource(c_maxCount + c_maxOffset);
+    bool matches = true;
+    for (size_t offset = 0; offset <= c_maxOffset; ++offset)
+    {
+        for (size_t count = 0; count <= c_maxCount; ++count)
+        {
+            // The last element must stay untouched
+            std::vector<uint32_t> expected(offset + count + 1, 0xdeadbeef);
+            std::vector<uint32_t> actual(expected);
+            reference(source.data() + offset, expected.data() + offset, count);
+            tested(source.data() + offset, actual.data() + offset, count);
+
+            char parameters[128];
+            snprintf(parameters, sizeof(parameters), "count %zu, offset %zu", count, offset);
+            matches = report(kernel, isa, parameters, expected == actual) && matches;
+        }
+    }
+    return matches;
+}
+
+// Luma followed by the chroma plane or planes, uvStep 2 is NV12 and 1 is I420
+std::vector<uint8_t> convertYuv(const PixelKernelTable& table, const uint8_t* source, uint32_t width, uint32_t height, uint32_t uvStep)
+{
+    const size_t lumaSize = size_t(width) * height;
+    std::vector<uint8_t> yuv(lumaSize * 3 / 2 + 1, 0xcd);
+    uint8_t* luma = yuv.data();
+    uint8_t* u = luma + lumaSize;
+    uint8_t* v = uvStep == 2 ? u + 1 : u + lumaSize / 4;
+    const uint32_t uvStride = uvStep == 2 ? width : width / 2;
+    convertRgbaToYuv420(table, source, width * 4, width, height, luma, width, u, v, uvStride, uvStep);
+    return yuv;
+}
+
+bool testYuv(const PixelKernelTable& table, PixelIsa isa)
+{
+    const std::vector<uint32_t> pixels = createSource(size_t(c_maxWidth) * c_heights[1] + c_maxOffset);
+    const PixelKernelTable* scalar = getPixelKernelTable(PixelIsa::Scalar);
+    bool matches = true;
+    for (uint32_t height : c_heights)
+    {
+        for (uint32_t width = 2; width <= c_maxWidth; width += 2)
+        {
+            for (size_t offset = 0; offset <= c_maxOffset; ++offset)
+            {
+                // Byte offsets, the source rows are not even pixel aligned
+                const uint8_t* source = reinterpret_cast<const uint8_t*>(pixels.data()) + offset;
+                for (uint32_t uvStep : {1u, 2u})
+                {
+                    const bool same = convertYuv(*scalar, source, width, height, uvStep) == convertYuv(table, source, width, height, uvStep);
+                    char parameters[128];
+                    snprintf(parameters, sizeof(parameters), "%ux%u, offset %zu", width, height, offset);
+                    matches = report(uvStep == 2 ? "RGBA to NV12" : "RGBA to I420", isa, parameters, same) && matches;
+                }
+            }
+        }
+    }
+    return matches;
+}
+} // namespace
+
+int main()
+{
+    bool matches = true;
+    int testedCount = 0;
+    for (PixelIsa isa : c_simdIsas)
+    {
+        const PixelKernelTable* table = getPixelKernelTable(isa);
+        if (table == nullptr)
+        {
+            printf("%s: not supported, skipped\n", getPixelIsaName(isa));
+            continue;
+        }
+
+        bool isaMatches = testFill(*table, isa);
+        isaMatches = testPixelKernel("swizzle", scalarSwizzleRgbaBgra, table->swizzleRgbaBgra, isa) && isaMatches;
+        isaMatches = testPixelKernel("premultiply", scalarPremultiplyAlpha, table->premultiplyAlpha, isa) && isaMatches;
+        isaMatches = testYuv(*table, isa) && isaMatches;
+        printf("%s: %s\n", getPixelIsaName(isa), isaMatches ? "matches the scalar reference" : "differs from the scalar reference");
+        matches = matches && isaMatches;
+        ++testedCount;
+    }
+
+    if (testedCount == 0)
+    {
+        printf("No SIMD version is supported, nothing to compare\n");
+    }
+    return matches ? 0 : 1;
+}